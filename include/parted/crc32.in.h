@@ -32,4 +32,20 @@
 extern uint32_t __efi_crc32 (const void *buf, unsigned long len,
 			     uint32_t seed) _GL_ATTRIBUTE_PURE;
 
+/*
+ * The implementations __efi_crc32 picks from, exported for the tests.
+ * __efi_crc32_ref is the plain byte-at-a-time one.  __efi_crc32_hw returns
+ * the one using CRC or carry-less multiply instructions, and sets *NAME to
+ * its name, or returns NULL if this CPU has none.
+ */
+
+typedef uint32_t (*efi_crc32_fn) (const void *buf, unsigned long len,
+				  uint32_t seed);
+
+extern uint32_t __efi_crc32_ref (const void *buf, unsigned long len,
+				 uint32_t seed) _GL_ATTRIBUTE_PURE;
+extern uint32_t __efi_crc32_slice8 (const void *buf, unsigned long len,
+				    uint32_t seed) _GL_ATTRIBUTE_PURE;
+extern efi_crc32_fn __efi_crc32_hw (const char **name);
+
 #endif /* _CRC32_H */
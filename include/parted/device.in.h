@@ -27,6 +27,8 @@
 #ifndef PED_DEVICE_H_INCLUDED
 #define PED_DEVICE_H_INCLUDED
 
+#include <sys/types.h>
+
 /** We can address 2^63 sectors */
 typedef long long PedSector;
 
@@ -58,6 +60,8 @@ typedef enum {
 typedef struct _PedDevice PedDevice;
 typedef struct _PedDeviceArchOps PedDeviceArchOps;
 typedef struct _PedCHSGeometry PedCHSGeometry;
+typedef struct _PedDeviceStats PedDeviceStats;
+typedef struct _PedIoVec PedIoVec;
 
 /**
  * A cylinder-head-sector "old-style" geometry.
@@ -97,6 +101,35 @@ struct _PedDevice {
         void*           arch_specific;
 };
 
+/**
+ * I/O counters for a device, as returned by ped_device_get_stats().
+ * They count from the creation of the PedDevice.
+ */
+struct _PedDeviceStats {
+        unsigned long long      read_requests;  /**< sector ranges read */
+        unsigned long long      write_requests; /**< ped_device_write() calls */
+        unsigned long long      read_syscalls;  /**< system calls issued
+                                                     to read data */
+        unsigned long long      write_syscalls; /**< system calls issued
+                                                     to write data */
+        unsigned long long      sectors_read;
+        unsigned long long      sectors_written;
+        unsigned long long      cache_hits;     /**< reads served entirely
+                                                     from the read cache */
+        unsigned long long      cache_misses;   /**< cacheable reads that
+                                                     went to the device */
+};
+
+/**
+ * One sector range of a ped_device_read_batch() request.
+ */
+struct _PedIoVec {
+        void*           buffer;         /**< count sectors are read here,
+                                             or written from here */
+        PedSector       start;
+        PedSector       count;
+};
+
 #include <parted/natmath.h>
 
 /**
@@ -122,6 +155,13 @@ struct _PedDeviceArchOps {
         /* These functions are optional */
         PedAlignment *(*get_minimum_alignment)(const PedDevice *dev);
         PedAlignment *(*get_optimum_alignment)(const PedDevice *dev);
+        void (*get_stats) (const PedDevice* dev, PedDeviceStats* stats);
+        int (*read_batch) (const PedDevice* dev, PedIoVec* iov, int n);
+        int (*write_batch) (PedDevice* dev, PedIoVec* iov, int n);
+        int (*prefetch) (PedDevice* dev);
+        int (*get_devt) (const PedDevice* dev, dev_t* devt);
+        char* (*devt_path) (dev_t devt);
+        PedSector (*next_data) (const PedDevice* dev, PedSector start);
 };
 
 #include <parted/constraint.h>
@@ -131,6 +171,8 @@ extern void ped_device_probe_all ();
 extern void ped_device_free_all ();
 
 extern PedDevice* ped_device_get (const char* name);
+extern PedDevice* ped_device_get_by_devt (dev_t devt);
+extern PedDevice* ped_device_dup (const PedDevice* dev);
 extern PedDevice* ped_device_get_next (const PedDevice* dev) _GL_ATTRIBUTE_PURE;
 extern int ped_device_is_busy (PedDevice* dev);
 extern int ped_device_open (PedDevice* dev);
@@ -143,8 +185,11 @@ extern int ped_device_end_external_access (PedDevice* dev);
 
 extern int ped_device_read (const PedDevice* dev, void* buffer,
                             PedSector start, PedSector count);
+extern int ped_device_read_batch (const PedDevice* dev, PedIoVec* iov, int n);
+extern PedSector ped_device_next_data (const PedDevice* dev, PedSector start);
 extern int ped_device_write (PedDevice* dev, const void* buffer,
                              PedSector start, PedSector count);
+extern int ped_device_write_batch (PedDevice* dev, PedIoVec* iov, int n);
 extern int ped_device_sync (PedDevice* dev);
 extern int ped_device_sync_fast (PedDevice* dev);
 extern PedSector ped_device_check (PedDevice* dev, void* buffer,
@@ -159,6 +204,17 @@ extern PedConstraint *ped_device_get_optimal_aligned_constraint(
 extern PedAlignment *ped_device_get_minimum_alignment(const PedDevice *dev);
 extern PedAlignment *ped_device_get_optimum_alignment(const PedDevice *dev);
 
+extern int ped_device_get_stats (const PedDevice* dev, PedDeviceStats* stats);
+
+/**
+ * Called by ped_device_scan() for each device, in order.
+ */
+typedef int PedDeviceScanFunc (PedDevice* dev, void* data);
+
+extern int ped_device_prefetch (PedDevice* dev);
+extern int ped_device_scan (PedDevice** devs, int n, int jobs,
+                            PedDeviceScanFunc* func, void* data);
+
 /* private stuff ;-) */
 
 extern void _ped_device_probe (const char* path);
@@ -51,6 +51,22 @@ enum _PedDiskFlag {
 #define PED_DISK_FIRST_FLAG             1 // PED_DISK_CYLINDER_ALIGNMENT
 #define PED_DISK_LAST_FLAG              2 // PED_DISK_GPT_PMBR_BOOT
 
+/**
+ * Flags for ped_disk_new_with_flags()
+ */
+enum _PedDiskOpenFlag {
+        /* Trust a valid primary partition table, and only check a backup
+           copy of it (GPT has one at the end of the disk) when
+           ped_disk_check() is called or the table is committed.  Meant
+           for callers that only list partitions.  */
+        PED_DISK_OPEN_LAZY_BACKUP=1,
+        /* Don't guess a BIOS cylinder/head/sector geometry from the
+           partition table (msdos does, from the CHS values of its
+           entries), and keep the device's.  Meant for callers that
+           only deal in sectors.  */
+        PED_DISK_OPEN_LBA_ONLY=2,
+};
+
 /**
  * Partition types
  */
@@ -113,6 +129,7 @@ struct _PedDiskType;
 struct _PedDiskArchOps;
 
 typedef enum _PedDiskFlag               PedDiskFlag;
+typedef enum _PedDiskOpenFlag           PedDiskOpenFlag;
 typedef enum _PedPartitionType          PedPartitionType;
 typedef enum _PedPartitionFlag          PedPartitionFlag;
 typedef enum _PedDiskTypeFeature        PedDiskTypeFeature;
@@ -210,6 +227,27 @@ struct _PedDisk {
         int                 update_mode;        /**< mode without free/metadata
                                                    partitions, for easier
                                                    update */
+        PedPartition**      num_index;          /**< partitions by number,
+                                                   built on demand */
+        int                 num_index_len;      /**< length of num_index, or
+                                                   -1 if it is out of date */
+        PedPartition**      geom_index;         /**< primary, then logical
+                                                   partitions in list order,
+                                                   built on demand */
+        int                 geom_index_len;     /**< length of geom_index, or
+                                                   -1 if it is out of date */
+        int                 geom_index_split;   /**< position of the first
+                                                   logical partition */
+        int                 geom_index_flags;   /**< what lookups may assume
+                                                   about geom_index */
+        int                 open_flags;         /**< PedDiskOpenFlag bits the
+                                                   table was read with */
+        int                 batch_depth;        /**< ped_disk_begin_batch()
+                                                   calls not yet ended */
+        int                 batch_dirty;        /**< a commit was put off
+                                                   until the batch ends */
+        int                 batch_clobber;      /**< needs_clobber, put off
+                                                   until the batch ends */
 };
 
 struct _PedDiskOps {
@@ -279,6 +317,8 @@ struct _PedDiskOps {
         PedAlignment *(*get_partition_alignment)(const PedDisk *disk);
         PedSector (*max_length) (void);
         PedSector (*max_start_sector) (void);
+        /* optional: label specific part of ped_disk_check() */
+        int (*check) (const PedDisk* disk);
 };
 
 struct _PedDiskType {
@@ -314,6 +354,7 @@ extern int ped_disk_type_check_feature (const PedDiskType* disk_type,
 extern PedDiskType* ped_disk_probe (PedDevice* dev);
 extern int ped_disk_clobber (PedDevice* dev);
 extern PedDisk* ped_disk_new (PedDevice* dev);
+extern PedDisk* ped_disk_new_with_flags (PedDevice* dev, int flags);
 extern PedDisk* ped_disk_new_fresh (PedDevice* dev,
                                     const PedDiskType* disk_type);
 extern PedDisk* ped_disk_duplicate (const PedDisk* old_disk);
@@ -321,6 +362,9 @@ extern void ped_disk_destroy (PedDisk* disk);
 extern int ped_disk_commit (PedDisk* disk);
 extern int ped_disk_commit_to_dev (PedDisk* disk);
 extern int ped_disk_commit_to_os (PedDisk* disk);
+extern int ped_disk_begin_batch (PedDisk* disk);
+extern int ped_disk_end_batch (PedDisk* disk);
+extern int ped_disk_in_batch (const PedDisk* disk);
 extern int ped_disk_check (const PedDisk* disk);
 extern void ped_disk_print (const PedDisk* disk);
 
@@ -425,6 +469,7 @@ extern PedSector ped_disk_max_partition_start_sector (const PedDisk *disk);
 /* internal functions */
 extern PedDisk* _ped_disk_alloc (const PedDevice* dev, const PedDiskType* type);
 extern void _ped_disk_free (PedDisk* disk);
+extern void _ped_disk_renumbered (PedDisk* disk);
 
 
 /** @} */
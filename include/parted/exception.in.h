@@ -87,7 +87,9 @@ struct _PedException {
 
 typedef PedExceptionOption (PedExceptionHandler) (PedException* ex);
 
-extern int ped_exception;	/* set to true if there's an exception */
+/* set to true if there's an exception; not meaningful when several
+   threads use libparted */
+extern int ped_exception;
 
 extern char* ped_exception_get_type_string (PedExceptionType ex_type)
      _GL_ATTRIBUTE_CONST;
@@ -31,13 +31,28 @@ typedef struct _PedFileSystem		PedFileSystem;
 typedef struct _PedFileSystemType	PedFileSystemType;
 typedef struct _PedFileSystemAlias	PedFileSystemAlias;
 typedef const struct _PedFileSystemOps	PedFileSystemOps;
+typedef struct _PedFileSystemMagic	PedFileSystemMagic;
 
 #include <parted/geom.h>
 #include <parted/constraint.h>
 #include <parted/timer.h>
 
+/**
+ * A signature that the probe of a file system type requires, at a fixed
+ * place from the start of the file system: \p offset bytes into sector
+ * \p sector.
+ */
+struct _PedFileSystemMagic {
+	PedSector	sector;
+	int		offset;
+	int		length;		/**< 0 ends a list of magics */
+	const char*	bytes;
+};
+
 struct _PedFileSystemOps {
 	PedGeometry* (*probe) (PedGeometry* geom);
+	/* Optional: the probe fails unless one of these is found.  */
+	const PedFileSystemMagic* magic;
 };
 
 /**
@@ -93,6 +108,18 @@ ped_file_system_alias_get_next (const PedFileSystemAlias* fs_alias)
   _GL_ATTRIBUTE_PURE;
 
 extern PedFileSystemType* ped_file_system_probe (PedGeometry* geom);
+
+/**
+ * Called by ped_file_system_scan() for each sector where a file system
+ * may start.  Returns zero to stop the scan.
+ */
+typedef int PedFileSystemScanFunc (PedSector start, void* data);
+
+extern int ped_file_system_scan (PedGeometry* starts, PedTimer* timer,
+				 PedFileSystemScanFunc* func, void* data);
+extern int ped_file_system_scan_jobs (PedGeometry* starts, int jobs,
+				      PedTimer* timer,
+				      PedFileSystemScanFunc* func, void* data);
 extern PedGeometry* ped_file_system_probe_specific (
 			const PedFileSystemType* fs_type,
 			PedGeometry* geom);
@@ -30,14 +30,17 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <syscall.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <dirent.h>
+#include <limits.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/utsname.h>        /* for uname() */
 #include <scsi/scsi.h>
 #include <assert.h>
@@ -71,10 +74,6 @@
 
 #define KERNEL_VERSION(a,b,c) (((a) << 16) + ((b) << 8) + (c))
 
-#ifndef __NR__llseek
-#define __NR__llseek 140
-#endif
-
 #ifndef SCSI_IOCTL_SEND_COMMAND
 #define SCSI_IOCTL_SEND_COMMAND 1
 #endif
@@ -297,6 +296,10 @@ static unsigned int _device_get_partition_range(PedDevice const* dev);
 static int _device_open (PedDevice* dev, int flags);
 static int _device_open_ro (PedDevice* dev);
 static int _device_close (PedDevice* dev);
+static char* zasprintf (const char *format, ...);
+#if ENABLE_IO_URING
+static void _uring_destroy (PedDevice* dev);
+#endif
 
 static int
 _read_fd (int fd, char **buf)
@@ -717,21 +720,29 @@ _device_probe_type (PedDevice* dev)
 static int
 _get_linux_version ()
 {
+        /* Threads may race to fill this in, but they all store the
+           same value.  */
         static int kver = -1;
 
         struct utsname uts;
         unsigned int major = 0;
         unsigned int minor = 0;
         unsigned int teeny = 0;
+        int v = __atomic_load_n (&kver, __ATOMIC_RELAXED);
 
-        if (kver != -1)
-                return kver;
+        if (v != -1)
+                return v;
 
-        if (uname (&uts))
-                return kver = 0;
-        int n = sscanf (uts.release, "%u.%u.%u", &major, &minor, &teeny);
-        assert (n == 2 || n == 3);
-        return kver = KERNEL_VERSION (major, minor, teeny);
+        if (uname (&uts)) {
+                v = 0;
+        } else {
+                int n = sscanf (uts.release, "%u.%u.%u",
+                                &major, &minor, &teeny);
+                assert (n == 2 || n == 3);
+                v = KERNEL_VERSION (major, minor, teeny);
+        }
+        __atomic_store_n (&kver, v, __ATOMIC_RELAXED);
+        return v;
 }
 
 #if USE_BLKID
@@ -1451,6 +1462,15 @@ linux_new (const char* path)
                 goto error_free_path;
         arch_specific = LINUX_SPECIFIC (dev);
         arch_specific->dmtype = NULL;
+        memset (arch_specific->iobuf, 0, sizeof (arch_specific->iobuf));
+        memset (&arch_specific->stats, 0, sizeof (arch_specific->stats));
+        arch_specific->cache_data = NULL;
+        memset (arch_specific->cache, 0, sizeof (arch_specific->cache));
+        arch_specific->cache_clock = 0;
+#if ENABLE_IO_URING
+        arch_specific->ring = NULL;
+        arch_specific->ring_failed = 0;
+#endif
 #if USE_BLKID
         arch_specific->probe = NULL;
         arch_specific->topology = NULL;
@@ -1608,6 +1628,277 @@ error:
         return NULL;
 }
 
+/* Release the memory held by the bounce-buffer pool of DEV.  Buffers
+ * still handed out are left alone.
+ */
+static void
+_iobuf_pool_free (PedDevice* dev)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        int             i;
+
+        for (i = 0; i < LINUX_IOBUF_POOL_SIZE; i++) {
+                LinuxIOBuf*     b = &arch_specific->iobuf[i];
+
+                if (b->busy)
+                        continue;
+                free (b->buf);
+                b->buf = NULL;
+                b->size = 0;
+        }
+}
+
+/* Return a buffer of at least LENGTH bytes aligned to the sector size of
+ * DEV.  It comes from a small per-device pool whose slots grow on demand,
+ * so that repeated small reads don't hit the allocator every time.  If
+ * every slot is in use, a one-off buffer is allocated.  Hand the buffer
+ * back with _iobuf_put().
+ */
+static void*
+_iobuf_get (const PedDevice* dev, size_t length)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        size_t          align = dev->sector_size;
+        LinuxIOBuf*     slot = NULL;
+        void*           buf;
+        int             i;
+
+        for (i = 0; i < LINUX_IOBUF_POOL_SIZE; i++) {
+                LinuxIOBuf*     b = &arch_specific->iobuf[i];
+
+                if (b->busy)
+                        continue;
+                if (b->buf && b->size >= length && b->align == align) {
+                        b->busy = 1;
+                        return b->buf;
+                }
+                if (!slot)
+                        slot = b;
+        }
+
+        if (!slot) {
+                if (posix_memalign (&buf, align, length) != 0)
+                        return NULL;
+                return buf;
+        }
+
+        /* Grow geometrically so that a run of slightly increasing
+           requests doesn't reallocate each time.  */
+        size_t size = PED_MAX (length, 2 * slot->size);
+        if (posix_memalign (&buf, align, size) != 0)
+                return NULL;
+        free (slot->buf);
+        slot->buf = buf;
+        slot->size = size;
+        slot->align = align;
+        slot->busy = 1;
+        return buf;
+}
+
+static void
+_iobuf_put (const PedDevice* dev, void* buf)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        int             i;
+
+        for (i = 0; i < LINUX_IOBUF_POOL_SIZE; i++) {
+                if (arch_specific->iobuf[i].buf == buf) {
+                        arch_specific->iobuf[i].busy = 0;
+                        return;
+                }
+        }
+        free (buf);
+}
+
+/* Nonzero if BUF can be handed to read/write directly, without going
+ * through a bounce buffer.
+ */
+static inline int
+_is_sector_aligned (const PedDevice* dev, const void* buf)
+{
+        return (uintptr_t) buf % dev->sector_size == 0;
+}
+
+/* The read cache.  Small reads go through a little LRU cache of
+ * fixed-size blocks, so that the many label and file system probes that
+ * look at the same few sectors (the first 34, the last 33, superblocks)
+ * only hit the device once.  Any write drops the whole cache, and so does
+ * closing the device.
+ */
+
+/* Reads of more than this many blocks bypass the cache.  */
+#define LINUX_CACHE_MAX_SPAN    16
+
+static PedSector
+_cache_block_sectors (const PedDevice* dev)
+{
+        return PED_MAX (LINUX_CACHE_BLOCK_SIZE / dev->sector_size, 1);
+}
+
+static void
+_cache_invalidate (const PedDevice* dev)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        int             i;
+
+        for (i = 0; i < LINUX_CACHE_BLOCKS; i++)
+                arch_specific->cache[i].start = -1;
+}
+
+static void
+_cache_free (PedDevice* dev)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+
+        _cache_invalidate (dev);
+        free (arch_specific->cache_data);
+        arch_specific->cache_data = NULL;
+}
+
+static int
+_cache_lookup (const PedDevice* dev, PedSector block_start)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        int             i;
+
+        for (i = 0; i < LINUX_CACHE_BLOCKS; i++) {
+                if (arch_specific->cache[i].start == block_start)
+                        return i;
+        }
+        return -1;
+}
+
+static void*
+_cache_block_data (const PedDevice* dev, int slot)
+{
+        return (char *) LINUX_SPECIFIC (dev)->cache_data
+               + slot * _cache_block_sectors (dev) * dev->sector_size;
+}
+
+static int
+_cache_alloc (const PedDevice* dev)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        PedSector       bs = _cache_block_sectors (dev);
+
+        if (arch_specific->cache_data)
+                return 1;
+        if (posix_memalign (&arch_specific->cache_data, dev->sector_size,
+                            LINUX_CACHE_BLOCKS * bs * dev->sector_size) != 0) {
+                arch_specific->cache_data = NULL;
+                return 0;
+        }
+        _cache_invalidate (dev);
+        return 1;
+}
+
+/* Read the blocks FIRST to LAST (inclusive block starts) from FD with a
+ * single pread and put them in the cache, evicting the least recently
+ * used blocks as needed.
+ */
+static int
+_cache_fill (const PedDevice* dev, int fd, PedSector first, PedSector last)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        PedSector       bs = _cache_block_sectors (dev);
+        PedSector       fetch_end = PED_MIN (last + bs, dev->length);
+        size_t          length = (fetch_end - first) * dev->sector_size;
+        PedSector       b;
+        void*           diobuf;
+        int             slot;
+
+        diobuf = _iobuf_get (dev, length);
+        if (!diobuf)
+                return 0;
+        arch_specific->stats.cache_misses++;
+        arch_specific->stats.read_syscalls++;
+        if (pread (fd, diobuf, length, (off_t) first * dev->sector_size)
+            != (ssize_t) length) {
+                _iobuf_put (dev, diobuf);
+                return 0;
+        }
+        arch_specific->stats.sectors_read += fetch_end - first;
+
+        for (b = first; b <= last; b += bs) {
+                slot = _cache_lookup (dev, b);
+                if (slot < 0) {
+                        int i;
+                        slot = 0;
+                        for (i = 1; i < LINUX_CACHE_BLOCKS; i++) {
+                                if (arch_specific->cache[i].used
+                                    < arch_specific->cache[slot].used)
+                                        slot = i;
+                        }
+                }
+                memcpy (_cache_block_data (dev, slot),
+                        (char *) diobuf + (b - first) * dev->sector_size,
+                        (PED_MIN (b + bs, fetch_end) - b) * dev->sector_size);
+                arch_specific->cache[slot].start = b;
+                arch_specific->cache[slot].used = arch_specific->cache_clock;
+        }
+        _iobuf_put (dev, diobuf);
+        return 1;
+}
+
+/* Serve the read of COUNT sectors at START from the cache, first fetching
+ * the missing blocks with a single pread.  Returns zero if the read is
+ * not cacheable or the fetch did not work out; the caller then does the
+ * read itself, and reports any error.
+ */
+static int
+_cache_read (const PedDevice* dev, void* buffer, PedSector start,
+             PedSector count)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        PedSector       bs = _cache_block_sectors (dev);
+        PedSector       first = start / bs * bs;
+        PedSector       last = (start + count - 1) / bs * bs;
+        PedSector       miss_first = -1;
+        PedSector       miss_last = -1;
+        PedSector       b;
+        int             slot;
+
+        if (count <= 0 || start < 0 || start + count > dev->length
+            || (last - first) / bs + 1 > LINUX_CACHE_MAX_SPAN)
+                return 0;
+
+        if (!_cache_alloc (dev))
+                return 0;
+
+        /* Mark the blocks we already have as used now, so that fetching
+           the others can't evict them.  */
+        arch_specific->cache_clock++;
+        for (b = first; b <= last; b += bs) {
+                slot = _cache_lookup (dev, b);
+                if (slot >= 0) {
+                        arch_specific->cache[slot].used
+                                = arch_specific->cache_clock;
+                } else {
+                        if (miss_first == -1)
+                                miss_first = b;
+                        miss_last = b;
+                }
+        }
+
+        if (miss_first == -1)
+                arch_specific->stats.cache_hits++;
+        else if (!_cache_fill (dev, arch_specific->fd, miss_first, miss_last))
+                return 0;
+
+        for (b = first; b <= last; b += bs) {
+                PedSector from = PED_MAX (b, start);
+                PedSector to = PED_MIN (b + bs, start + count);
+
+                slot = _cache_lookup (dev, b);
+                PED_ASSERT (slot >= 0);
+                memcpy ((char *) buffer + (from - start) * dev->sector_size,
+                        (char *) _cache_block_data (dev, slot)
+                        + (from - b) * dev->sector_size,
+                        (to - from) * dev->sector_size);
+        }
+        return 1;
+}
+
 static void
 linux_destroy (PedDevice* dev)
 {
@@ -1618,6 +1909,11 @@ linux_destroy (PedDevice* dev)
         if (arch_specific->probe)
                 blkid_free_probe(arch_specific->probe);
 #endif
+#if ENABLE_IO_URING
+        _uring_destroy (dev);
+#endif
+        _cache_free (dev);
+        _iobuf_pool_free (dev);
         free (p);
         free (dev->arch_specific);
         free (dev->path);
@@ -1776,6 +2072,11 @@ retry:
 			dev->path, strerror (errno))
 				== PED_EXCEPTION_RETRY)
 			goto retry;
+#if ENABLE_IO_URING
+        _uring_destroy (dev);
+#endif
+        _cache_free (dev);
+        _iobuf_pool_free (dev);
         return 1;
 }
 
@@ -1796,52 +2097,129 @@ _device_close (PedDevice* dev)
     return rc;
 }
 
-#if SIZEOF_OFF_T < 8
+/* Byte offset of SECTOR on DEV, for use with pread and pwrite.  These
+ * don't touch the shared file offset, so each request is a single system
+ * call and the descriptor can be used from several threads.
+ */
+static inline off_t
+_device_offset (const PedDevice* dev, PedSector sector)
+{
+        PED_ASSERT (dev->sector_size % PED_SECTOR_SIZE_DEFAULT == 0);
+        PED_ASSERT (!dev->external_mode);
 
-static _syscall5(int,_llseek,
-                 unsigned int, fd,
-                 unsigned long, offset_high,
-                 unsigned long, offset_low,
-                 loff_t*, result,
-                 unsigned int, origin)
+        return (off_t) sector * dev->sector_size;
+}
 
-loff_t
-llseek (unsigned int fd, loff_t offset, unsigned int whence)
+static void
+linux_get_stats (const PedDevice* dev, PedDeviceStats* stats)
 {
-        loff_t result;
-        int retval;
+        *stats = LINUX_SPECIFIC (dev)->stats;
+}
+
+static int
+linux_get_devt (const PedDevice* dev, dev_t* devt)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
 
-        retval = _llseek(fd,
-                         ((unsigned long long)offset) >> 32,
-                         ((unsigned long long)offset) & 0xffffffff,
-                         &result,
-                         whence);
-        return (retval==-1 ? (loff_t) retval : result);
+        if (dev->type == PED_DEVICE_FILE)
+                return 0;
+        *devt = makedev (arch_specific->major, arch_specific->minor);
+        return 1;
 }
 
-#endif /* SIZEOF_OFF_T < 8 */
+static PedSector
+linux_next_data (const PedDevice* dev, PedSector start)
+{
+#ifdef SEEK_DATA
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        off_t           pos;
+
+        /* Block devices have no holes, and may not support SEEK_DATA.  */
+        if (dev->type != PED_DEVICE_FILE)
+                return start;
+
+        pos = lseek (arch_specific->fd, _device_offset (dev, start),
+                     SEEK_DATA);
+        if (pos >= 0)
+                return PED_MIN (PED_MAX (pos / dev->sector_size, start),
+                                dev->length);
+        if (errno == ENXIO)
+                return dev->length;
+#endif
+        return start;
+}
+
+/* Find the device node of the block device DEVT through sysfs, where
+ * /sys/dev/block/MAJOR:MINOR links to the device's directory, named as in
+ * /dev with '/' turned into '!'.
+ */
+static char*
+linux_devt_path (dev_t devt)
+{
+        char    link[PATH_MAX];
+        char    target[PATH_MAX];
+        char*   name;
+        char*   p;
+        ssize_t len;
+
+        snprintf (link, sizeof link, "/sys/dev/block/%u:%u",
+                  major (devt), minor (devt));
+        len = readlink (link, target, sizeof target - 1);
+        if (len < 0) {
+                ped_exception_throw (
+                        PED_EXCEPTION_ERROR,
+                        PED_EXCEPTION_CANCEL,
+                        _("Could not find block device %u:%u - %s."),
+                        major (devt), minor (devt), strerror (errno));
+                return NULL;
+        }
+        target[len] = '\0';
 
+        name = strrchr (target, '/');
+        name = name ? name + 1 : target;
+        for (p = name; *p; p++) {
+                if (*p == '!')
+                        *p = '/';
+        }
+        return zasprintf ("/dev/%s", name);
+}
+
+/* Fill the read cache with the blocks at the start and the end of DEV,
+ * which is where the partition table probes look.  This may run in a
+ * thread of its own while other devices are scanned, so it never throws;
+ * a device that is not open is read through a descriptor of its own, and
+ * the cache is then kept until the device is next closed.
+ */
 static int
-_device_seek (const PedDevice* dev, PedSector sector)
+linux_prefetch (PedDevice* dev)
 {
-        LinuxSpecific*  arch_specific;
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        PedSector       bs = _cache_block_sectors (dev);
+        PedSector       span = LINUX_CACHE_MAX_SPAN * bs;
+        PedSector       head_end;
+        PedSector       tail;
+        int             fd;
+        int             ok;
+
+        if (dev->external_mode || dev->length <= 0)
+                return 0;
+        if (!_cache_alloc (dev))
+                return 0;
 
-        PED_ASSERT (dev->sector_size % PED_SECTOR_SIZE_DEFAULT == 0);
-        PED_ASSERT (dev != NULL);
-        PED_ASSERT (!dev->external_mode);
+        fd = dev->open_count ? arch_specific->fd : open (dev->path, RD_MODE);
+        if (fd == -1)
+                return 0;
 
-        arch_specific = LINUX_SPECIFIC (dev);
+        arch_specific->cache_clock++;
+        head_end = PED_MIN (span, dev->length);
+        ok = _cache_fill (dev, fd, 0, (head_end - 1) / bs * bs);
+        tail = PED_MAX (head_end, (dev->length - span) / bs * bs);
+        if (ok && tail < dev->length)
+                ok = _cache_fill (dev, fd, tail, (dev->length - 1) / bs * bs);
 
-#if SIZEOF_OFF_T < 8
-        if (sizeof (off_t) < 8) {
-                loff_t  pos = (loff_t)(sector * dev->sector_size);
-                return llseek (arch_specific->fd, pos, SEEK_SET) == pos;
-        } else
-#endif
-        {
-                off_t   pos = sector * dev->sector_size;
-                return lseek (arch_specific->fd, pos, SEEK_SET) == pos;
-        }
+        if (!dev->open_count)
+                close (fd);
+        return ok;
 }
 
 static int
@@ -1898,49 +2276,33 @@ linux_read (const PedDevice* dev, void* buffer, PedSector start,
                                 && _read_lastoddsector (
                                         dev, (char *) buffer + (count-1) * 512);
         }
-        while (1) {
-                if (_device_seek (dev, start))
-                        break;
-
-                ex_status = ped_exception_throw (
-                        PED_EXCEPTION_ERROR,
-                        PED_EXCEPTION_RETRY_IGNORE_CANCEL,
-                        _("%s during seek for read on %s"),
-                        strerror (errno), dev->path);
-
-                switch (ex_status) {
-                        case PED_EXCEPTION_IGNORE:
-                                return 1;
-
-                        case PED_EXCEPTION_RETRY:
-                                break;
-
-                        case PED_EXCEPTION_UNHANDLED:
-                                ped_exception_catch ();
-                                /* FALLTHROUGH */
-                        case PED_EXCEPTION_CANCEL:
-                                return 0;
-                        default:
-                                PED_ASSERT (0);
-                                break;
-                }
-        }
+        arch_specific->stats.read_requests++;
+        if (_cache_read (dev, buffer, start, count))
+                return 1;
 
         size_t read_length = count * dev->sector_size;
-        if (posix_memalign (&diobuf, dev->sector_size, read_length) != 0)
+        size_t done = 0;
+        if (_is_sector_aligned (dev, buffer))
+                diobuf = buffer;
+        else if ((diobuf = _iobuf_get (dev, read_length)) == NULL)
                 return 0;
 
         while (1) {
-                ssize_t status = read (arch_specific->fd, diobuf, read_length);
-                if (status > 0)
-                        memcpy(buffer, diobuf, status);
-                if (status == (ssize_t) read_length)
-                        break;
+                ssize_t status = pread (arch_specific->fd,
+                                        (char *) diobuf + done,
+                                        read_length - done,
+                                        _device_offset (dev, start) + done);
+                arch_specific->stats.read_syscalls++;
                 if (status > 0) {
-                        read_length -= status;
-                        buffer = (char *) buffer + status;
-                        continue;
+                        if (diobuf != buffer)
+                                memcpy ((char *) buffer + done,
+                                        (char *) diobuf + done, status);
+                        done += status;
                 }
+                if (done == read_length)
+                        break;
+                if (status > 0)
+                        continue;
 
                 ex_status = ped_exception_throw (
                         PED_EXCEPTION_ERROR,
@@ -1953,7 +2315,8 @@ linux_read (const PedDevice* dev, void* buffer, PedSector start,
 
                 switch (ex_status) {
                         case PED_EXCEPTION_IGNORE:
-                                free(diobuf);
+                                if (diobuf != buffer)
+                                        _iobuf_put (dev, diobuf);
                                 return 1;
 
                         case PED_EXCEPTION_RETRY:
@@ -1963,7 +2326,8 @@ linux_read (const PedDevice* dev, void* buffer, PedSector start,
                                 ped_exception_catch ();
                                 /* FALLTHROUGH */
                         case PED_EXCEPTION_CANCEL:
-                                free(diobuf);
+                                if (diobuf != buffer)
+                                        _iobuf_put (dev, diobuf);
                                 return 0;
                         default:
                                 PED_ASSERT (0);
@@ -1971,7 +2335,9 @@ linux_read (const PedDevice* dev, void* buffer, PedSector start,
                 }
         }
 
-        free (diobuf);
+        if (diobuf != buffer)
+                _iobuf_put (dev, diobuf);
+        arch_specific->stats.sectors_read += count;
 
         return 1;
 }
@@ -2016,7 +2382,6 @@ linux_write (PedDevice* dev, const void* buffer, PedSector start,
         LinuxSpecific*          arch_specific = LINUX_SPECIFIC (dev);
         PedExceptionOption      ex_status;
         void*                   diobuf;
-        void*                   diobuf_start;
 
         PED_ASSERT(dev->sector_size % PED_SECTOR_SIZE_DEFAULT == 0);
 
@@ -2031,6 +2396,7 @@ linux_write (PedDevice* dev, const void* buffer, PedSector start,
                 else
                         return 1;
         }
+        _cache_invalidate (dev);
 
         if (_get_linux_version() < KERNEL_VERSION (2,6,0)) {
                 /* Kludge.  This is necessary to read/write the last
@@ -2043,51 +2409,33 @@ linux_write (PedDevice* dev, const void* buffer, PedSector start,
                                         dev, ((char*) buffer
                                               + (count-1) * dev->sector_size));
         }
-        while (1) {
-                if (_device_seek (dev, start))
-                        break;
-
-                ex_status = ped_exception_throw (
-                        PED_EXCEPTION_ERROR, PED_EXCEPTION_RETRY_IGNORE_CANCEL,
-                        _("%s during seek for write on %s"),
-                        strerror (errno), dev->path);
-
-                switch (ex_status) {
-                        case PED_EXCEPTION_IGNORE:
-                                return 1;
-
-                        case PED_EXCEPTION_RETRY:
-                                break;
-
-                        case PED_EXCEPTION_UNHANDLED:
-                                ped_exception_catch ();
-                                /* FALLTHROUGH */
-                        case PED_EXCEPTION_CANCEL:
-                                return 0;
-                        default:
-                                PED_ASSERT (0);
-                                break;
-                }
-        }
-
 #ifdef READ_ONLY
         printf ("ped_device_write (\"%s\", %p, %d, %d)\n",
                 dev->path, buffer, (int) start, (int) count);
 #else
         size_t write_length = count * dev->sector_size;
+        size_t done = 0;
         dev->dirty = 1;
-        if (posix_memalign(&diobuf, dev->sector_size, write_length) != 0)
-                return 0;
-        memcpy(diobuf, buffer, write_length);
-        diobuf_start = diobuf;
+        arch_specific->stats.write_requests++;
+        if (_is_sector_aligned (dev, buffer)) {
+                diobuf = (void *) buffer;
+        } else {
+                if ((diobuf = _iobuf_get (dev, write_length)) == NULL)
+                        return 0;
+                memcpy (diobuf, buffer, write_length);
+        }
         while (1) {
-                ssize_t status = write (arch_specific->fd, diobuf, write_length);
-                if (status == write_length) break;
-                if (status > 0) {
-                        write_length -= status;
-                        diobuf = (char *) diobuf + status;
+                ssize_t status = pwrite (arch_specific->fd,
+                                         (char *) diobuf + done,
+                                         write_length - done,
+                                         _device_offset (dev, start) + done);
+                arch_specific->stats.write_syscalls++;
+                if (status > 0)
+                        done += status;
+                if (done == write_length)
+                        break;
+                if (status > 0)
                         continue;
-                }
 
                 ex_status = ped_exception_throw (
                         PED_EXCEPTION_ERROR,
@@ -2097,7 +2445,8 @@ linux_write (PedDevice* dev, const void* buffer, PedSector start,
 
                 switch (ex_status) {
                         case PED_EXCEPTION_IGNORE:
-                                free(diobuf_start);
+                                if (diobuf != buffer)
+                                        _iobuf_put (dev, diobuf);
                                 return 1;
 
                         case PED_EXCEPTION_RETRY:
@@ -2107,14 +2456,17 @@ linux_write (PedDevice* dev, const void* buffer, PedSector start,
                                 ped_exception_catch ();
                                 /* FALLTHROUGH */
                         case PED_EXCEPTION_CANCEL:
-                                free(diobuf_start);
+                                if (diobuf != buffer)
+                                        _iobuf_put (dev, diobuf);
                                 return 0;
                         default:
                                 PED_ASSERT (0);
                                 break;
                 }
         }
-        free(diobuf_start);
+        if (diobuf != buffer)
+                _iobuf_put (dev, diobuf);
+        arch_specific->stats.sectors_written += count;
 #endif /* !READ_ONLY */
         return 1;
 }
@@ -2131,26 +2483,520 @@ linux_check (PedDevice* dev, void* buffer, PedSector start, PedSector count)
 
         PED_ASSERT(dev != NULL);
 
-        if (!_device_seek (dev, start))
-                return 0;
-
-        if (posix_memalign(&diobuf, PED_SECTOR_SIZE_DEFAULT,
-                           count * PED_SECTOR_SIZE_DEFAULT) != 0)
+        size_t length = count * dev->sector_size;
+        if (_is_sector_aligned (dev, buffer))
+                diobuf = buffer;
+        else if ((diobuf = _iobuf_get (dev, length)) == NULL)
                 return 0;
 
         for (done = 0; done < count; done += status / dev->sector_size) {
-                status = read (arch_specific->fd, diobuf,
-                               (size_t) ((count-done) * dev->sector_size));
-                if (status > 0)
-                        memcpy(buffer, diobuf, status);
-                if (status < 0)
+                size_t offset = done * dev->sector_size;
+                status = pread (arch_specific->fd, (char *) diobuf + offset,
+                                length - offset,
+                                _device_offset (dev, start + done));
+                arch_specific->stats.read_syscalls++;
+                if (status > 0 && diobuf != buffer)
+                        memcpy ((char *) buffer + offset,
+                                (char *) diobuf + offset, status);
+                if (status <= 0)
                         break;
         }
-        free(diobuf);
+        if (diobuf != buffer)
+                _iobuf_put (dev, diobuf);
+        arch_specific->stats.sectors_read += done;
 
         return done;
 }
 
+/* Ranges of a batched read whose gap is at most this many bytes are
+ * fetched with a single request, the sectors in between are discarded.
+ * A merged request never grows beyond LINUX_BATCH_MAX_BYTES.
+ */
+#define LINUX_BATCH_MAX_GAP     (64 * 1024)
+#define LINUX_BATCH_MAX_BYTES   (1024 * 1024)
+
+/* One request of a batch: a contiguous byte range of the device, read
+ * into or written from the IOVCNT buffers at IOV.  When the caller's
+ * buffers can't be used directly, IOV describes BOUNCE instead.
+ */
+typedef struct {
+        PedIoVec**      vec;            /* caller's ranges, sorted */
+        int             n;
+        PedSector       start;
+        PedSector       count;
+        void*           bounce;
+        struct iovec*   iov;
+        int             iovcnt;
+        int             done;
+} LinuxIoReq;
+
+#if ENABLE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+
+/* Number of submission queue entries of each device's ring.  */
+#define LINUX_URING_ENTRIES     64
+
+struct _LinuxRing {
+        int                     fd;
+        unsigned                sq_entries;
+        unsigned*               sq_head;
+        unsigned*               sq_tail;
+        unsigned*               sq_mask;
+        unsigned*               sq_array;
+        struct io_uring_sqe*    sqes;
+        unsigned*               cq_head;
+        unsigned*               cq_tail;
+        unsigned*               cq_mask;
+        struct io_uring_cqe*    cqes;
+        void*                   sq_ring;
+        size_t                  sq_ring_size;
+        void*                   cq_ring;
+        size_t                  cq_ring_size;
+        size_t                  sqes_size;
+};
+
+static void
+_uring_free (LinuxRing* ring)
+{
+        if (ring->sqes && ring->sqes != MAP_FAILED)
+                munmap (ring->sqes, ring->sqes_size);
+        if (ring->cq_ring && ring->cq_ring != MAP_FAILED)
+                munmap (ring->cq_ring, ring->cq_ring_size);
+        if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+                munmap (ring->sq_ring, ring->sq_ring_size);
+        if (ring->fd >= 0)
+                close (ring->fd);
+        free (ring);
+}
+
+static LinuxRing*
+_uring_new (void)
+{
+        struct io_uring_params  p;
+        LinuxRing*              ring;
+
+        ring = calloc (1, sizeof *ring);
+        if (!ring)
+                return NULL;
+
+        memset (&p, 0, sizeof p);
+        ring->fd = syscall (__NR_io_uring_setup, LINUX_URING_ENTRIES, &p);
+        if (ring->fd < 0)
+                goto error;
+
+        ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+        ring->cq_ring_size = p.cq_off.cqes
+                             + p.cq_entries * sizeof (struct io_uring_cqe);
+        ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+        ring->sq_ring = mmap (NULL, ring->sq_ring_size,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring->fd,
+                              IORING_OFF_SQ_RING);
+        if (ring->sq_ring == MAP_FAILED)
+                goto error;
+        ring->cq_ring = mmap (NULL, ring->cq_ring_size,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring->fd,
+                              IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+                goto error;
+        ring->sqes = mmap (NULL, ring->sqes_size,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring->fd,
+                           IORING_OFF_SQES);
+        if (ring->sqes == MAP_FAILED)
+                goto error;
+
+        ring->sq_entries = p.sq_entries;
+        ring->sq_head = (unsigned*) ((char*) ring->sq_ring + p.sq_off.head);
+        ring->sq_tail = (unsigned*) ((char*) ring->sq_ring + p.sq_off.tail);
+        ring->sq_mask = (unsigned*) ((char*) ring->sq_ring
+                                     + p.sq_off.ring_mask);
+        ring->sq_array = (unsigned*) ((char*) ring->sq_ring + p.sq_off.array);
+        ring->cq_head = (unsigned*) ((char*) ring->cq_ring + p.cq_off.head);
+        ring->cq_tail = (unsigned*) ((char*) ring->cq_ring + p.cq_off.tail);
+        ring->cq_mask = (unsigned*) ((char*) ring->cq_ring
+                                     + p.cq_off.ring_mask);
+        ring->cqes = (struct io_uring_cqe*) ((char*) ring->cq_ring
+                                             + p.cq_off.cqes);
+        return ring;
+
+error:
+        _uring_free (ring);
+        return NULL;
+}
+
+/* Return the ring of DEV, setting it up on first use.  NULL means that
+ * batches are done with plain system calls: either the io_uring engine
+ * was not asked for (PARTED_IO_ENGINE=sync), or the kernel refused it.
+ */
+static LinuxRing*
+_uring_get (const PedDevice* dev)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+
+        if (arch_specific->ring || arch_specific->ring_failed)
+                return arch_specific->ring;
+
+        const char* engine = getenv ("PARTED_IO_ENGINE");
+        if (engine && strcmp (engine, "io_uring") != 0) {
+                arch_specific->ring_failed = 1;
+                return NULL;
+        }
+
+        arch_specific->ring = _uring_new ();
+        if (!arch_specific->ring)
+                arch_specific->ring_failed = 1;
+        return arch_specific->ring;
+}
+
+static void
+_uring_destroy (PedDevice* dev)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+
+        if (arch_specific->ring) {
+                _uring_free (arch_specific->ring);
+                arch_specific->ring = NULL;
+        }
+}
+
+/* Queue the N requests at REQ on the ring of DEV, as many at a time as
+ * fit, and wait for them.  Requests that complete in full get their
+ * done flag set.  Returns zero if the ring itself failed, in which case
+ * it is torn down and later batches use plain system calls.
+ */
+static int
+_uring_run (const PedDevice* dev, LinuxRing* ring, LinuxIoReq* req, int n,
+            int write)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        int             first = 0;
+
+        while (first < n) {
+                int             batch = PED_MIN (n - first,
+                                                 (int) ring->sq_entries);
+                unsigned        tail = *ring->sq_tail;
+                int             i;
+
+                for (i = first; i < first + batch; i++) {
+                        unsigned                idx = tail & *ring->sq_mask;
+                        struct io_uring_sqe*    sqe = &ring->sqes[idx];
+
+                        memset (sqe, 0, sizeof *sqe);
+                        sqe->opcode = write ? IORING_OP_WRITEV
+                                            : IORING_OP_READV;
+                        sqe->fd = arch_specific->fd;
+                        sqe->addr = (uintptr_t) req[i].iov;
+                        sqe->len = req[i].iovcnt;
+                        sqe->off = _device_offset (dev, req[i].start);
+                        sqe->user_data = i;
+                        ring->sq_array[idx] = idx;
+                        tail++;
+                }
+                __atomic_store_n (ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+                int to_submit = batch;
+                int reaped = 0;
+                int failed = 0;
+                int stuck = 0;
+                /* Once the ring fails, submit nothing more, but wait for
+                 * the requests already in flight: they still read into or
+                 * write from the caller's buffers.  If even waiting fails,
+                 * the ring is stuck with them.
+                 */
+                while (reaped < batch - (failed ? to_submit : 0)) {
+                        int status = syscall (__NR_io_uring_enter, ring->fd,
+                                              failed ? 0 : to_submit,
+                                              batch - (failed ? to_submit : 0)
+                                                    - reaped,
+                                              IORING_ENTER_GETEVENTS,
+                                              NULL, 0);
+                        if (write)
+                                arch_specific->stats.write_syscalls++;
+                        else
+                                arch_specific->stats.read_syscalls++;
+                        if (status < 0) {
+                                if (errno == EINTR || errno == EAGAIN)
+                                        continue;
+                                if (failed)
+                                        stuck = 1;
+                                else if (to_submit < batch) {
+                                        failed = 1;
+                                        continue;
+                                }
+                                break;
+                        }
+                        if (!failed)
+                                to_submit -= status;
+
+                        unsigned head = *ring->cq_head;
+                        unsigned cq_tail = __atomic_load_n (ring->cq_tail,
+                                                            __ATOMIC_ACQUIRE);
+                        for (; head != cq_tail; head++) {
+                                struct io_uring_cqe* cqe =
+                                        &ring->cqes[head & *ring->cq_mask];
+                                LinuxIoReq* r = &req[cqe->user_data];
+
+                                r->done = cqe->res
+                                          == r->count * dev->sector_size;
+                                reaped++;
+                        }
+                        __atomic_store_n (ring->cq_head, head,
+                                          __ATOMIC_RELEASE);
+                }
+                if (stuck) {
+                        /* The kernel may still complete requests into the
+                         * ring: leak it rather than close it under them.
+                         */
+                        arch_specific->ring = NULL;
+                        arch_specific->ring_failed = 1;
+                        return 0;
+                }
+                if (failed || reaped < batch) {
+                        _uring_destroy ((PedDevice*) dev);
+                        arch_specific->ring_failed = 1;
+                        return 0;
+                }
+                first += batch;
+        }
+        return 1;
+}
+#endif /* ENABLE_IO_URING */
+
+/* Issue the N requests at REQ, through io_uring when it is available and
+ * otherwise with one preadv/pwritev each.  Failures are not reported;
+ * requests that did not complete in full are left with done == 0.
+ */
+static void
+_run_requests (const PedDevice* dev, LinuxIoReq* req, int n, int write)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        int             i;
+
+#if ENABLE_IO_URING
+        /* A lone request gains nothing from the ring.  */
+        LinuxRing* ring = n > 1 ? _uring_get (dev) : NULL;
+        if (ring && _uring_run (dev, ring, req, n, write))
+                return;
+#endif
+
+        for (i = 0; i < n; i++) {
+                ssize_t status;
+                off_t   offset = _device_offset (dev, req[i].start);
+
+                if (write) {
+                        status = pwritev (arch_specific->fd, req[i].iov,
+                                          req[i].iovcnt, offset);
+                        arch_specific->stats.write_syscalls++;
+                } else {
+                        status = preadv (arch_specific->fd, req[i].iov,
+                                         req[i].iovcnt, offset);
+                        arch_specific->stats.read_syscalls++;
+                }
+                req[i].done = status == req[i].count * dev->sector_size;
+        }
+}
+
+/* Point REQ's iovecs at the caller's buffers if they are aligned and
+ * exactly tile the request, otherwise at a bounce buffer.  IOV must have
+ * room for REQ->n entries.  Returns zero if no bounce buffer could be had.
+ */
+static int
+_req_setup_buffers (const PedDevice* dev, LinuxIoReq* req, struct iovec* iov)
+{
+        int     direct = req->n <= IOV_MAX;
+        int     i;
+
+        for (i = 0; i < req->n; i++) {
+                if (!_is_sector_aligned (dev, req->vec[i]->buffer)
+                    || req->vec[i]->start
+                       != (i ? req->vec[i-1]->start + req->vec[i-1]->count
+                             : req->start))
+                        direct = 0;
+        }
+
+        req->iov = iov;
+        req->bounce = NULL;
+        req->done = 0;
+        if (direct) {
+                for (i = 0; i < req->n; i++) {
+                        iov[i].iov_base = req->vec[i]->buffer;
+                        iov[i].iov_len = req->vec[i]->count * dev->sector_size;
+                }
+                req->iovcnt = req->n;
+                return 1;
+        }
+
+        req->bounce = _iobuf_get (dev, req->count * dev->sector_size);
+        if (!req->bounce)
+                return 0;
+        iov[0].iov_base = req->bounce;
+        iov[0].iov_len = req->count * dev->sector_size;
+        req->iovcnt = 1;
+        return 1;
+}
+
+static int
+_iovec_cmp_start (const void* a, const void* b)
+{
+        const PedIoVec* x = *(const PedIoVec* const*) a;
+        const PedIoVec* y = *(const PedIoVec* const*) b;
+
+        return (x->start > y->start) - (x->start < y->start);
+}
+
+static int
+linux_read_batch (const PedDevice* dev, PedIoVec* iov, int n)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        PedSector       max_gap = LINUX_BATCH_MAX_GAP / dev->sector_size;
+        PedSector       max_count = LINUX_BATCH_MAX_BYTES / dev->sector_size;
+        PedIoVec**      sorted;
+        LinuxIoReq*     req;
+        struct iovec*   sys_iov;
+        int             n_req = 0;
+        int             first;
+        int             i;
+        int             j;
+        int             ok = 1;
+
+        sorted = ped_malloc (n * sizeof *sorted);
+        req = ped_malloc (n * sizeof *req);
+        sys_iov = ped_malloc (n * sizeof *sys_iov);
+        if (!sorted || !req || !sys_iov) {
+                free (sorted);
+                free (req);
+                free (sys_iov);
+                return 0;
+        }
+        for (i = 0; i < n; i++)
+                sorted[i] = &iov[i];
+        qsort (sorted, n, sizeof *sorted, _iovec_cmp_start);
+
+        /* Merge ranges that are close enough into one request each.  */
+        for (first = 0; first < n; first = i) {
+                PedSector start = sorted[first]->start;
+                PedSector end = start + sorted[first]->count;
+
+                for (i = first + 1; i < n; i++) {
+                        PedSector e_end = sorted[i]->start + sorted[i]->count;
+                        PedSector new_end = PED_MAX (end, e_end);
+                        if (sorted[i]->start > end + max_gap
+                            || new_end - start > max_count)
+                                break;
+                        end = new_end;
+                }
+
+                req[n_req].vec = sorted + first;
+                req[n_req].n = i - first;
+                req[n_req].start = start;
+                req[n_req].count = end - start;
+                if (!_req_setup_buffers (dev, &req[n_req], sys_iov + first))
+                        req[n_req].iovcnt = 0;
+                n_req++;
+        }
+
+        _run_requests (dev, req, n_req, 0);
+
+        for (i = 0; i < n_req; i++) {
+                LinuxIoReq* r = &req[i];
+
+                if (r->done) {
+                        if (r->bounce) {
+                                for (j = 0; j < r->n; j++)
+                                        memcpy (r->vec[j]->buffer,
+                                                (char *) r->bounce
+                                                + (r->vec[j]->start - r->start)
+                                                  * dev->sector_size,
+                                                r->vec[j]->count
+                                                * dev->sector_size);
+                        }
+                        arch_specific->stats.read_requests += r->n;
+                        arch_specific->stats.sectors_read += r->count;
+                }
+                if (r->bounce)
+                        _iobuf_put (dev, r->bounce);
+
+                /* Requests that could not be read in one go are redone
+                   range by range, so that errors get reported through
+                   the usual exception dialogue.  */
+                for (j = 0; ok && !r->done && j < r->n; j++)
+                        ok = linux_read (dev, r->vec[j]->buffer,
+                                         r->vec[j]->start, r->vec[j]->count);
+        }
+
+        free (sys_iov);
+        free (req);
+        free (sorted);
+        return ok;
+}
+
+static int
+linux_write_batch (PedDevice* dev, PedIoVec* iov, int n)
+{
+        LinuxSpecific*  arch_specific = LINUX_SPECIFIC (dev);
+        PedIoVec**      vec;
+        LinuxIoReq*     req;
+        struct iovec*   sys_iov;
+        int             i;
+        int             ok = 1;
+
+        vec = ped_malloc (n * sizeof *vec);
+        req = ped_malloc (n * sizeof *req);
+        sys_iov = ped_malloc (n * sizeof *sys_iov);
+        if (!vec || !req || !sys_iov) {
+                free (vec);
+                free (req);
+                free (sys_iov);
+                return 0;
+        }
+
+        /* Writes are never merged: the sectors between two ranges are
+           not ours to overwrite.  */
+        for (i = 0; i < n; i++) {
+                vec[i] = &iov[i];
+                req[i].vec = &vec[i];
+                req[i].n = 1;
+                req[i].start = iov[i].start;
+                req[i].count = iov[i].count;
+                if (!_req_setup_buffers (dev, &req[i], &sys_iov[i]))
+                        req[i].iovcnt = 0;
+                else if (req[i].bounce)
+                        memcpy (req[i].bounce, iov[i].buffer,
+                                iov[i].count * dev->sector_size);
+        }
+
+        /* Read-only devices (and READ_ONLY builds) go straight to
+           linux_write, which knows how to complain.  */
+#ifndef READ_ONLY
+        if (!dev->read_only) {
+                _cache_invalidate (dev);
+                dev->dirty = 1;
+                _run_requests (dev, req, n, 1);
+        }
+#endif
+
+        for (i = 0; i < n; i++) {
+                if (req[i].bounce)
+                        _iobuf_put (dev, req[i].bounce);
+                if (req[i].done) {
+                        arch_specific->stats.write_requests++;
+                        arch_specific->stats.sectors_written += req[i].count;
+                } else if (ok) {
+                        ok = linux_write (dev, iov[i].buffer, iov[i].start,
+                                          iov[i].count);
+                }
+        }
+
+        free (sys_iov);
+        free (req);
+        free (vec);
+        return ok;
+}
+
 static int
 _do_fsync (PedDevice* dev)
 {
@@ -3242,12 +4088,15 @@ _have_blkpg ()
 {
         static int have_blkpg = -1;
         int kver;
+        int v = __atomic_load_n (&have_blkpg, __ATOMIC_RELAXED);
 
-        if (have_blkpg != -1)
-                return have_blkpg;
+        if (v != -1)
+                return v;
 
         kver = _get_linux_version();
-        return have_blkpg = kver >= KERNEL_VERSION (2,4,0) ? 1 : 0;
+        v = kver >= KERNEL_VERSION (2,4,0) ? 1 : 0;
+        __atomic_store_n (&have_blkpg, v, __ATOMIC_RELAXED);
+        return v;
 }
 
 /* Return nonzero upon success, 0 if something fails.  */
@@ -3399,6 +4248,13 @@ static PedDeviceArchOps linux_dev_ops = {
         get_minimum_alignment:	linux_get_minimum_alignment,
         get_optimum_alignment:	linux_get_optimum_alignment,
 #endif
+        get_stats:      linux_get_stats,
+        read_batch:     linux_read_batch,
+        write_batch:    linux_write_batch,
+        prefetch:       linux_prefetch,
+        get_devt:       linux_get_devt,
+        devt_path:      linux_devt_path,
+        next_data:      linux_next_data,
 };
 
 PedDiskArchOps linux_disk_ops =  {
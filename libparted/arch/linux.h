@@ -18,19 +18,53 @@
 #ifndef PED_ARCH_LINUX_H_INCLUDED
 #define PED_ARCH_LINUX_H_INCLUDED
 
+#include <parted/parted.h>
+
 #if HAVE_BLKID_BLKID_H
 #  include <blkid/blkid.h>
 #endif
 
 #define LINUX_SPECIFIC(dev)	((LinuxSpecific*) (dev)->arch_specific)
 
+/* Number of sector-aligned bounce buffers kept per device.  */
+#define LINUX_IOBUF_POOL_SIZE	4
+
+/* Geometry of the read cache: LINUX_CACHE_BLOCKS blocks of
+   LINUX_CACHE_BLOCK_SIZE bytes (or one sector, if that is larger).  */
+#define LINUX_CACHE_BLOCKS	64
+#define LINUX_CACHE_BLOCK_SIZE	4096
+
 typedef	struct _LinuxSpecific	LinuxSpecific;
+typedef	struct _LinuxIOBuf	LinuxIOBuf;
+typedef	struct _LinuxRing	LinuxRing;
+typedef	struct _LinuxCacheBlock	LinuxCacheBlock;
+
+struct _LinuxIOBuf {
+	void*	buf;
+	size_t	size;           /**< allocated length in bytes */
+	size_t	align;          /**< alignment buf was allocated with */
+	int	busy;
+};
+
+struct _LinuxCacheBlock {
+	PedSector	start;  /**< first sector held, -1 if the slot is free */
+	unsigned long	used;   /**< cache clock at the last access */
+};
 
 struct _LinuxSpecific {
 	int	fd;
 	int	major;
 	int	minor;
 	char*	dmtype;         /**< device map target type */
+	LinuxIOBuf iobuf[LINUX_IOBUF_POOL_SIZE]; /**< reusable O_DIRECT buffers */
+	PedDeviceStats stats;   /**< I/O counters */
+	void*	cache_data;     /**< read cache, allocated on first use */
+	LinuxCacheBlock cache[LINUX_CACHE_BLOCKS];
+	unsigned long cache_clock;
+#if ENABLE_IO_URING
+	LinuxRing* ring;        /**< io_uring for batched I/O, set up lazily */
+	int	ring_failed;    /**< io_uring disabled or unavailable */
+#endif
 #if defined __s390__ || defined __s390x__
 	unsigned int real_sector_size;
 	unsigned int devno;
@@ -32,6 +32,14 @@
  * devices from file descriptors, stores, etc.  For example,
  * ped_device_new_from_store().
  *
+ * libparted may be used from several threads at once, as long as each
+ * PedDevice, along with the PedDisk and PedFileSystem objects on it, is
+ * used by one thread at a time.  ped_device_get() may be called from any
+ * thread.  Walking the device list is not locked, though: call
+ * ped_device_probe_all(), ped_device_get_next(), ped_device_free_all()
+ * and ped_device_destroy() only while no other thread is adding devices
+ * or destroying them.  Exceptions are per thread, see \ref PedException.
+ *
  * @{
  */
 
@@ -44,34 +52,226 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <string.h>
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
 
 #include "architecture.h"
 
+#if ENABLE_NLS
+#  include <libintl.h>
+#  define _(String) dgettext (PACKAGE, String)
+#else
+#  define _(String) (String)
+#endif /* ENABLE_NLS */
+
 static PedDevice*	devices; /* legal advice says: initialized to NULL,
 				    under section 6.7.8 part 10
 				    of ISO/EIC 9899:1999 */
+#if HAVE_PTHREAD
+static pthread_mutex_t	devices_lock = PTHREAD_MUTEX_INITIALIZER;
+# define DEVICES_LOCK()		pthread_mutex_lock (&devices_lock)
+# define DEVICES_UNLOCK()	pthread_mutex_unlock (&devices_lock)
+#else
+# define DEVICES_LOCK()
+# define DEVICES_UNLOCK()
+#endif
+
+/* The device list is indexed by path and by device number, so that
+   neither looking up a device nor adding or removing one has to walk
+   the whole list.  Each hash chain holds DeviceEntry records, which also
+   remember the previous device in the list.  */
+typedef struct _DeviceEntry DeviceEntry;
+struct _DeviceEntry {
+	PedDevice*	dev;
+	PedDevice*	prev;
+	int		has_devt;
+	dev_t		devt;
+	DeviceEntry*	next_by_path;
+	DeviceEntry*	next_by_devt;
+};
+
+static PedDevice*	devices_tail;
+static DeviceEntry**	by_path;
+static DeviceEntry**	by_devt;
+static size_t		n_buckets;	/* a power of two */
+static size_t		n_entries;
+
+static size_t _GL_ATTRIBUTE_PURE
+_hash_path (const char* path)
+{
+	size_t	h = 2166136261u;
+
+	for (; *path; path++)
+		h = (h ^ (unsigned char) *path) * 16777619u;
+	return h;
+}
+
+static size_t _GL_ATTRIBUTE_CONST
+_hash_devt (dev_t devt)
+{
+	unsigned long long	h = (unsigned long long) devt;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
 
 static void
-_device_register (PedDevice* dev)
+_index_link (DeviceEntry* entry)
 {
-	PedDevice*	walk;
-	for (walk = devices; walk && walk->next; walk = walk->next);
-	if (walk)
-		walk->next = dev;
+	size_t	mask = n_buckets - 1;
+	size_t	i = _hash_path (entry->dev->path) & mask;
+
+	entry->next_by_path = by_path[i];
+	by_path[i] = entry;
+	if (entry->has_devt) {
+		i = _hash_devt (entry->devt) & mask;
+		entry->next_by_devt = by_devt[i];
+		by_devt[i] = entry;
+	}
+}
+
+/* Make room for one more entry.  If memory is short the index just keeps
+   its size, and the chains get longer.  Returns zero if there is no index
+   to keep.  */
+static int
+_index_grow ()
+{
+	DeviceEntry**	old_by_path = by_path;
+	size_t		old_n_buckets = n_buckets;
+	size_t		new_n_buckets = n_buckets ? n_buckets * 2 : 64;
+	DeviceEntry**	new_by_path;
+	DeviceEntry**	new_by_devt;
+	size_t		i;
+
+	if (n_entries < n_buckets)
+		return 1;
+
+	new_by_path = calloc (new_n_buckets, sizeof *new_by_path);
+	new_by_devt = calloc (new_n_buckets, sizeof *new_by_devt);
+	if (!new_by_path || !new_by_devt) {
+		free (new_by_path);
+		free (new_by_devt);
+		return n_buckets != 0;
+	}
+
+	free (by_devt);
+	by_path = new_by_path;
+	by_devt = new_by_devt;
+	n_buckets = new_n_buckets;
+	for (i = 0; i < old_n_buckets; i++) {
+		DeviceEntry*	entry = old_by_path[i];
+		while (entry) {
+			DeviceEntry*	next = entry->next_by_path;
+			_index_link (entry);
+			entry = next;
+		}
+	}
+	free (old_by_path);
+	return 1;
+}
+
+static DeviceEntry*
+_index_find_path (const char* path)
+{
+	DeviceEntry*	entry;
+
+	if (!n_buckets)
+		return NULL;
+	for (entry = by_path[_hash_path (path) & (n_buckets - 1)]; entry;
+	     entry = entry->next_by_path) {
+		if (!strcmp (entry->dev->path, path))
+			return entry;
+	}
+	return NULL;
+}
+
+static DeviceEntry*
+_index_find_devt (dev_t devt)
+{
+	DeviceEntry*	entry;
+
+	if (!n_buckets)
+		return NULL;
+	for (entry = by_devt[_hash_devt (devt) & (n_buckets - 1)]; entry;
+	     entry = entry->next_by_devt) {
+		if (entry->devt == devt)
+			return entry;
+	}
+	return NULL;
+}
+
+/* Remove the entry of DEV from the index, and return it.  */
+static DeviceEntry*
+_index_unlink (const PedDevice* dev)
+{
+	DeviceEntry**	link;
+	DeviceEntry*	entry;
+
+	if (!n_buckets)
+		return NULL;
+	for (link = &by_path[_hash_path (dev->path) & (n_buckets - 1)];
+	     *link; link = &(*link)->next_by_path) {
+		if ((*link)->dev == dev)
+			break;
+	}
+	entry = *link;
+	if (!entry)
+		return NULL;
+	*link = entry->next_by_path;
+
+	if (entry->has_devt) {
+		for (link = &by_devt[_hash_devt (entry->devt)
+				     & (n_buckets - 1)];
+		     *link != entry; link = &(*link)->next_by_devt);
+		*link = entry->next_by_devt;
+	}
+	return entry;
+}
+
+/* Add DEV to the end of the list.  ENTRY is its index entry, allocated
+   by the caller.  Returns zero if DEV could not be indexed.  */
+static int
+_device_register (PedDevice* dev, DeviceEntry* entry)
+{
+	if (!_index_grow ())
+		return 0;
+
+	entry->dev = dev;
+	entry->prev = devices_tail;
+	entry->has_devt = ped_architecture->dev_ops->get_devt
+			  && ped_architecture->dev_ops->get_devt (dev,
+								  &entry->devt);
+	_index_link (entry);
+	n_entries++;
+
+	if (devices_tail)
+		devices_tail->next = dev;
 	else
 		devices = dev;
+	devices_tail = dev;
 	dev->next = NULL;
+	return 1;
+}
+
+static PedDevice*
+_device_lookup (const char* path)
+{
+	DeviceEntry*	entry = _index_find_path (path);
+
+	return entry ? entry->dev : NULL;
 }
 
 static void
 _device_unregister (PedDevice* dev)
 {
-	PedDevice*	walk;
-	PedDevice*	last = NULL;
+	DeviceEntry*	entry;
 
-	for (walk = devices; walk != NULL; last = walk, walk = walk->next) {
-		if (walk == dev) break;
-	}
+	DEVICES_LOCK ();
+	entry = _index_unlink (dev);
 
 	/* This function may be called twice for the same device if a
 	   libparted user explictly removes the device from the cache using
@@ -80,13 +280,25 @@ _device_unregister (PedDevice* dev)
 	   ped_device_destroy().
 	   ped_device_destroy() will then call us a second time, so if the
 	   device is not found in the list do nothing. */
-	if (walk == NULL)
-		return;
-
-	if (last)
-		last->next = dev->next;
-	else
-		devices = dev->next;
+	if (entry != NULL) {
+		if (entry->prev)
+			entry->prev->next = dev->next;
+		else
+			devices = dev->next;
+		if (dev->next)
+			_index_find_path (dev->next->path)->prev = entry->prev;
+		else
+			devices_tail = entry->prev;
+		free (entry);
+
+		if (--n_entries == 0) {
+			free (by_path);
+			free (by_devt);
+			by_path = by_devt = NULL;
+			n_buckets = 0;
+		}
+	}
+	DEVICES_UNLOCK ();
 }
 
 /**
@@ -149,7 +361,10 @@ PedDevice*
 ped_device_get (const char* path)
 {
 	PedDevice*	walk;
+	PedDevice*	dev;
+	DeviceEntry*	entry;
 	char*		normal_path = NULL;
+	int		registered = 0;
 
 	PED_ASSERT (path != NULL);
 	/* Don't canonicalize /dev/mapper or /dev/md/ paths, see
@@ -165,19 +380,96 @@ ped_device_get (const char* path)
 	if (!normal_path)
 		return NULL;
 
-	for (walk = devices; walk != NULL; walk = walk->next) {
-		if (!strcmp (walk->path, normal_path)) {
-			free (normal_path);
-			return walk;
-		}
+	DEVICES_LOCK ();
+	walk = _device_lookup (normal_path);
+	DEVICES_UNLOCK ();
+	if (walk) {
+		free (normal_path);
+		return walk;
 	}
 
-	walk = ped_architecture->dev_ops->_new (normal_path);
-	free (normal_path);
+	entry = ped_malloc (sizeof *entry);
+	if (!entry) {
+		free (normal_path);
+		return NULL;
+	}
+	dev = ped_architecture->dev_ops->_new (normal_path);
+	if (!dev) {
+		free (entry);
+		free (normal_path);
+		return NULL;
+	}
+
+	/* Another thread may have got the same device meanwhile.  */
+	DEVICES_LOCK ();
+	walk = _device_lookup (normal_path);
 	if (!walk)
+		registered = _device_register (dev, entry);
+	DEVICES_UNLOCK ();
+	free (normal_path);
+	if (!registered) {
+		free (entry);
+		ped_architecture->dev_ops->destroy (dev);
+		if (!walk)
+			ped_exception_throw (PED_EXCEPTION_FATAL,
+					     PED_EXCEPTION_CANCEL,
+					     _("Out of memory."));
+		return walk;
+	}
+	return dev;
+}
+
+/**
+ * Gets the device with device number \p devt, as in the \c st_rdev field
+ * of stat(2).  If it is not on the device list yet, the architecture is
+ * asked for its path, and it is added as by ped_device_get().
+ *
+ * \return NULL if no such device could be found.
+ */
+PedDevice*
+ped_device_get_by_devt (dev_t devt)
+{
+	DeviceEntry*	entry;
+	PedDevice*	dev;
+	char*		path;
+
+	DEVICES_LOCK ();
+	entry = _index_find_devt (devt);
+	dev = entry ? entry->dev : NULL;
+	DEVICES_UNLOCK ();
+	if (dev)
+		return dev;
+
+	if (!ped_architecture->dev_ops->devt_path) {
+		ped_exception_throw (
+			PED_EXCEPTION_NO_FEATURE,
+			PED_EXCEPTION_CANCEL,
+			_("Looking up devices by number is not supported "
+			  "on this platform."));
+		return NULL;
+	}
+	path = ped_architecture->dev_ops->devt_path (devt);
+	if (!path)
 		return NULL;
-	_device_register (walk);
-	return walk;
+	dev = ped_device_get (path);
+	free (path);
+	return dev;
+}
+
+/**
+ * Gets a new device for the same path as \p dev, that is not on the
+ * device list.  It has its own file descriptor and read cache once
+ * opened, so one thread can read from it while another uses \p dev.
+ * Destroy it with ped_device_destroy() when done.
+ *
+ * \return NULL on failure.
+ */
+PedDevice*
+ped_device_dup (const PedDevice* dev)
+{
+	PED_ASSERT (dev != NULL);
+
+	return ped_architecture->dev_ops->_new (dev->path);
 }
 
 /**
@@ -334,6 +626,61 @@ ped_device_read (const PedDevice* dev, void* buffer, PedSector start,
         return (ped_architecture->dev_ops->read) (dev, buffer, start, count);
 }
 
+/**
+ * \internal Read the \p n sector ranges described by \p iov from \p dev.
+ *
+ * The ranges need not be sorted or contiguous.  Architectures that support
+ * it fetch them with as few requests as possible; elsewhere this is the
+ * same as calling ped_device_read() for each range.
+ *
+ * \return zero on failure.
+ */
+int
+ped_device_read_batch (const PedDevice* dev, PedIoVec* iov, int n)
+{
+        int     i;
+
+        PED_ASSERT (dev != NULL);
+        PED_ASSERT (iov != NULL || n == 0);
+        PED_ASSERT (!dev->external_mode);
+        PED_ASSERT (dev->open_count > 0);
+
+        if (n == 0)
+                return 1;
+
+        if (ped_architecture->dev_ops->read_batch)
+                return ped_architecture->dev_ops->read_batch (dev, iov, n);
+
+        for (i = 0; i < n; i++) {
+                PED_ASSERT (iov[i].buffer != NULL);
+                if (!ped_device_read (dev, iov[i].buffer, iov[i].start,
+                                      iov[i].count))
+                        return 0;
+        }
+        return 1;
+}
+
+/**
+ * Find the first sector of \p dev at or after \p start that may hold
+ * data, skipping the holes of a sparse image file, which read as zeros.
+ * Devices that can't tell where their holes are return \p start.
+ *
+ * \return \p dev->length if there is no data after \p start.
+ */
+PedSector
+ped_device_next_data (const PedDevice* dev, PedSector start)
+{
+        PED_ASSERT (dev != NULL);
+        PED_ASSERT (!dev->external_mode);
+        PED_ASSERT (dev->open_count > 0);
+
+        if (start >= dev->length)
+                return dev->length;
+        if (!ped_architecture->dev_ops->next_data)
+                return start;
+        return ped_architecture->dev_ops->next_data (dev, start);
+}
+
 /**
  * \internal Write count sectors from buffer to dev, starting at sector
  * start.
@@ -355,6 +702,40 @@ ped_device_write (PedDevice* dev, const void* buffer, PedSector start,
 	return (ped_architecture->dev_ops->write) (dev, buffer, start, count);
 }
 
+/**
+ * \internal Write the \p n sector ranges described by \p iov to \p dev.
+ *
+ * The ranges must not overlap.  Architectures that support it keep
+ * several of them in flight at once; elsewhere this is the same as
+ * calling ped_device_write() for each range.
+ *
+ * \return zero on failure.
+ */
+int
+ped_device_write_batch (PedDevice* dev, PedIoVec* iov, int n)
+{
+        int     i;
+
+        PED_ASSERT (dev != NULL);
+        PED_ASSERT (iov != NULL || n == 0);
+        PED_ASSERT (!dev->external_mode);
+        PED_ASSERT (dev->open_count > 0);
+
+        if (n == 0)
+                return 1;
+
+        if (ped_architecture->dev_ops->write_batch)
+                return ped_architecture->dev_ops->write_batch (dev, iov, n);
+
+        for (i = 0; i < n; i++) {
+                PED_ASSERT (iov[i].buffer != NULL);
+                if (!ped_device_write (dev, iov[i].buffer, iov[i].start,
+                                       iov[i].count))
+                        return 0;
+        }
+        return 1;
+}
+
 PedSector
 ped_device_check (PedDevice* dev, void* buffer, PedSector start,
 		  PedSector count)
@@ -559,4 +940,181 @@ ped_device_get_optimum_alignment(const PedDevice *dev)
         return align;
 }
 
+/**
+ * Get the I/O counters of \p dev.
+ *
+ * Not every architecture keeps these; if \p dev's does not, \p stats
+ * is zeroed.
+ *
+ * \return zero if the counters are not available.
+ */
+int
+ped_device_get_stats (const PedDevice* dev, PedDeviceStats* stats)
+{
+        PED_ASSERT (dev != NULL);
+        PED_ASSERT (stats != NULL);
+
+        if (!ped_architecture->dev_ops->get_stats) {
+                memset (stats, 0, sizeof *stats);
+                return 0;
+        }
+
+        ped_architecture->dev_ops->get_stats (dev, stats);
+        return 1;
+}
+
+/**
+ * Read the parts of \p dev that partition table probes look at first
+ * into its read cache, so that a following ped_disk_probe() or
+ * ped_disk_new() need not wait for the device.
+ *
+ * \p dev need not be open.  This never throws an exception, and may be
+ * called from any thread, as long as no other thread uses \p dev at the
+ * same time.
+ *
+ * \return zero if nothing was read.
+ */
+int
+ped_device_prefetch (PedDevice* dev)
+{
+        PED_ASSERT (dev != NULL);
+
+        if (!ped_architecture->dev_ops->prefetch)
+                return 0;
+        return ped_architecture->dev_ops->prefetch (dev);
+}
+
+#if PED_THREADS
+typedef struct {
+        PedDevice**     devs;
+        int             n;
+        int             window;         /* how far ahead of the caller
+                                           the workers may read */
+        int             next;           /* next device to prefetch */
+        int             done;           /* devices passed to func */
+        char*           ready;
+        pthread_mutex_t lock;
+        pthread_cond_t  cond;
+} ScanState;
+
+static void*
+_scan_worker (void* arg)
+{
+        ScanState*      scan = arg;
+        int             i, j;
+
+        pthread_mutex_lock (&scan->lock);
+        while (1) {
+                while (scan->next < scan->n
+                       && scan->next >= scan->done + scan->window)
+                        pthread_cond_wait (&scan->cond, &scan->lock);
+                if (scan->next >= scan->n)
+                        break;
+                i = scan->next++;
+                pthread_mutex_unlock (&scan->lock);
+
+                /* A device listed twice is read ahead only once, so that
+                   no two threads ever use the same one.  */
+                for (j = 0; j < i; j++) {
+                        if (scan->devs[j] == scan->devs[i])
+                                break;
+                }
+                if (j == i)
+                        ped_device_prefetch (scan->devs[i]);
+
+                pthread_mutex_lock (&scan->lock);
+                scan->ready[i] = 1;
+                pthread_cond_broadcast (&scan->cond);
+        }
+        pthread_mutex_unlock (&scan->lock);
+        return NULL;
+}
+#endif /* PED_THREADS */
+
+/**
+ * Call \p func for each of the \p n devices in \p devs, in order, while
+ * up to \p jobs threads read ahead the devices that come next with
+ * ped_device_prefetch().
+ *
+ * This lets a program that looks at many devices, like "parted -l", wait
+ * for all of them at once instead of one after the other.  \p func is
+ * always called from the calling thread, so it may do anything,
+ * including throw exceptions and print; it just must not destroy devices
+ * that are still to come.  With \p jobs of 1 or less, or where threads
+ * are not available, this is a plain loop.
+ *
+ * \return zero if \p func returned zero for any device.
+ */
+int
+ped_device_scan (PedDevice** devs, int n, int jobs,
+                 PedDeviceScanFunc* func, void* data)
+{
+        int             ok = 1;
+        int             i;
+
+        PED_ASSERT (devs != NULL || n == 0);
+        PED_ASSERT (func != NULL);
+
+#if PED_THREADS
+        if (jobs > 1 && n > 1 && ped_architecture->dev_ops->prefetch) {
+                ScanState       scan;
+                pthread_t*      threads;
+                int             n_threads = 0;
+
+                jobs = PED_MIN (jobs, n);
+                threads = ped_malloc (jobs * sizeof *threads);
+                scan.ready = ped_calloc (n);
+                if (!threads || !scan.ready) {
+                        free (threads);
+                        free (scan.ready);
+                        goto sequential;
+                }
+                scan.devs = devs;
+                scan.n = n;
+                scan.window = 2 * jobs;
+                scan.next = 0;
+                scan.done = 0;
+                pthread_mutex_init (&scan.lock, NULL);
+                pthread_cond_init (&scan.cond, NULL);
+
+                for (i = 0; i < jobs; i++) {
+                        if (pthread_create (&threads[n_threads], NULL,
+                                            _scan_worker, &scan) == 0)
+                                n_threads++;
+                }
+                if (!n_threads)
+                        memset (scan.ready, 1, n);
+
+                for (i = 0; i < n; i++) {
+                        pthread_mutex_lock (&scan.lock);
+                        while (!scan.ready[i])
+                                pthread_cond_wait (&scan.cond, &scan.lock);
+                        pthread_mutex_unlock (&scan.lock);
+
+                        if (!func (devs[i], data))
+                                ok = 0;
+
+                        pthread_mutex_lock (&scan.lock);
+                        scan.done = i + 1;
+                        pthread_cond_broadcast (&scan.cond);
+                        pthread_mutex_unlock (&scan.lock);
+                }
+
+                for (i = 0; i < n_threads; i++)
+                        pthread_join (threads[i], NULL);
+                pthread_cond_destroy (&scan.cond);
+                pthread_mutex_destroy (&scan.lock);
+                free (scan.ready);
+                free (threads);
+                return ok;
+        }
+sequential:
+#endif /* PED_THREADS */
+        for (i = 0; i < n; i++) {
+                if (!func (devs[i], data))
+                        ok = 0;
+        }
+        return ok;
+}
+
 /** @} */
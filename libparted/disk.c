@@ -159,8 +159,7 @@ ped_disk_probe (PedDevice* dev)
                         break;
           }
 
-        if (ped_exception)
-                ped_exception_catch ();
+        ped_exception_catch ();
         ped_exception_leave_all ();
 
         ped_device_close (dev);
@@ -179,6 +178,21 @@ ped_disk_probe (PedDevice* dev)
  */
 PedDisk*
 ped_disk_new (PedDevice* dev)
+{
+	return ped_disk_new_with_flags (dev, 0);
+}
+
+/**
+ * Like ped_disk_new(), but \p flags, a combination of
+ * \link _PedDiskOpenFlag PedDiskOpenFlag \endlink values, say how much
+ * of the partition table to read and check.  Flags a disk label type
+ * has no use for are ignored.
+ *
+ * \return A new \link _PedDisk PedDisk \endlink object;
+ *         NULL on failure (e.g. partition table not detected).
+ */
+PedDisk*
+ped_disk_new_with_flags (PedDevice* dev, int flags)
 {
 	PedDiskType*	type;
 	PedDisk*	disk;
@@ -198,6 +212,7 @@ ped_disk_new (PedDevice* dev)
 	disk = ped_disk_new_fresh (dev, type);
 	if (!disk)
 		goto error_close_dev;
+	disk->open_flags = flags;
 	if (!type->ops->read (disk))
 		goto error_destroy_disk;
 	disk->needs_clobber = 0;
@@ -276,7 +291,9 @@ ped_disk_duplicate (const PedDisk* old_disk)
 	if (!_disk_pop_update_mode (new_disk))
 		goto error_destroy_new_disk;
 
-        new_disk->needs_clobber = old_disk->needs_clobber;
+        new_disk->needs_clobber = old_disk->needs_clobber
+				  || old_disk->batch_clobber;
+	new_disk->open_flags = old_disk->open_flags;
 
 	return new_disk;
 
@@ -407,6 +424,14 @@ _ped_disk_alloc (const PedDevice* dev, const PedDiskType* disk_type)
 	disk->update_mode = 1;
 	disk->part_list = NULL;
 	disk->needs_clobber = 0;
+	disk->num_index = NULL;
+	disk->num_index_len = -1;
+	disk->geom_index = NULL;
+	disk->geom_index_len = -1;
+	disk->open_flags = 0;
+	disk->batch_depth = 0;
+	disk->batch_dirty = 0;
+	disk->batch_clobber = 0;
 	return disk;
 
 error:
@@ -418,6 +443,8 @@ _ped_disk_free (PedDisk* disk)
 {
 	_disk_push_update_mode (disk);
 	ped_disk_delete_all (disk);
+	free (disk->num_index);
+	free (disk->geom_index);
 	free (disk);
 }
 
@@ -516,11 +543,25 @@ error:
  * \note Equivalent to calling first ped_disk_commit_to_dev(), then
  *      ped_disk_commit_to_os().
  *
+ * Between ped_disk_begin_batch() and ped_disk_end_batch(), this only
+ * notes that \p disk is to be committed when the batch ends.
+ *
  * \return 0 on failure, 1 otherwise.
  */
 int
 ped_disk_commit (PedDisk* disk)
 {
+	if (disk->batch_depth) {
+		/* needs_clobber also keeps partitions from being aligned
+		 * while a fresh table has not been written yet.  Treat the
+		 * table as written from here on, and clobber at the end.
+		 */
+		disk->batch_clobber |= disk->needs_clobber;
+		disk->needs_clobber = 0;
+		disk->batch_dirty = 1;
+		return 1;
+	}
+
         /* Open the device here, so that the underlying fd is not closed
            between commit_to_dev and commit_to_os (closing causes unwanted
            udev events to be sent under Linux). */
@@ -542,6 +583,62 @@ error:
 	return 0;
 }
 
+/**
+ * Start a batch of changes to \p disk.  Until the batch ends,
+ * ped_disk_commit() writes nothing, so that a program making many
+ * changes, each of which it would commit on its own, like a script of
+ * parted commands, writes the partition table and tells the operating
+ * system about it only once.  Each change is still checked as it is
+ * made.  ped_disk_commit_to_dev() and ped_disk_commit_to_os() are not
+ * affected.
+ *
+ * Batches nest: only the end of the outermost one commits.  Destroying
+ * \p disk before then drops the changes made in the batch.
+ *
+ * \return 0 on failure, 1 otherwise.
+ */
+int
+ped_disk_begin_batch (PedDisk* disk)
+{
+	PED_ASSERT (disk != NULL);
+
+	disk->batch_depth++;
+	return 1;
+}
+
+/**
+ * End a batch of changes to \p disk started with ped_disk_begin_batch().
+ * If this ends the outermost batch, and ped_disk_commit() was called
+ * during it, \p disk is committed now.
+ *
+ * \return 0 if the commit failed, 1 otherwise.
+ */
+int
+ped_disk_end_batch (PedDisk* disk)
+{
+	PED_ASSERT (disk != NULL);
+	PED_ASSERT (disk->batch_depth > 0);
+
+	if (--disk->batch_depth || !disk->batch_dirty)
+		return 1;
+	disk->needs_clobber |= disk->batch_clobber;
+	disk->batch_clobber = 0;
+	disk->batch_dirty = 0;
+	return ped_disk_commit (disk);
+}
+
+/**
+ * Tell whether \p disk is in a batch of changes started with
+ * ped_disk_begin_batch().
+ */
+int
+ped_disk_in_batch (const PedDisk* disk)
+{
+	PED_ASSERT (disk != NULL);
+
+	return disk->batch_depth > 0;
+}
+
 /**
  * \addtogroup PedPartition
  *
@@ -587,7 +684,9 @@ ped_partition_get_path (const PedPartition* part)
 /**
  * Perform a sanity check on a partition table.
  *
- * \note The check performed is generic (i.e. it does not depends on the label
+ * \note Apart from the checks a disk label type may add, such as verifying
+ *      a GPT backup table that was skipped with PED_DISK_OPEN_LAZY_BACKUP,
+ *      the check performed is generic (i.e. it does not depends on the label
  *      type of the disk.
  *
  * \throws PED_EXCEPTION_WARNING if a partition type ID does not match the file
@@ -602,6 +701,9 @@ ped_disk_check (const PedDisk* disk)
 
 	PED_ASSERT (disk != NULL);
 
+	if (disk->type->ops->check && !disk->type->ops->check (disk))
+		return 0;
+
 	for (walk = disk->part_list; walk;
 	     walk = ped_disk_next_partition (disk, walk)) {
 		const PedFileSystemType*	fs_type = walk->fs_type;
@@ -681,6 +783,188 @@ ped_disk_get_primary_partition_count (const PedDisk* disk)
 	return count;
 }
 
+/* Lookups by partition number go through disk->num_index, which maps
+ * each number to the first partition in list order that has it.  It is
+ * dropped whenever partitions may have been added, removed or renumbered:
+ * by _disk_raw_add(), _disk_raw_remove(), a change of update mode, or an
+ * enumeration that changed a number.  The next lookup rebuilds it.
+ *
+ * Label enumerate ops only renumber the partition they were given, except
+ * where they say so with _ped_disk_renumbered().
+ */
+static void
+_disk_num_index_invalidate (const PedDisk* disk)
+{
+	((PedDisk*) disk)->num_index_len = -1;
+}
+
+/**
+ * Tell libparted that partitions of \p disk other than the one being
+ * enumerated were renumbered.  For use by partition_enumerate ops.
+ */
+void
+_ped_disk_renumbered (PedDisk* disk)
+{
+	PED_ASSERT (disk != NULL);
+
+	_disk_num_index_invalidate (disk);
+}
+
+static int
+_disk_num_index_build (const PedDisk* disk)
+{
+	PedDisk*	d = (PedDisk*) disk;
+	PedPartition**	index;
+	PedPartition*	walk;
+	int		highest = 0;
+
+	if (d->num_index_len >= 0)
+		return 1;
+
+	for (walk = d->part_list; walk; walk = ped_disk_next_partition (d, walk)) {
+		if (!(walk->type & PED_PARTITION_FREESPACE) && walk->num > highest)
+			highest = walk->num;
+	}
+
+	index = realloc (d->num_index, (highest + 1) * sizeof *index);
+	if (!index)
+		return 0;
+	memset (index, 0, (highest + 1) * sizeof *index);
+	for (walk = d->part_list; walk; walk = ped_disk_next_partition (d, walk)) {
+		if (!(walk->type & PED_PARTITION_FREESPACE) && walk->num > 0
+		    && !index[walk->num])
+			index[walk->num] = walk;
+	}
+	d->num_index = index;
+	d->num_index_len = highest + 1;
+	return 1;
+}
+
+/* Lookups by sector and overlap checks go through disk->geom_index, a copy
+ * of the primary partition list followed by the logical partition list.
+ * Both lists are kept in order of start sector by _disk_raw_add(), so the
+ * copy can be binary searched.  Labels may read overlapping or misplaced
+ * partitions from disk, though, so the build records which assumptions
+ * hold and lookups that need more fall back to walking the lists.  The
+ * index is dropped whenever a list changes.
+ */
+#define GEOM_INDEX_SORTED_PRI	1	/* primaries sorted by start */
+#define GEOM_INDEX_SORTED_LOG	2	/* logicals sorted by start */
+#define GEOM_INDEX_DISJOINT	4	/* no overlaps, logicals inside the
+					   extended partition */
+
+static void
+_disk_geom_index_invalidate (const PedDisk* disk)
+{
+	((PedDisk*) disk)->geom_index_len = -1;
+}
+
+static void
+_disk_index_invalidate (const PedDisk* disk)
+{
+	_disk_num_index_invalidate (disk);
+	_disk_geom_index_invalidate (disk);
+}
+
+/* Returns the GEOM_INDEX_SORTED_* and GEOM_INDEX_DISJOINT bits that hold
+ * for the \p n partitions in \p list.
+ */
+static int _GL_ATTRIBUTE_PURE
+_geom_index_check (PedPartition* const* list, int n, int sorted)
+{
+	int	flags = sorted | GEOM_INDEX_DISJOINT;
+	int	i;
+
+	for (i = 1; i < n; i++) {
+		if (list[i]->geom.start < list[i - 1]->geom.start)
+			return 0;
+		if (list[i]->geom.start <= list[i - 1]->geom.end)
+			flags &= ~GEOM_INDEX_DISJOINT;
+	}
+	return flags;
+}
+
+static int
+_disk_geom_index_build (const PedDisk* disk)
+{
+	PedDisk*	d = (PedDisk*) disk;
+	PedPartition**	index;
+	PedPartition*	ext_part;
+	PedPartition*	walk;
+	int		inside = 1;
+	int		pri_flags;
+	int		log_flags;
+	int		n = 0;
+
+	if (d->geom_index_len >= 0)
+		return 1;
+
+	ext_part = ped_disk_extended_partition (d);
+	for (walk = d->part_list; walk; walk = walk->next)
+		n++;
+	for (walk = ext_part ? ext_part->part_list : NULL; walk;
+	     walk = walk->next)
+		n++;
+
+	index = realloc (d->geom_index, (n ? n : 1) * sizeof *index);
+	if (!index)
+		return 0;
+	n = 0;
+	for (walk = d->part_list; walk; walk = walk->next)
+		index[n++] = walk;
+	d->geom_index_split = n;
+	for (walk = ext_part ? ext_part->part_list : NULL; walk;
+	     walk = walk->next) {
+		if (!ped_geometry_test_inside (&ext_part->geom, &walk->geom))
+			inside = 0;
+		index[n++] = walk;
+	}
+
+	pri_flags = _geom_index_check (index, d->geom_index_split,
+				       GEOM_INDEX_SORTED_PRI);
+	log_flags = _geom_index_check (index + d->geom_index_split,
+				       n - d->geom_index_split,
+				       GEOM_INDEX_SORTED_LOG);
+	d->geom_index_flags = (pri_flags | log_flags) & ~GEOM_INDEX_DISJOINT;
+	if (pri_flags & log_flags & GEOM_INDEX_DISJOINT && inside)
+		d->geom_index_flags |= GEOM_INDEX_DISJOINT;
+	d->geom_index = index;
+	d->geom_index_len = n;
+	return 1;
+}
+
+/* Returns the position of the first of the \p n partitions in \p list that
+ * starts at or after \p sect.  \p list must be sorted by start.
+ */
+static int _GL_ATTRIBUTE_PURE
+_geom_index_lower_bound (PedPartition* const* list, int n, PedSector sect)
+{
+	int	lo = 0;
+	int	hi = n;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (list[mid]->geom.start < sect)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Returns the partition among the \p n in \p list that contains \p sect,
+ * or NULL.  \p list must be sorted and free of overlaps.
+ */
+static PedPartition* _GL_ATTRIBUTE_PURE
+_geom_index_find (PedPartition* const* list, int n, PedSector sect)
+{
+	int	i = _geom_index_lower_bound (list, n, sect + 1);
+
+	if (i > 0 && list[i - 1]->geom.end >= sect)
+		return list[i - 1];
+	return NULL;
+}
+
 /**
  * Get the highest available partition number on \p disk.
  */
@@ -692,6 +976,14 @@ ped_disk_get_last_partition_num (const PedDisk* disk)
 
 	PED_ASSERT (disk != NULL);
 
+	if (_disk_num_index_build (disk) && disk->num_index_len > 1) {
+		highest = disk->num_index_len - 1;
+		if (disk->num_index[highest]->num == highest)
+			return highest;
+		_disk_num_index_invalidate (disk);
+		highest = -1;
+	}
+
 	for (walk = disk->part_list; walk;
 	     walk = ped_disk_next_partition (disk, walk)) {
 		if (walk->num > highest)
@@ -960,6 +1252,8 @@ static int
 _partition_enumerate (PedPartition* part)
 {
 	const PedDiskType*	disk_type;
+	int			old_num;
+	int			ok;
 
 	PED_ASSERT (part != NULL);
 	PED_ASSERT (part->disk != NULL);
@@ -967,7 +1261,11 @@ _partition_enumerate (PedPartition* part)
 	PED_ASSERT (disk_type != NULL);
 	PED_ASSERT (disk_type->ops->partition_enumerate != NULL);
 
-	return disk_type->ops->partition_enumerate (part);
+	old_num = part->num;
+	ok = disk_type->ops->partition_enumerate (part);
+	if (part->num != old_num)
+		_disk_num_index_invalidate (part->disk);
+	return ok;
 }
 
 /**
@@ -1101,8 +1399,8 @@ _alloc_extended_freespace (PedDisk* disk)
 
 		if (last)
 			return _disk_raw_insert_after (disk, last, free_space);
-		else
-			extended_part->part_list = free_space;
+		_disk_geom_index_invalidate (disk);
+		extended_part->part_list = free_space;
 	}
 
 	return 1;
@@ -1142,8 +1440,8 @@ _disk_alloc_freespace (PedDisk* disk)
 					last_end + 1, disk->dev->length - 1);
 		if (last)
 			return _disk_raw_insert_after (disk, last, free_space);
-		else
-			disk->part_list = free_space;
+		_disk_geom_index_invalidate (disk);
+		disk->part_list = free_space;
 	}
 
 	return 1;
@@ -1158,6 +1456,7 @@ _disk_alloc_freespace (PedDisk* disk)
 static int
 _disk_push_update_mode (PedDisk* disk)
 {
+	_disk_index_invalidate (disk);
 	if (!disk->update_mode) {
 #ifdef DEBUG
 		if (!_disk_check_sanity (disk))
@@ -1183,6 +1482,7 @@ _disk_pop_update_mode (PedDisk* disk)
 {
 	PED_ASSERT (disk->update_mode);
 
+	_disk_index_invalidate (disk);
 	if (disk->update_mode == 1) {
 	/* re-allocate metadata BEFORE leaving update mode, to prevent infinite
 	 * recursion (metadata allocation requires update mode)
@@ -1766,6 +2066,16 @@ ped_disk_get_partition (const PedDisk* disk, int num)
 
 	PED_ASSERT (disk != NULL);
 
+	if (num > 0 && _disk_num_index_build (disk)) {
+		if (num >= disk->num_index_len)
+			return NULL;
+		walk = disk->num_index[num];
+		if (!walk || walk->num == num)
+			return walk;
+		/* Renumbered without us noticing; fall back to a scan.  */
+		_disk_num_index_invalidate (disk);
+	}
+
 	for (walk = disk->part_list; walk;
 	     walk = ped_disk_next_partition (disk, walk)) {
 		if (walk->num == num && !(walk->type & PED_PARTITION_FREESPACE))
@@ -1787,6 +2097,18 @@ ped_disk_get_partition_by_sector (const PedDisk* disk, PedSector sect)
 
 	PED_ASSERT (disk != NULL);
 
+	if (_disk_geom_index_build (disk)
+	    && disk->geom_index_flags & GEOM_INDEX_DISJOINT) {
+		walk = _geom_index_find (disk->geom_index,
+					 disk->geom_index_split, sect);
+		if (walk && walk->type == PED_PARTITION_EXTENDED)
+			walk = _geom_index_find (
+				disk->geom_index + disk->geom_index_split,
+				disk->geom_index_len - disk->geom_index_split,
+				sect);
+		return walk;
+	}
+
 	for (walk = disk->part_list; walk;
 	     walk = ped_disk_next_partition (disk, walk)) {
 		if (ped_geometry_test_sector_inside (&walk->geom, sect)
@@ -1829,6 +2151,7 @@ _disk_raw_insert_before (PedDisk* disk, PedPartition* loc, PedPartition* part)
 	PED_ASSERT (loc != NULL);
 	PED_ASSERT (part != NULL);
 
+	_disk_geom_index_invalidate (disk);
 	part->prev = loc->prev;
 	part->next = loc;
 	if (part->prev) {
@@ -1851,6 +2174,7 @@ _disk_raw_insert_after (PedDisk* disk, PedPartition* loc, PedPartition* part)
 	PED_ASSERT (loc != NULL);
 	PED_ASSERT (part != NULL);
 
+	_disk_geom_index_invalidate (disk);
 	part->prev = loc;
 	part->next = loc->next;
 	if (loc->next)
@@ -1866,6 +2190,7 @@ _disk_raw_remove (PedDisk* disk, PedPartition* part)
 	PED_ASSERT (disk != NULL);
 	PED_ASSERT (part != NULL);
 
+	_disk_index_invalidate (disk);
 	if (part->prev) {
 		part->prev->next = part->next;
 		if (part->next)
@@ -1896,6 +2221,7 @@ _disk_raw_add (PedDisk* disk, PedPartition* part)
 
 	PED_ASSERT (disk->update_mode);
 
+	_disk_index_invalidate (disk);
 	ext_part = ped_disk_extended_partition (disk);
 
 	last = NULL;
@@ -1926,18 +2252,19 @@ _disk_raw_add (PedDisk* disk, PedPartition* part)
 static PedConstraint*
 _partition_get_overlap_constraint (PedPartition* part, PedGeometry* geom)
 {
+	PedDisk*	disk = part->disk;
 	PedSector	min_start;
 	PedSector	max_end;
 	PedPartition*	walk;
 	PedGeometry	free_space;
 
-	PED_ASSERT (part->disk->update_mode);
+	PED_ASSERT (disk->update_mode);
 	PED_ASSERT (part->geom.dev == geom->dev);
 
 	if (part->type & PED_PARTITION_LOGICAL) {
 		PedPartition* ext_part;
 
-		ext_part = ped_disk_extended_partition (part->disk);
+		ext_part = ped_disk_extended_partition (disk);
 		PED_ASSERT (ext_part != NULL);
 
 		min_start = ext_part->geom.start;
@@ -1946,7 +2273,33 @@ _partition_get_overlap_constraint (PedPartition* part, PedGeometry* geom)
 	} else {
 		min_start = 0;
 		max_end = LLONG_MAX - 1;
-		walk = part->disk->part_list;
+		walk = disk->part_list;
+	}
+
+	/* Skip the partitions that start before geom, which the loop below
+	 * would walk past anyway.  min_start ends up just past the last of
+	 * them other than part.
+	 */
+	if (walk && _disk_geom_index_build (disk)
+	    && disk->geom_index_flags & (part->type & PED_PARTITION_LOGICAL
+					 ? GEOM_INDEX_SORTED_LOG
+					 : GEOM_INDEX_SORTED_PRI)) {
+		PedPartition**	list = disk->geom_index;
+		int		n = disk->geom_index_split;
+		int		i;
+
+		if (part->type & PED_PARTITION_LOGICAL) {
+			list += n;
+			n = disk->geom_index_len - n;
+		}
+		PED_ASSERT (n > 0 && list[0] == walk);
+
+		i = _geom_index_lower_bound (list, n, geom->start);
+		walk = i < n ? list[i] : NULL;
+		if (i > 0 && list[i - 1] == part)
+			i--;
+		if (i > 0)
+			min_start = list[i - 1]->geom.end + 1;
 	}
 
 	while (walk != NULL
@@ -46,6 +46,16 @@
  *    handle everything itself. In this case, PED_EXCEPTION_UNHANDLED is
  *    returned.
  *
+ * Each thread has its own exception state: an exception thrown in one
+ * thread is caught, rethrown or fetched in that thread only, and
+ * ped_exception_fetch_all() only affects the thread that calls it.  The
+ * handler set with ped_exception_set_handler() is shared by all threads,
+ * so in a program that uses libparted from several threads at once, it
+ * may be called concurrently and must be prepared for that.  Where the
+ * compiler has no thread-local storage, the exception state is shared by
+ * all threads: libparted then starts none of its own, and a program must
+ * not call it from several threads at once.
+ *
  * @{
  */
 
@@ -67,13 +77,21 @@
 #include <stdarg.h>
 #include <stdlib.h>
 
+#if HAVE_TLS
+# define THREAD_LOCAL __thread
+#else
+# define THREAD_LOCAL
+#endif
+
+/* Kept for compatibility.  It is only meaningful in single-threaded
+   programs, and libparted itself no longer reads it.  */
 int				ped_exception = 0;
 
 static PedExceptionOption default_handler (PedException* ex);
 
 static PedExceptionHandler*	ex_handler = default_handler;
-static PedException*		ex = NULL;
-static int			ex_fetch_count = 0;
+static THREAD_LOCAL PedException*	ex = NULL;
+static THREAD_LOCAL int		ex_fetch_count = 0;
 
 static const char *const type_strings [] = {
 	N_("Information"),
@@ -188,8 +206,8 @@ ped_exception_get_handler (void)
 void
 ped_exception_catch ()
 {
-        if (ped_exception) {
-                ped_exception = 0;
+        if (ex) {
+                __atomic_store_n (&ped_exception, 0, __ATOMIC_RELAXED);
                 free (ex->message);
                 free (ex);
                 ex = NULL;
@@ -201,7 +219,7 @@ do_throw ()
 {
 	PedExceptionOption	ex_opt;
 
-	ped_exception = 1;
+	__atomic_store_n (&ped_exception, 1, __ATOMIC_RELAXED);
 
 	if (ex_fetch_count) {
 		return PED_EXCEPTION_UNHANDLED;
@@ -232,7 +250,7 @@ ped_exception_throw (PedExceptionType ex_type,
 {
 	va_list		arg_list;
 	int result;
-	static int size = 1000;
+	int size = 1000;
 
 	if (ex)
 		ped_exception_catch ();
@@ -256,7 +274,7 @@ ped_exception_throw (PedExceptionType ex_type,
 			if (result > -1 && result < size)
 					break;
 
-			size += 10;
+			size = result > -1 ? result + 1 : size * 2;
 			free (ex->message);
 	}
 
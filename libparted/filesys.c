@@ -32,6 +32,12 @@
 #include <parted/parted.h>
 #include <parted/debug.h>
 
+#include <stdlib.h>
+#include <string.h>
+#if PED_THREADS
+# include <pthread.h>
+#endif
+
 #if ENABLE_NLS
 #  include <libintl.h>
 #  define _(String) dgettext (PACKAGE, String)
@@ -246,12 +252,625 @@ _best_match (const PedGeometry* geom, PedFileSystemType* detected [],
 }
 
 
+/* Read sectors START to START + COUNT - 1 of DEV into BUF.  Sectors that
+ * can't be read are left as zeros, where no magic matches.
+ */
+static void
+_scan_read (PedDevice* dev, char* buf, PedSector start, PedSector count)
+{
+	PedSector	i;
+
+	ped_exception_fetch_all ();
+	if (!ped_device_read (dev, buf, start, count)) {
+		ped_exception_catch ();
+		for (i = 0; i < count; i++) {
+			char* b = buf + i * dev->sector_size;
+			if (!ped_device_read (dev, b, start + i, 1)) {
+				ped_exception_catch ();
+				memset (b, 0, dev->sector_size);
+			}
+		}
+	}
+	ped_exception_leave_all ();
+}
+
+/* Whether some magic in MAGIC matches at BUF, which holds AVAIL bytes.  */
+static int
+_scan_match (const PedFileSystemMagic* magic, int n_magic, PedSector ss,
+	     const char* buf, PedSector avail)
+{
+	int	i;
+
+	for (i = 0; i < n_magic; i++) {
+		PedSector pos = magic[i].sector * ss + magic[i].offset;
+
+		if (pos + magic[i].length > avail)
+			continue;
+		if (buf[pos] == magic[i].bytes[0]
+		    && !memcmp (buf + pos, magic[i].bytes, magic[i].length))
+			return 1;
+	}
+	return 0;
+}
+
+/* The magics of all registered file system types.  */
+typedef struct {
+	PedFileSystemMagic*	magic;
+	int			n_magic;
+	int			every_sector;	/* some type has no magic */
+	PedSector		span;		/* sectors a magic may reach */
+} ScanMagics;
+
+static int
+_scan_magics_init (ScanMagics* sm, PedSector ss)
+{
+	PedFileSystemType*	walk = NULL;
+
+	sm->magic = NULL;
+	sm->n_magic = 0;
+	sm->every_sector = 0;
+	sm->span = 1;
+
+	while ((walk = ped_file_system_type_get_next (walk))) {
+		const PedFileSystemMagic* m = walk->ops->magic;
+
+		if (!m) {
+			sm->every_sector = 1;
+			continue;
+		}
+		for (; m->length; m++) {
+			PedFileSystemMagic* grown;
+
+			grown = realloc (sm->magic,
+					 (sm->n_magic + 1) * sizeof *sm->magic);
+			if (!grown) {
+				free (sm->magic);
+				return 0;
+			}
+			sm->magic = grown;
+			sm->magic[sm->n_magic++] = *m;
+			sm->span = PED_MAX (sm->span,
+					    (m->sector * ss + m->offset
+					     + m->length + ss - 1) / ss);
+		}
+	}
+	return 1;
+}
+
+/* Where _scan_region reports to.  FOUND is called for each sector where
+ * a magic matches, and PROGRESS before each chunk with the first sector
+ * not scanned yet.  Either returns zero to stop.
+ */
+typedef struct _ScanSink ScanSink;
+struct _ScanSink {
+	int	(*found) (ScanSink* sink, PedSector start);
+	int	(*progress) (ScanSink* sink, PedSector next);
+};
+
+/* Scan sectors FIRST to LAST of DEV, which is open, for the magics in SM.
+ * Returns zero on failure, or if SINK asked to stop.
+ */
+static int
+_scan_region (const ScanMagics* sm, PedDevice* dev, PedSector first,
+	      PedSector last, ScanSink* sink)
+{
+	PedSector	ss = dev->sector_size;
+	PedSector	start;
+	PedSector	buf_start = 0;	/* sectors held in buf */
+	PedSector	buf_count = 0;
+	char*		buf;
+
+	buf = ped_malloc ((BUFFER_SIZE + sm->span) * ss);
+	if (!buf)
+		return 0;
+
+	start = first;
+	while (start <= last) {
+		PedSector	n = PED_MIN (BUFFER_SIZE, last - start + 1);
+		PedSector	end;
+		PedSector	i;
+
+		if (!sink->progress (sink, start))
+			goto error;
+
+		/* A file system starting here would have its magic in a
+		 * hole, which reads as zeros.
+		 */
+		if (!sm->every_sector) {
+			PedSector data_start = ped_device_next_data (dev, start);
+			if (data_start - sm->span >= start) {
+				start = data_start - sm->span + 1;
+				continue;
+			}
+		}
+
+		/* Keep what's already read of the sectors needed next, and
+		 * read the rest.
+		 */
+		end = PED_MIN (start + n + sm->span, dev->length);
+		if (start >= buf_start && start < buf_start + buf_count) {
+			PedSector kept = buf_start + buf_count - start;
+			memmove (buf, buf + (start - buf_start) * ss, kept * ss);
+			buf_count = kept;
+		} else {
+			buf_count = 0;
+		}
+		buf_start = start;
+		if (buf_start + buf_count < end) {
+			_scan_read (dev, buf + buf_count * ss,
+				    buf_start + buf_count,
+				    end - buf_start - buf_count);
+			buf_count = end - buf_start;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (!sm->every_sector
+			    && !_scan_match (sm->magic, sm->n_magic, ss,
+					     buf + i * ss,
+					     (buf_count - i) * ss))
+				continue;
+			if (!sink->found (sink, start + i))
+				goto error;
+		}
+		start += n;
+	}
+	free (buf);
+	return 1;
+
+error:
+	free (buf);
+	return 0;
+}
+
+/* Hands what _scan_region finds straight to the caller's function.  */
+typedef struct {
+	ScanSink		sink;
+	PedGeometry*		starts;
+	PedTimer*		timer;
+	PedFileSystemScanFunc*	func;
+	void*			data;
+} ScanDirect;
+
+static int
+_scan_direct_found (ScanSink* sink, PedSector start)
+{
+	ScanDirect*	direct = (ScanDirect*) sink;
+
+	return direct->func (start, direct->data);
+}
+
+static int
+_scan_direct_progress (ScanSink* sink, PedSector next)
+{
+	ScanDirect*	direct = (ScanDirect*) sink;
+
+	ped_timer_update (direct->timer, 1.0 * (next - direct->starts->start)
+					 / direct->starts->length);
+	return 1;
+}
+
+#if PED_THREADS
+/* Don't give a thread less than this to scan.  */
+#define SCAN_PIECE_MIN	(4 * BUFFER_SIZE)	/* in sectors */
+
+typedef struct _ScanJobs ScanJobs;
+
+/* The part of the region one thread scans, on its own device, and what
+ * it has found so far.
+ */
+typedef struct {
+	ScanSink	sink;
+	ScanJobs*	jobs;
+	PedDevice*	dev;
+	PedSector	first;
+	PedSector	last;
+	PedSector	next;		/* first sector not scanned yet */
+	PedSector*	found;
+	int		n_found;
+	int		n_alloc;
+	int		done;
+	int		failed;
+	int		started;	/* runs in a thread of its own */
+	pthread_t	thread;
+} ScanPiece;
+
+struct _ScanJobs {
+	const ScanMagics*	sm;
+	ScanPiece*		pieces;
+	int			n;
+	int			stop;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+};
+
+static int
+_scan_piece_found (ScanSink* sink, PedSector start)
+{
+	ScanPiece*	piece = (ScanPiece*) sink;
+	ScanJobs*	jobs = piece->jobs;
+	int		ok = 1;
+
+	pthread_mutex_lock (&jobs->lock);
+	if (piece->n_found == piece->n_alloc) {
+		int		n_alloc = PED_MAX (2 * piece->n_alloc, 16);
+		PedSector*	grown;
+
+		grown = realloc (piece->found, n_alloc * sizeof *grown);
+		if (grown) {
+			piece->found = grown;
+			piece->n_alloc = n_alloc;
+		} else {
+			ok = 0;
+		}
+	}
+	if (ok) {
+		piece->found[piece->n_found++] = start;
+		pthread_cond_broadcast (&jobs->cond);
+	}
+	pthread_mutex_unlock (&jobs->lock);
+	return ok;
+}
+
+static int
+_scan_piece_progress (ScanSink* sink, PedSector next)
+{
+	ScanPiece*	piece = (ScanPiece*) sink;
+	ScanJobs*	jobs = piece->jobs;
+	int		stop;
+
+	pthread_mutex_lock (&jobs->lock);
+	piece->next = next;
+	stop = jobs->stop;
+	pthread_cond_broadcast (&jobs->cond);
+	pthread_mutex_unlock (&jobs->lock);
+	return !stop;
+}
+
+static void*
+_scan_piece_worker (void* arg)
+{
+	ScanPiece*	piece = arg;
+	ScanJobs*	jobs = piece->jobs;
+	int		ok;
+
+	ok = _scan_region (jobs->sm, piece->dev, piece->first, piece->last,
+			   &piece->sink);
+
+	pthread_mutex_lock (&jobs->lock);
+	piece->next = piece->last + 1;
+	piece->done = 1;
+	if (!ok && !jobs->stop)
+		piece->failed = 1;
+	pthread_cond_broadcast (&jobs->cond);
+	pthread_mutex_unlock (&jobs->lock);
+	return NULL;
+}
+
+/* Split STARTS into N pieces, each scanned by a thread of its own on a
+ * device of its own, and hand what they find to FUNC, in order, from
+ * the calling thread.  Returns -1 if the threads couldn't be set up,
+ * and the region should be scanned the plain way.
+ */
+static int
+_scan_jobs (const ScanMagics* sm, PedGeometry* starts, int n,
+	    PedTimer* timer, PedFileSystemScanFunc* func, void* data)
+{
+	ScanJobs	jobs;
+	int		ok = 1;
+	int		k;
+
+	jobs.pieces = ped_calloc (n * sizeof *jobs.pieces);
+	if (!jobs.pieces)
+		return -1;
+	jobs.sm = sm;
+	jobs.n = n;
+	jobs.stop = 0;
+
+	/* Opening a device may ask questions, so do it here, not in the
+	 * threads.
+	 */
+	ped_exception_fetch_all ();
+	for (k = 0; k < n; k++) {
+		ScanPiece*	piece = &jobs.pieces[k];
+
+		piece->sink.found = _scan_piece_found;
+		piece->sink.progress = _scan_piece_progress;
+		piece->jobs = &jobs;
+		piece->first = starts->start + starts->length * k / n;
+		piece->last = starts->start + starts->length * (k + 1) / n - 1;
+		piece->next = piece->first;
+		piece->dev = ped_device_dup (starts->dev);
+		if (!piece->dev)
+			break;
+		if (!ped_device_open (piece->dev)) {
+			ped_device_destroy (piece->dev);
+			piece->dev = NULL;
+			break;
+		}
+	}
+	ped_exception_catch ();
+	ped_exception_leave_all ();
+	if (k < n) {
+		while (k--)
+			ped_device_destroy (jobs.pieces[k].dev);
+		free (jobs.pieces);
+		return -1;
+	}
+
+	pthread_mutex_init (&jobs.lock, NULL);
+	pthread_cond_init (&jobs.cond, NULL);
+	for (k = 0; k < n; k++) {
+		ScanPiece*	piece = &jobs.pieces[k];
+
+		piece->started = !pthread_create (&piece->thread, NULL,
+						  _scan_piece_worker, piece);
+		if (!piece->started)
+			_scan_piece_worker (piece);
+	}
+
+	/* The pieces are in order, and so is what each finds.  */
+	for (k = 0; k < n && ok; k++) {
+		ScanPiece*	piece = &jobs.pieces[k];
+		int		i = 0;
+
+		while (ok) {
+			PedSector	scanned = 0;
+			PedSector	start = 0;
+			int		have;
+			int		done;
+			int		j;
+
+			pthread_mutex_lock (&jobs.lock);
+			if (i == piece->n_found && !piece->done)
+				pthread_cond_wait (&jobs.cond, &jobs.lock);
+			for (j = 0; j < n; j++)
+				scanned += jobs.pieces[j].next
+					   - jobs.pieces[j].first;
+			have = i < piece->n_found;
+			if (have)
+				start = piece->found[i++];
+			done = piece->done;
+			if (!have && done && piece->failed)
+				ok = 0;
+			pthread_mutex_unlock (&jobs.lock);
+
+			ped_timer_update (timer, 1.0 * scanned
+						 / starts->length);
+			if (have) {
+				if (!func (start, data))
+					ok = 0;
+			} else if (done) {
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_lock (&jobs.lock);
+	jobs.stop = 1;
+	pthread_mutex_unlock (&jobs.lock);
+	for (k = 0; k < n; k++) {
+		ScanPiece*	piece = &jobs.pieces[k];
+
+		if (piece->started)
+			pthread_join (piece->thread, NULL);
+		ped_device_destroy (piece->dev);
+		free (piece->found);
+	}
+	pthread_cond_destroy (&jobs.cond);
+	pthread_mutex_destroy (&jobs.lock);
+	free (jobs.pieces);
+	return ok;
+}
+#endif /* PED_THREADS */
+
+/**
+ * Look for file systems that start anywhere in \p starts, reading the
+ * region once, in large sequential chunks, and calling \p func for
+ * each sector where the magic of some file system type is found.  Holes
+ * in sparse image files are skipped.  Unreadable sectors are ignored.
+ *
+ * File system types that don't give their magic can't be ruled out, so
+ * if one is registered, \p func is called for every sector.
+ *
+ * \return zero on failure, or if \p func asked to stop.
+ */
+int
+ped_file_system_scan (PedGeometry* starts, PedTimer* timer,
+		      PedFileSystemScanFunc* func, void* data)
+{
+	return ped_file_system_scan_jobs (starts, 1, timer, func, data);
+}
+
+/**
+ * Like ped_file_system_scan(), but with \p jobs greater than 1, large
+ * regions are split in up to \p jobs pieces, read at once by as many
+ * threads, each on a device of its own from ped_device_dup().  \p func
+ * is still called from the calling thread only, in order of \p start,
+ * while the threads keep reading, and \p timer shows how much of the
+ * whole region was read.
+ */
+int
+ped_file_system_scan_jobs (PedGeometry* starts, int jobs, PedTimer* timer,
+			   PedFileSystemScanFunc* func, void* data)
+{
+	PedDevice*	dev;
+	ScanMagics	sm;
+	ScanDirect	direct;
+	int		ok = 0;
+
+	PED_ASSERT (starts != NULL);
+	PED_ASSERT (func != NULL);
+
+	dev = starts->dev;
+	if (!_scan_magics_init (&sm, dev->sector_size))
+		return 0;
+	if (!ped_device_open (dev))
+		goto error;
+
+	ok = -1;
+#if PED_THREADS
+	/* Going through every sector, the time is spent in FUNC, which only
+	 * runs in this thread anyway.
+	 */
+	jobs = PED_MIN (jobs, starts->length / SCAN_PIECE_MIN);
+	if (jobs > 1 && !sm.every_sector)
+		ok = _scan_jobs (&sm, starts, jobs, timer, func, data);
+#endif /* PED_THREADS */
+	if (ok < 0) {
+		direct.sink.found = _scan_direct_found;
+		direct.sink.progress = _scan_direct_progress;
+		direct.starts = starts;
+		direct.timer = timer;
+		direct.func = func;
+		direct.data = data;
+		ok = _scan_region (&sm, dev, starts->start, starts->end,
+				   &direct.sink);
+	}
+
+	if (ok)
+		ped_timer_update (timer, 1.0);
+	ped_device_close (dev);
+error:
+	free (sm.magic);
+	return ok;
+}
+
+/* The sectors of a region where file system magics are, read at once by
+ * _probe_read_magics.
+ */
+typedef struct {
+	PedIoVec*	iov;
+	int		n_iov;
+	char*		buf;
+} ProbeMagics;
+
+static int
+_iovec_cmp_start (const void* a, const void* b)
+{
+	const PedIoVec*	x = a;
+	const PedIoVec*	y = b;
+
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+/* Read the sectors of GEOM that hold the magic of some registered file
+ * system type, in one batch.  Magics that don't fit in GEOM are left
+ * out.
+ */
+static int
+_probe_read_magics (PedGeometry* geom, ProbeMagics* pm)
+{
+	PedFileSystemType*	walk = NULL;
+	PedSector		ss = geom->dev->sector_size;
+	PedSector		total = 0;
+	char*			buf;
+	int			n = 0;
+	int			i;
+
+	pm->iov = NULL;
+	pm->n_iov = 0;
+	pm->buf = NULL;
+
+	/* One range per magic, then merge those that touch.  */
+	while ((walk = ped_file_system_type_get_next (walk))) {
+		const PedFileSystemMagic* m = walk->ops->magic;
+
+		for (; m && m->length; m++) {
+			PedSector	pos = m->sector * ss + m->offset;
+			PedSector	first = pos / ss;
+			PedSector	last = (pos + m->length - 1) / ss;
+			PedIoVec*	grown;
+
+			if (last >= geom->length)
+				continue;
+			grown = realloc (pm->iov, (n + 1) * sizeof *grown);
+			if (!grown)
+				goto error;
+			pm->iov = grown;
+			pm->iov[n].start = geom->start + first;
+			pm->iov[n].count = last - first + 1;
+			n++;
+		}
+	}
+	if (!n)
+		return 1;
+
+	qsort (pm->iov, n, sizeof *pm->iov, _iovec_cmp_start);
+	pm->n_iov = 1;
+	for (i = 1; i < n; i++) {
+		PedIoVec*	prev = &pm->iov[pm->n_iov - 1];
+		PedSector	end = pm->iov[i].start + pm->iov[i].count;
+
+		if (pm->iov[i].start <= prev->start + prev->count)
+			prev->count = PED_MAX (prev->count, end - prev->start);
+		else
+			pm->iov[pm->n_iov++] = pm->iov[i];
+	}
+
+	for (i = 0; i < pm->n_iov; i++)
+		total += pm->iov[i].count;
+	buf = pm->buf = ped_malloc (total * ss);
+	if (!buf)
+		goto error;
+	for (i = 0; i < pm->n_iov; i++) {
+		pm->iov[i].buffer = buf;
+		buf += pm->iov[i].count * ss;
+	}
+	if (!ped_device_read_batch (geom->dev, pm->iov, pm->n_iov))
+		goto error;
+	return 1;
+
+error:
+	free (pm->iov);
+	free (pm->buf);
+	return 0;
+}
+
+/* Whether FS_TYPE may be in GEOM, going by the magics in PM: types that
+ * don't give their magic may always be.
+ */
+static int
+_probe_magic_found (const PedFileSystemType* fs_type, PedGeometry* geom,
+		    const ProbeMagics* pm)
+{
+	const PedFileSystemMagic*	m = fs_type->ops->magic;
+	PedSector			ss = geom->dev->sector_size;
+	int				i;
+
+	if (!m)
+		return 1;
+	for (; m->length; m++) {
+		PedSector	pos = m->sector * ss + m->offset;
+		PedSector	start = geom->start + pos / ss;
+
+		for (i = 0; i < pm->n_iov; i++) {
+			const PedIoVec*	v = &pm->iov[i];
+			const char*	bytes;
+
+			if (start < v->start
+			    || pos + m->length > (v->start - geom->start
+						  + v->count) * ss)
+				continue;
+			bytes = (const char*) v->buffer
+				+ (start - v->start) * ss + pos % ss;
+			if (!memcmp (bytes, m->bytes, m->length))
+				return 1;
+			break;
+		}
+	}
+	return 0;
+}
+
 /**
  * Attempt to detect a file system in region \p geom.
  * This function tries to be clever at dealing with ambiguous
  * situations, such as when one file system was not completely erased before a
  * new file system was created on top of it.
  *
+ * The sectors where the registered types keep their magic are read
+ * first, in one batch, and only the types whose magic is there are
+ * probed.
+ *
  * \return a new PedFileSystem on success, \c NULL on failure
  */
 PedFileSystemType*
@@ -261,6 +880,8 @@ ped_file_system_probe (PedGeometry* geom)
 	int			detected_error[32];
 	int			detected_count = 0;
 	PedFileSystemType*	walk = NULL;
+	ProbeMagics		pm;
+	int			have_magics;
 
 	PED_ASSERT (geom != NULL);
 
@@ -268,9 +889,14 @@ ped_file_system_probe (PedGeometry* geom)
 		return NULL;
 
 	ped_exception_fetch_all ();
+	have_magics = _probe_read_magics (geom, &pm);
+	if (!have_magics)
+		ped_exception_catch ();
 	while ( (walk = ped_file_system_type_get_next (walk)) ) {
 		PedGeometry*	probed;
 
+		if (have_magics && !_probe_magic_found (walk, geom, &pm))
+			continue;
 		probed = ped_file_system_probe_specific (walk, geom);
 		if (probed) {
 			detected [detected_count] = walk;
@@ -283,6 +909,10 @@ ped_file_system_probe (PedGeometry* geom)
 		}
 	}
 	ped_exception_leave_all ();
+	if (have_magics) {
+		free (pm.iov);
+		free (pm.buf);
+	}
 
 	ped_device_close (geom->dev);
 
@@ -169,50 +169,127 @@ _amufs5_probe (PedGeometry* geom) {
 	return _generic_affs_probe (geom, 0x6d754605);
 }
 
+/* the boot block starts with the DOS type */
+static const PedFileSystemMagic _affs0_magic[] = {
+	{ 0, 0, 4, "\x44\x4f\x53\x00" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _affs1_magic[] = {
+	{ 0, 0, 4, "\x44\x4f\x53\x01" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _affs2_magic[] = {
+	{ 0, 0, 4, "\x44\x4f\x53\x02" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _affs3_magic[] = {
+	{ 0, 0, 4, "\x44\x4f\x53\x03" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _affs4_magic[] = {
+	{ 0, 0, 4, "\x44\x4f\x53\x04" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _affs5_magic[] = {
+	{ 0, 0, 4, "\x44\x4f\x53\x05" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _affs6_magic[] = {
+	{ 0, 0, 4, "\x44\x4f\x53\x06" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _affs7_magic[] = {
+	{ 0, 0, 4, "\x44\x4f\x53\x07" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _amufs_magic[] = {
+	{ 0, 0, 4, "\x6d\x75\x46\x53" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _amufs0_magic[] = {
+	{ 0, 0, 4, "\x6d\x75\x46\x00" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _amufs1_magic[] = {
+	{ 0, 0, 4, "\x6d\x75\x46\x01" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _amufs2_magic[] = {
+	{ 0, 0, 4, "\x6d\x75\x46\x02" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _amufs3_magic[] = {
+	{ 0, 0, 4, "\x6d\x75\x46\x03" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _amufs4_magic[] = {
+	{ 0, 0, 4, "\x6d\x75\x46\x04" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _amufs5_magic[] = {
+	{ 0, 0, 4, "\x6d\x75\x46\x05" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps _affs0_ops = {
 	probe:		_affs0_probe,
+	magic:		_affs0_magic,
 };
 static PedFileSystemOps _affs1_ops = {
 	probe:		_affs1_probe,
+	magic:		_affs1_magic,
 };
 static PedFileSystemOps _affs2_ops = {
 	probe:		_affs2_probe,
+	magic:		_affs2_magic,
 };
 static PedFileSystemOps _affs3_ops = {
 	probe:		_affs3_probe,
+	magic:		_affs3_magic,
 };
 static PedFileSystemOps _affs4_ops = {
 	probe:		_affs4_probe,
+	magic:		_affs4_magic,
 };
 static PedFileSystemOps _affs5_ops = {
 	probe:		_affs5_probe,
+	magic:		_affs5_magic,
 };
 static PedFileSystemOps _affs6_ops = {
 	probe:		_affs6_probe,
+	magic:		_affs6_magic,
 };
 static PedFileSystemOps _affs7_ops = {
 	probe:		_affs7_probe,
+	magic:		_affs7_magic,
 };
 static PedFileSystemOps _amufs_ops = {
 	probe:		_amufs_probe,
+	magic:		_amufs_magic,
 };
 static PedFileSystemOps _amufs0_ops = {
 	probe:		_amufs0_probe,
+	magic:		_amufs0_magic,
 };
 static PedFileSystemOps _amufs1_ops = {
 	probe:		_amufs1_probe,
+	magic:		_amufs1_magic,
 };
 static PedFileSystemOps _amufs2_ops = {
 	probe:		_amufs2_probe,
+	magic:		_amufs2_magic,
 };
 static PedFileSystemOps _amufs3_ops = {
 	probe:		_amufs3_probe,
+	magic:		_amufs3_magic,
 };
 static PedFileSystemOps _amufs4_ops = {
 	probe:		_amufs4_probe,
+	magic:		_amufs4_magic,
 };
 static PedFileSystemOps _amufs5_ops = {
 	probe:		_amufs5_probe,
+	magic:		_amufs5_magic,
 };
 
 PedFileSystemType _affs0_type = {
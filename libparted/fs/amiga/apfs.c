@@ -109,11 +109,23 @@ _apfs2_probe (PedGeometry* geom) {
 	return _generic_apfs_probe (geom, 0x50463102);
 }
 
+/* the boot block starts with the DOS type */
+static const PedFileSystemMagic _apfs1_magic[] = {
+	{ 0, 0, 4, "PF1\x01" },
+	{ 0, 0, 0, NULL }
+};
+static const PedFileSystemMagic _apfs2_magic[] = {
+	{ 0, 0, 4, "PF1\x02" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps _apfs1_ops = {
 	probe:		_apfs1_probe,
+	magic:		_apfs1_magic,
 };
 static PedFileSystemOps _apfs2_ops = {
 	probe:		_apfs2_probe,
+	magic:		_apfs2_magic,
 };
 
 PedFileSystemType _apfs1_type = {
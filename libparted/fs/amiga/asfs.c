@@ -119,8 +119,15 @@ error_part:
 	return NULL;
 }
 
+/* the root block, at the start, begins with its id */
+static const PedFileSystemMagic _asfs_magic[] = {
+	{ 0, 0, 4, "SFS\x00" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps _asfs_ops = {
 	probe:		_asfs_probe,
+	magic:		_asfs_magic,
 };
 
 PedFileSystemType _asfs_type = {
@@ -54,8 +54,17 @@ btrfs_probe (PedGeometry* geom)
         return NULL;
 }
 
+/* the magic of the superblock 64KiB in, after its csum, fsid, bytenr
+   and flags */
+static const PedFileSystemMagic btrfs_magic[] = {
+        { 0, 64 * 1024 + BTRFS_CSUM_SIZE + BTRFS_FSID_SIZE + 16, 8,
+          "_BHRfS_M" },
+        { 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps btrfs_ops = {
         probe:          btrfs_probe,
+        magic:          btrfs_magic,
 };
 
 static PedFileSystemType btrfs_type = {
@@ -115,16 +115,25 @@ _ext4_probe (PedGeometry* geom)
 	return _ext2_generic_probe (geom, 4);
 }
 
+/* s_magic, in the superblock 1024 bytes in */
+static const PedFileSystemMagic _ext2_magic[] = {
+	{ 0, 1080, 2, "\x53\xef" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps _ext2_ops = {
 	probe:		_ext2_probe,
+	magic:		_ext2_magic,
 };
 
 static PedFileSystemOps _ext3_ops = {
 	probe:		_ext3_probe,
+	magic:		_ext2_magic,
 };
 
 static PedFileSystemOps _ext4_ops = {
 	probe:		_ext4_probe,
+	magic:		_ext2_magic,
 };
 
 static PedFileSystemType _ext2_type = {
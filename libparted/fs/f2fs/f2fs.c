@@ -37,8 +37,15 @@ f2fs_probe (PedGeometry* geom)
         return NULL;
 }
 
+static const PedFileSystemMagic f2fs_magic[] = {
+        { F2FS_SB_OFFSET, offsetof (struct f2fs_super_block, magic), 4,
+          "\x10\x20\xf5\xf2" },
+        { 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps f2fs_ops = {
         probe:          f2fs_probe,
+        magic:          f2fs_magic,
 };
 
 static PedFileSystemType f2fs_type = {
@@ -121,12 +121,20 @@ fat_probe_fat32 (PedGeometry* geom)
 	return NULL;
 }
 
+/* the boot sector signature */
+static const PedFileSystemMagic fat_magic[] = {
+	{ 0, 510, 2, "\x55\xaa" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps fat16_ops = {
 	probe:		fat_probe_fat16,
+	magic:		fat_magic,
 };
 
 static PedFileSystemOps fat32_ops = {
 	probe:		fat_probe_fat32,
+	magic:		fat_magic,
 };
 
 PedFileSystemType fat16_type = {
@@ -44,16 +44,37 @@ uint8_t* hfsp_block = NULL;
 unsigned hfs_block_count;
 unsigned hfsp_block_count;
 
+/* The signature of the HFS master directory block, or of the HFS+ volume
+   header, either of which may wrap an HFS+ volume.  */
+static const PedFileSystemMagic hfs_magic[] = {
+	{ 0, 1024, 2, "BD" },
+	{ 0, 0, 0, NULL }
+};
+
+static const PedFileSystemMagic hfsplus_magic[] = {
+	{ 0, 1024, 2, "BD" },
+	{ 2, 0, 2, "H+" },
+	{ 0, 0, 0, NULL }
+};
+
+static const PedFileSystemMagic hfsx_magic[] = {
+	{ 2, 0, 2, "HX" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps hfs_ops = {
 	probe:		hfs_probe,
+	magic:		hfs_magic,
 };
 
 static PedFileSystemOps hfsplus_ops = {
 	probe:		hfsplus_probe,
+	magic:		hfsplus_magic,
 };
 
 static PedFileSystemOps hfsx_ops = {
 	probe:		hfsx_probe,
+	magic:		hfsx_magic,
 };
 
 
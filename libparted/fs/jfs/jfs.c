@@ -57,8 +57,15 @@ jfs_probe (PedGeometry* geom)
 	}
 }
 
+static const PedFileSystemMagic jfs_magic[] = {
+	{ 0, JFS_SUPER_OFFSET + offsetof (struct superblock, s_magic), 4,
+	  JFS_MAGIC },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps jfs_ops = {
 	probe:		jfs_probe,
+	magic:		jfs_magic,
 };
 
 static PedFileSystemType jfs_type = {
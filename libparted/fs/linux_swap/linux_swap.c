@@ -341,16 +341,36 @@ _swap_swsusp_probe (PedGeometry* geom) {
         return _generic_swap_probe (geom, -1);
 }
 
+/* The signatures end the first page; ped_file_system_linux_swap_init
+   sets their offsets to the page size less 10.  */
+static PedFileSystemMagic _swap_v0_magic[] = {
+	{ 0, 0, 10, "SWAP-SPACE" },
+	{ 0, 0, 0, NULL }
+};
+
+static PedFileSystemMagic _swap_v1_magic[] = {
+	{ 0, 0, 10, "SWAPSPACE2" },
+	{ 0, 0, 0, NULL }
+};
+
+static PedFileSystemMagic _swap_swsusp_magic[] = {
+	{ 0, 0, 9, "S1SUSPEND" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps _swap_v0_ops = {
 	probe:		_swap_v0_probe,
+	magic:		_swap_v0_magic,
 };
 
 static PedFileSystemOps _swap_v1_ops = {
 	probe:		_swap_v1_probe,
+	magic:		_swap_v1_magic,
 };
 
 static PedFileSystemOps _swap_swsusp_ops = {
   probe:		_swap_swsusp_probe,
+  magic:		_swap_swsusp_magic,
 };
 
 static PedFileSystemType _swap_v0_type = {
@@ -374,6 +394,10 @@ static PedFileSystemType _swap_swsusp_type = {
 void
 ped_file_system_linux_swap_init ()
 {
+	_swap_v0_magic[0].offset = getpagesize () - 10;
+	_swap_v1_magic[0].offset = getpagesize () - 10;
+	_swap_swsusp_magic[0].offset = getpagesize () - 10;
+
 	ped_file_system_type_register (&_swap_v0_type);
 	ped_file_system_type_register (&_swap_v1_type);
 	ped_file_system_type_register (&_swap_swsusp_type);
@@ -133,8 +133,15 @@ nilfs2_probe (PedGeometry* geom)
 	return ped_geometry_new(geom->dev, geom->start, length);
 }
 
+static const PedFileSystemMagic nilfs2_magic[] = {
+	{ 0, 1024 + offsetof (struct nilfs2_super_block, s_magic), 2,
+	  "\x34\x34" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps nilfs2_ops = {
 	probe:			nilfs2_probe,
+	magic:			nilfs2_magic,
 };
 
 static PedFileSystemType nilfs2_type = {
@@ -50,8 +50,14 @@ ntfs_probe (PedGeometry* geom)
 	return newg;
 }
 
+static const PedFileSystemMagic ntfs_magic[] = {
+	{ 0, 3, 4, NTFS_SIGNATURE },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps ntfs_ops = {
 	probe:		ntfs_probe,
+	magic:		ntfs_magic,
 };
 
 static PedFileSystemType ntfs_type = {
@@ -19,11 +19,167 @@
 
 #include <config.h>
 #include <string.h>
+#include <unistd.h>
+#if PED_THREADS
+#  include <pthread.h>
+#endif
 
 #include "fat.h"
 
 #ifndef DISCOVER_ONLY
 
+/* fat_duplicate_clusters() copies the fragments that need duplicating a
+ * batch at a time, each batch covering buffer_frags fragments of the old
+ * file system.  The runs of fragments to copy in a batch are read with a
+ * single ped_device_read_batch(), which reads nearby runs together.  They
+ * are written a group of new locations at a time, with a single
+ * ped_device_write_batch() of just the fragments that move.  There are
+ * two batches: while one is written, a thread reads the next one into the
+ * other, from a device of its own.
+ */
+
+/* The largest batch, in sectors.  */
+#define COPY_BUFFER_MAX		16384
+
+typedef struct _FatCopyEngine	FatCopyEngine;
+
+typedef struct {
+	FatCopyEngine*	engine;
+	FatFragment	offset;
+	FatFragment*	map;		/* 1 for the fragments to copy, or -1 */
+	char*		buffer;
+	PedIoVec*	iov;		/* the runs of fragments to read */
+	int		n_iov;
+	int		read_ok;
+#if PED_THREADS
+	pthread_t	thread;
+	int		started;
+#endif
+} FatCopyBatch;
+
+struct _FatCopyEngine {
+	FatOpContext*	ctx;
+	FatCopyBatch	batches [2];
+	FatCopyBatch*	batch;		/* the one being written */
+	PedDevice*	read_dev;	/* for the thread, or NULL */
+	char*		write_buffer;
+	PedIoVec*	write_iov;
+};
+
+static PedSector _GL_ATTRIBUTE_CONST
+lcm (PedSector a, PedSector b)
+{
+	return a / ped_greatest_common_divisor (a, b) * b;
+}
+
+/* Returns how many sectors a batch covers: COPY_BUFFER_MAX, or less if
+ * free memory is short, but no less than BUFFER_SIZE, rounded up to whole
+ * fragments, physical sectors and optimal I/O units of the device.
+ */
+static PedSector
+copy_buffer_sectors (const FatOpContext* ctx)
+{
+	PedDevice*	dev = ctx->old_fs->geom->dev;
+	PedSector	unit = ctx->frag_sectors;
+	PedSector	sectors = COPY_BUFFER_MAX;
+	PedAlignment*	align;
+#ifdef _SC_AVPHYS_PAGES
+	long		pages = sysconf (_SC_AVPHYS_PAGES);
+	long		page_size = sysconf (_SC_PAGESIZE);
+
+	/* the three buffers take at most 1/16 of it */
+	if (pages > 0 && page_size >= 512)
+		sectors = PED_MIN (sectors,
+				   (PedSector) pages * (page_size / 512) / 48);
+#endif
+
+	if (dev->phys_sector_size > 512)
+		unit = lcm (unit, dev->phys_sector_size / 512);
+	align = ped_device_get_optimum_alignment (dev);
+	if (align) {
+		if (align->grain_size > 0
+		    && lcm (unit, align->grain_size) <= COPY_BUFFER_MAX)
+			unit = lcm (unit, align->grain_size);
+		ped_alignment_destroy (align);
+	}
+
+	sectors = PED_MAX (sectors, BUFFER_SIZE);
+	return ped_div_round_up (sectors, unit) * unit;
+}
+
+static void
+copy_engine_destroy (FatCopyEngine* engine)
+{
+	int	i;
+
+	for (i = 0; i < 2; i++) {
+		FatCopyBatch*	batch = &engine->batches [i];
+
+#if PED_THREADS
+		if (batch->started)
+			pthread_join (batch->thread, NULL);
+#endif
+		free (batch->map);
+		free (batch->buffer);
+		free (batch->iov);
+	}
+	if (engine->read_dev)
+		ped_device_destroy (engine->read_dev);
+	free (engine->write_buffer);
+	free (engine->write_iov);
+	free (engine);
+}
+
+static FatCopyEngine*
+copy_engine_new (FatOpContext* ctx)
+{
+	FatCopyEngine*	engine;
+	PedSector	sectors = copy_buffer_sectors (ctx);
+	int		i;
+
+	engine = ped_calloc (sizeof (FatCopyEngine));
+	if (!engine)
+		return NULL;
+	engine->ctx = ctx;
+	ctx->buffer_frags = sectors / ctx->frag_sectors;
+
+	for (i = 0; i < 2; i++) {
+		FatCopyBatch*	batch = &engine->batches [i];
+
+		batch->engine = engine;
+		batch->map = ped_malloc (ctx->buffer_frags
+					 * sizeof (FatFragment));
+		batch->buffer = ped_malloc (sectors * 512);
+		batch->iov = ped_malloc (ctx->buffer_frags * sizeof (PedIoVec));
+		if (!batch->map || !batch->buffer || !batch->iov)
+			goto error;
+	}
+	engine->write_buffer = ped_malloc (sectors * 512);
+	engine->write_iov = ped_malloc (ctx->buffer_frags * sizeof (PedIoVec));
+	if (!engine->write_buffer || !engine->write_iov)
+		goto error;
+
+#if PED_THREADS
+	/* Opening a device may ask questions, so do it here, not in the
+	 * thread.  Without a device of its own, batches are read in turn.
+	 */
+	ped_exception_fetch_all ();
+	engine->read_dev = ped_device_dup (ctx->old_fs->geom->dev);
+	if (engine->read_dev && !ped_device_open (engine->read_dev)) {
+		ped_device_destroy (engine->read_dev);
+		engine->read_dev = NULL;
+	}
+	ped_exception_catch ();
+	ped_exception_leave_all ();
+#endif
+
+	return engine;
+
+error:
+	copy_engine_destroy (engine);
+	return NULL;
+}
+
 static int
 needs_duplicating (const FatOpContext* ctx, FatFragment frag)
 {
@@ -63,185 +219,171 @@ search_next_fragment (FatOpContext* ctx)
 	return 0;	/* all done! */
 }
 
-static int
-read_marked_fragments (FatOpContext* ctx, FatFragment length)
+/* Marks the fragments that need duplicating among the buffer_frags from
+ * <offset> in the map of <batch>, and lists the runs of them to read.
+ */
+static void
+plan_batch (FatCopyBatch* batch, FatFragment offset)
 {
-	FatSpecific*		fs_info = FAT_SPECIFIC (ctx->old_fs);
-	int			status;
-	FatFragment		i;
-
-	ped_exception_fetch_all ();
-	status = fat_read_fragments (ctx->old_fs, fs_info->buffer,
-				     ctx->buffer_offset, length);
-	ped_exception_leave_all ();
-	if (status)
-		return 1;
+	FatOpContext*	ctx = batch->engine->ctx;
+	FatSpecific*	old_fs_info = FAT_SPECIFIC (ctx->old_fs);
+	PedIoVec*	run = NULL;
+	FatFragment	frag;
 
-	ped_exception_catch ();
+	batch->offset = offset;
+	batch->n_iov = 0;
+	for (frag = 0; frag < ctx->buffer_frags; frag++) {
+		if (offset + frag >= old_fs_info->frag_count
+		    || !needs_duplicating (ctx, offset + frag)) {
+			batch->map [frag] = -1;
+			run = NULL;
+			continue;
+		}
 
-/* something bad happened, so read fragments one by one.  (The error may
-   have occurred on an unused fragment: who cares) */
-	for (i = 0; i < length; i++) {
-		if (ctx->buffer_map [i]) {
-			if (!fat_read_fragment (ctx->old_fs,
-			      fs_info->buffer + i * fs_info->frag_size,
-			      ctx->buffer_offset + i))
-				return 0;
+		batch->map [frag] = 1;
+		if (run) {
+			run->count += old_fs_info->frag_sectors;
+		} else {
+			run = &batch->iov [batch->n_iov++];
+			fat_fragments_to_iovec (ctx->old_fs, run,
+				batch->buffer + frag * old_fs_info->frag_size,
+				offset + frag, 1);
 		}
 	}
-
-	return 1;
 }
 
+/* Reads the runs of <batch> from <dev> in one go, keeping quiet about
+ * errors.
+ */
 static int
-fetch_fragments (FatOpContext* ctx)
+read_batch_quick (FatCopyBatch* batch, PedDevice* dev)
 {
-	FatSpecific*	old_fs_info = FAT_SPECIFIC (ctx->old_fs);
-	FatFragment	fetch_length = 0;
-	FatFragment	frag;
-
-	for (frag = 0; frag < ctx->buffer_frags; frag++)
-		ctx->buffer_map [frag] = -1;
+	int	ok;
 
-	for (frag = 0;
-	     frag < ctx->buffer_frags
-		&& ctx->buffer_offset + frag < old_fs_info->frag_count;
-	     frag++) {
-		if (needs_duplicating (ctx, ctx->buffer_offset + frag)) {
-			ctx->buffer_map [frag] = 1;
-			fetch_length = frag + 1;
-		}
-	}
-
-	if (!read_marked_fragments (ctx, fetch_length))
-		return 0;
-
-	return 1;
+	ped_exception_fetch_all ();
+	ok = ped_device_read_batch (dev, batch->iov, batch->n_iov);
+	if (!ok)
+		ped_exception_catch ();
+	ped_exception_leave_all ();
+	return ok;
 }
 
-/*****************************************************************************
- * here starts the write code.  All assumes that ctx->buffer_map [first] and
- * ctx->buffer_map [last] are occupied by fragments that need to be duplicated.
- *****************************************************************************/
-
-/* finds the first fragment that is not going to get overwritten (that needs to
-   get read in) */
-static FatFragment _GL_ATTRIBUTE_PURE
-get_first_underlay (const FatOpContext* ctx, int first, int last)
+#if PED_THREADS
+static void*
+read_batch_worker (void* arg)
 {
-	int		old;
-	FatFragment	new;
+	FatCopyBatch*	batch = arg;
 
-	PED_ASSERT (first <= last);
-
-	new = ctx->buffer_map [first];
-	for (old = first + 1; old <= last; old++) {
-		if (ctx->buffer_map [old] == -1)
-			continue;
-		new++;
-		if (ctx->buffer_map [old] != new)
-			return new;
-	}
-	return -1;
+	batch->read_ok = read_batch_quick (batch, batch->engine->read_dev);
+	return NULL;
 }
+#endif
 
-/* finds the last fragment that is not going to get overwritten (that needs to
-   get read in) */
-static FatFragment _GL_ATTRIBUTE_PURE
-get_last_underlay (const FatOpContext* ctx, int first, int last)
+/* Starts reading <batch>: in a thread if the engine has a device for one,
+ * or else right away.
+ */
+static void
+start_read (FatCopyBatch* batch)
 {
-	int		old;
-	FatFragment	new;
-
-	PED_ASSERT (first <= last);
-
-	new = ctx->buffer_map [last];
-	for (old = last - 1; old >= first; old--) {
-		if (ctx->buffer_map [old] == -1)
-			continue;
-		new--;
-		if (ctx->buffer_map [old] != new)
-			return new;
-	}
-	return -1;
+	FatCopyEngine*	engine = batch->engine;
+
+#if PED_THREADS
+	batch->started = engine->read_dev
+			 && !pthread_create (&batch->thread, NULL,
+					     read_batch_worker, batch);
+	if (batch->started)
+		return;
+#endif
+	batch->read_ok = read_batch_quick (batch,
+					   engine->ctx->old_fs->geom->dev);
 }
 
-/* "underlay" refers to the "static" fragments, that remain unchanged.
- * when writing large chunks at a time, we don't want to clobber these,
- * so we read them in, and write them back again.  MUCH quicker that way.
+/* Waits for <batch> to be read.  If something bad happened, reads its
+ * fragments one by one, so that the error is reported for the right one.
+ * (The error may have occurred on an unused fragment: who cares)
  */
 static int
-quick_group_write_read_underlay (FatOpContext* ctx, int first, int last)
+finish_read (FatCopyBatch* batch)
 {
-	FatSpecific*	new_fs_info = FAT_SPECIFIC (ctx->new_fs);
-	FatFragment	first_underlay;
-	FatFragment	last_underlay;
-	FatFragment	underlay_length;
-
-	PED_ASSERT (first <= last);
+	FatOpContext*	ctx = batch->engine->ctx;
+	FatSpecific*	fs_info = FAT_SPECIFIC (ctx->old_fs);
+	FatFragment	i;
 
-	first_underlay = get_first_underlay (ctx, first, last);
-	if (first_underlay == -1)
+#if PED_THREADS
+	if (batch->started) {
+		pthread_join (batch->thread, NULL);
+		batch->started = 0;
+	}
+#endif
+	if (batch->read_ok)
 		return 1;
-	last_underlay = get_last_underlay (ctx, first, last);
-
-	PED_ASSERT (first_underlay <= last_underlay);
 
-	underlay_length = last_underlay - first_underlay + 1;
-	if (!fat_read_fragments (ctx->new_fs,
-				new_fs_info->buffer
-				   + (first_underlay - ctx->buffer_map [first])
-					* new_fs_info->frag_size,
-				first_underlay,
-				underlay_length))
-		return 0;
+	for (i = 0; i < ctx->buffer_frags; i++) {
+		if (batch->map [i] == -1)
+			continue;
+		if (!fat_read_fragment (ctx->old_fs,
+					batch->buffer + i * fs_info->frag_size,
+					batch->offset + i))
+			return 0;
+	}
 	return 1;
 }
 
+/*****************************************************************************
+ * here starts the write code.  All assumes that ctx->buffer_map [first] and
+ * ctx->buffer_map [last] are occupied by fragments that need to be duplicated.
+ *****************************************************************************/
+
 /* quick_group_write() makes no attempt to recover from errors - just
  * does things fast.  If there is an error, slow_group_write() is
  * called.
+ *    The fragments are laid out in the write buffer as they will be on
+ * disk, and each run of them with consecutive new locations is written
+ * in one go, all in one batch.  The fragments in between are left alone.
  *    Note: we do syncing writes, to make sure there isn't any
  * error writing out.  It's rather difficult recovering from errors
  * further on.
  */
 static int
-quick_group_write (FatOpContext* ctx, int first, int last)
+quick_group_write (FatCopyEngine* engine, int first, int last)
 {
-	FatSpecific*		old_fs_info = FAT_SPECIFIC (ctx->old_fs);
+	FatOpContext*		ctx = engine->ctx;
 	FatSpecific*		new_fs_info = FAT_SPECIFIC (ctx->new_fs);
-	int			active_length;
+	FatFragment*		map = ctx->buffer_map;
+	PedIoVec*		run = NULL;
+	int			n_runs = 0;
 	int			i;
-	int			offset;
+	int			ok;
+	char*			buf;
 
 	PED_ASSERT (first <= last);
 
-	ped_exception_fetch_all ();
-	if (!quick_group_write_read_underlay (ctx, first, last))
-		goto error;
-
 	for (i = first; i <= last; i++) {
-		if (ctx->buffer_map [i] == -1)
+		if (map [i] == -1)
 			continue;
 
-		offset = ctx->buffer_map [i] - ctx->buffer_map [first];
-		memcpy (new_fs_info->buffer + offset * new_fs_info->frag_size,
-			old_fs_info->buffer + i * new_fs_info->frag_size,
+		buf = engine->write_buffer
+		      + (map [i] - map [first]) * new_fs_info->frag_size;
+		memcpy (buf, engine->batch->buffer + i * new_fs_info->frag_size,
 			new_fs_info->frag_size);
-	}
 
-	active_length = ctx->buffer_map [last] - ctx->buffer_map [first] + 1;
-	if (!fat_write_sync_fragments (ctx->new_fs, new_fs_info->buffer,
-				       ctx->buffer_map [first], active_length))
-		goto error;
-
-	ped_exception_leave_all ();
-	return 1;
+		if (run && (char*) run->buffer + run->count * 512 == buf) {
+			run->count += new_fs_info->frag_sectors;
+		} else {
+			run = &engine->write_iov [n_runs++];
+			fat_fragments_to_iovec (ctx->new_fs, run, buf, map [i],
+						1);
+		}
+	}
 
-error:
-	ped_exception_catch ();
+	ped_exception_fetch_all ();
+	ok = ped_device_write_batch (ctx->new_fs->geom->dev, engine->write_iov,
+				     n_runs)
+	     && ped_geometry_sync (ctx->new_fs->geom);
+	if (!ok)
+		ped_exception_catch ();
 	ped_exception_leave_all ();
-	return 0;
+	return ok;
 }
 
 /* Writes fragments out, one at a time, avoiding errors on redundant writes
@@ -250,8 +392,9 @@ error:
  * is found.
  */
 static int
-slow_group_write (FatOpContext* ctx, int first, int last)
+slow_group_write (FatCopyEngine* engine, int first, int last)
 {
+	FatOpContext*		ctx = engine->ctx;
 	FatSpecific*		old_fs_info = FAT_SPECIFIC (ctx->old_fs);
 	FatSpecific*		new_fs_info = FAT_SPECIFIC (ctx->new_fs);
 	int			i;
@@ -263,7 +406,7 @@ slow_group_write (FatOpContext* ctx, int first, int last)
 			continue;
 
 		while (!fat_write_sync_fragment (ctx->new_fs,
-			      old_fs_info->buffer + i * old_fs_info->frag_size,
+			      engine->batch->buffer + i * old_fs_info->frag_size,
 			      ctx->buffer_map [i])) {
 			fat_table_set_bad (new_fs_info->fat,
 					   ctx->buffer_map [i]);
@@ -293,23 +436,24 @@ update_remap (FatOpContext* ctx, int first, int last)
 }
 
 static int
-group_write (FatOpContext* ctx, int first, int last)
+group_write (FatCopyEngine* engine, int first, int last)
 {
 	PED_ASSERT (first <= last);
 
-	if (!quick_group_write (ctx, first, last)) {
-		if (!slow_group_write (ctx, first, last))
+	if (!quick_group_write (engine, first, last)) {
+		if (!slow_group_write (engine, first, last))
 			return 0;
 	}
-	if (!update_remap (ctx, first, last))
+	if (!update_remap (engine->ctx, first, last))
 		return 0;
 	return 1;
 }
 
 /* assumes fragment size and new_fs's cluster size are equal */
 static int
-write_fragments (FatOpContext* ctx)
+write_fragments (FatCopyEngine* engine)
 {
+	FatOpContext*		ctx = engine->ctx;
 	FatSpecific*		old_fs_info = FAT_SPECIFIC (ctx->old_fs);
 	FatSpecific*		new_fs_info = FAT_SPECIFIC (ctx->new_fs);
 	int			group_start;
@@ -348,7 +492,7 @@ write_fragments (FatOpContext* ctx)
 			/* ran out of room in the buffer, so write this group,
 			 * and start a new one...
 			 */
-			if (!group_write (ctx, group_start, group_end))
+			if (!group_write (engine, group_start, group_end))
 				return 0;
 			group_start = group_end = i;
 		}
@@ -356,7 +500,7 @@ write_fragments (FatOpContext* ctx)
 
 	PED_ASSERT (group_start != -1);
 
-	if (!group_write (ctx, group_start, group_end))
+	if (!group_write (engine, group_start, group_end))
 		return 0;
 	return 1;
 }
@@ -396,6 +540,14 @@ int
 fat_duplicate_clusters (FatOpContext* ctx, PedTimer* timer)
 {
 	FatFragment	total_frags_to_dup;
+	FatCopyEngine*	engine;
+	FatCopyBatch*	batch;
+	FatCopyBatch*	next;
+	int		ok = 0;
+
+	engine = copy_engine_new (ctx);
+	if (!engine)
+		return 0;
 
 	init_remap (ctx);
 	total_frags_to_dup = count_frags_to_dup (ctx);
@@ -405,19 +557,44 @@ fat_duplicate_clusters (FatOpContext* ctx, PedTimer* timer)
 
 	ctx->buffer_offset = 0;
 	ctx->frags_duped = 0;
-	while (search_next_fragment (ctx)) {
+	batch = NULL;
+	if (search_next_fragment (ctx)) {
+		batch = &engine->batches [0];
+		plan_batch (batch, ctx->buffer_offset);
+		start_read (batch);
+	}
+
+	while (batch) {
 		ped_timer_update (
 			timer, 1.0 * ctx->frags_duped / total_frags_to_dup);
 
-		if (!fetch_fragments (ctx))
-			return 0;
-		if (!write_fragments (ctx))
-			return 0;
-		ctx->buffer_offset += ctx->buffer_frags;
+		if (!finish_read (batch))
+			goto error;
+
+		/* the next batch is read while this one is written */
+		next = NULL;
+		ctx->buffer_offset = batch->offset + ctx->buffer_frags;
+		if (search_next_fragment (ctx)) {
+			next = &engine->batches [batch == engine->batches];
+			plan_batch (next, ctx->buffer_offset);
+			start_read (next);
+		}
+
+		engine->batch = batch;
+		ctx->buffer_offset = batch->offset;
+		ctx->buffer_map = batch->map;
+		if (!write_fragments (engine))
+			goto error;
+		batch = next;
 	}
 
 	ped_timer_update (timer, 1.0);
-	return 1;
+	ok = 1;
+
+error:
+	ctx->buffer_map = NULL;
+	copy_engine_destroy (engine);
+	return ok;
 }
 
 #endif /* !DISCOVER_ONLY */
@@ -90,26 +90,24 @@ fat_op_context_new (PedFileSystem* new_fs, PedFileSystem* old_fs)
 	if (!fat_set_frag_sectors (old_fs, ctx->frag_sectors))
 		goto error;
 
-	ctx->buffer_frags = old_fs_info->buffer_sectors / ctx->frag_sectors;
-	ctx->buffer_map = (FatFragment*) ped_malloc (sizeof (FatFragment)
-						     * ctx->buffer_frags);
-	if (!ctx->buffer_map)
-		goto error_free_ctx;
+	/* set up by fat_duplicate_clusters() */
+	ctx->buffer_frags = 0;
+	ctx->buffer_map = NULL;
 
 	ctx->remap = (FatFragment*) ped_malloc (sizeof (FatFragment)
 						   * old_fs_info->frag_count);
 	if (!ctx->remap)
-		goto error_free_buffer_map;
+		goto error_free_ctx;
 
 	ctx->new_fs = new_fs;
 	ctx->old_fs = old_fs;
 	if (!calc_deltas (ctx))
-		goto error_free_buffer_map;
+		goto error_free_remap;
 
 	return ctx;
 
-error_free_buffer_map:
-	free (ctx->buffer_map);
+error_free_remap:
+	free (ctx->remap);
 error_free_ctx:
 	free (ctx);
 error:
@@ -119,7 +117,6 @@ error:
 void
 fat_op_context_destroy (FatOpContext* ctx)
 {
-	free (ctx->buffer_map);
 	free (ctx->remap);
 	free (ctx);
 }
@@ -63,9 +63,40 @@ remainder_round_up (PedSector a, PedSector b)
 	return result;
 }
 
+/*
+    marks the <count> clusters from <start>, a run of the chain for
+    <chain_name>, as fully used by "flag".
+*/
+static int
+flag_run (PedFileSystem* fs, const char* chain_name, FatCluster start,
+	  FatCluster count, FatClusterFlag flag)
+{
+	FatSpecific*	fs_info = FAT_SPECIFIC (fs);
+	FatCluster	clst;
+
+	for (clst = start; clst < start + count; clst++) {
+		if (fs_info->cluster_info [clst].flag != FAT_FLAG_FREE ) {
+			ped_exception_throw (PED_EXCEPTION_FATAL,
+				PED_EXCEPTION_CANCEL,
+				_("Bad FAT: cluster %d is cross-linked for "
+				  "%s.  You should run dosfsck or scandisk."),
+				(int) clst, chain_name);
+			return 0;
+		}
+
+		fs_info->cluster_info [clst].flag = flag;
+		fs_info->cluster_info [clst].units_used = 0;	/* 0 == 64 */
+	}
+
+	if (flag == FAT_FLAG_DIRECTORY)
+		fs_info->total_dir_clusters += count;
+	return 1;
+}
+
 /*
     traverse the FAT for a file/directory, marking each entry's flag
-    to "flag".
+    to "flag".  Clusters that follow each other are taken a run at a time,
+    so a contiguous file costs a single walk over its FAT entries.
 */
 static int
 flag_traverse_fat (PedFileSystem* fs, const char* chain_name, FatCluster start,
@@ -74,10 +105,14 @@ flag_traverse_fat (PedFileSystem* fs, const char* chain_name, FatCluster start,
 	FatSpecific*	fs_info = FAT_SPECIFIC (fs);
 	FatCluster	clst;
 	FatCluster	prev_clst;
+	FatCluster	next_clst;
+	FatCluster	run_length;
 	int		last_cluster_usage;
 	FatCluster	chain_length = 0;
 
 	if (fat_table_is_eof (fs_info->fat, start)) {
+		if (fat_table_failed (fs_info->fat))
+			return 0;
 		if (ped_exception_throw (
 			PED_EXCEPTION_ERROR,
 			PED_EXCEPTION_IGNORE_CANCEL,
@@ -89,8 +124,7 @@ flag_traverse_fat (PedFileSystem* fs, const char* chain_name, FatCluster start,
 	}
 
 	for (prev_clst = clst = start; !fat_table_is_eof (fs_info->fat, clst);
-	     prev_clst = clst, clst = fat_table_get (fs_info->fat, clst)) {
-		chain_length++;
+	     clst = next_clst) {
 		if (!clst) {
 			ped_exception_throw (PED_EXCEPTION_FATAL,
 				PED_EXCEPTION_CANCEL,
@@ -110,21 +144,15 @@ flag_traverse_fat (PedFileSystem* fs, const char* chain_name, FatCluster start,
 			return 0;
 		}
 
-		if (fs_info->cluster_info [clst].flag != FAT_FLAG_FREE ) {
-			ped_exception_throw (PED_EXCEPTION_FATAL,
-				PED_EXCEPTION_CANCEL,
-				_("Bad FAT: cluster %d is cross-linked for "
-				  "%s.  You should run dosfsck or scandisk."),
-				(int) clst, chain_name);
+		run_length = fat_table_get_run (fs_info->fat, clst, &next_clst);
+		if (!flag_run (fs, chain_name, clst, run_length, flag))
 			return 0;
-		}
-
-		if (flag == FAT_FLAG_DIRECTORY)
-			fs_info->total_dir_clusters++;
-
-		fs_info->cluster_info [clst].flag = flag;
-		fs_info->cluster_info [clst].units_used = 0;	/* 0 == 64 */
+		chain_length += run_length;
+		prev_clst = clst + run_length - 1;
 	}
+	/* the chain ended early if the FAT couldn't be loaded */
+	if (fat_table_failed (fs_info->fat))
+		return 0;
 
 	if (size
 	    && chain_length
@@ -216,6 +244,9 @@ _mark_bad_clusters (PedFileSystem* fs)
 	FatSpecific*	fs_info = FAT_SPECIFIC (fs);
 	FatCluster	cluster;
 
+	if (!fs_info->fat->bad_cluster_count)
+		return;
+
 	for (cluster = 2; cluster < fs_info->cluster_count + 2; cluster++) {
 		if (fat_table_is_bad (fs_info->fat, cluster))
 			fs_info->cluster_info [cluster].flag = FAT_FLAG_BAD;
@@ -252,7 +283,7 @@ fat_collect_cluster_info (PedFileSystem* fs) {
 	}
 
 	_mark_bad_clusters (fs);
-	return 1;
+	return !fat_table_failed (fs_info->fat);
 }
 
 FatClusterFlag _GL_ATTRIBUTE_PURE
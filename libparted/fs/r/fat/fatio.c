@@ -44,6 +44,22 @@ fat_read_fragments (PedFileSystem* fs, char* buf, FatFragment frag,
 	return ped_geometry_read (fs->geom, buf, sector, sector_count);
 }
 
+/* Sets *iov to the \p count fragments from \p frag, read into or written
+ * from \p buf, for ped_device_read_batch() and ped_device_write_batch().
+ */
+void
+fat_fragments_to_iovec (const PedFileSystem* fs, PedIoVec* iov, char* buf,
+			FatFragment frag, FatFragment count)
+{
+	FatSpecific*	fs_info = FAT_SPECIFIC (fs);
+
+	PED_ASSERT (frag >= 0 && frag + count <= fs_info->frag_count);
+
+	iov->buffer = buf;
+	iov->start = fs->geom->start + fat_frag_to_sector (fs, frag);
+	iov->count = count * fs_info->frag_sectors;
+}
+
 int
 fat_read_fragment (PedFileSystem* fs, char* buf, FatFragment frag)
 {
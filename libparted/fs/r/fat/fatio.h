@@ -29,6 +29,10 @@ extern int fat_write_fragments (PedFileSystem* fs, char* buf, FatFragment frag,
 extern int fat_write_sync_fragments (PedFileSystem* fs, char* buf,
 				     FatFragment frag, FatFragment count);
 
+extern void fat_fragments_to_iovec (const PedFileSystem* fs, PedIoVec* iov,
+				    char* buf, FatFragment frag,
+				    FatFragment count);
+
 extern int fat_read_fragment (PedFileSystem* fs, char* buf, FatFragment frag);
 extern int fat_write_fragment (PedFileSystem* fs, char* buf, FatFragment frag);
 extern int fat_write_sync_fragment (PedFileSystem* fs, char* buf,
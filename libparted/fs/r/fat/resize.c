@@ -227,6 +227,8 @@ alloc_root_dir (FatOpContext* ctx)
 	FatCluster		i;
 	FatCluster		cluster;
 	FatCluster		cluster_count;
+	FatCluster		run;
+	FatCluster		last_alloc;
 
 	PED_ASSERT (new_fs_info->fat_type == FAT_TYPE_FAT32);
 
@@ -234,9 +236,28 @@ alloc_root_dir (FatOpContext* ctx)
 			   PED_MAX (16, old_fs_info->root_dir_sector_count),
 			   new_fs_info->cluster_sectors);
 
+	/* Keep the root directory in one piece, if there is room for it and
+	 * all of it can be read.  Otherwise, mark what can't be read as bad,
+	 * and allocate it a cluster at a time from where the run was looked
+	 * for.
+	 */
+	last_alloc = new_fs_info->fat->last_alloc;
+	run = fat_table_alloc_run (new_fs_info->fat, cluster_count);
+	for (i = 0; run && i < cluster_count; i++) {
+		if (fat_read_cluster (ctx->new_fs, new_fs_info->buffer,
+				      run + i))
+			continue;
+		fat_table_set_bad (new_fs_info->fat, run + i);
+		new_fs_info->fat->last_alloc = last_alloc;
+		run = 0;
+	}
+
 	for (i = 0; i < cluster_count; i++) {
-		cluster = fat_table_alloc_check_cluster (new_fs_info->fat,
-							 ctx->new_fs);
+		if (run)
+			cluster = run + i;
+		else
+			cluster = fat_table_alloc_check_cluster (
+					new_fs_info->fat, ctx->new_fs);
 		if (!cluster)
 			return 0;
 		ctx->new_root_dir [i] = cluster;
@@ -821,6 +842,16 @@ _copy_hidden_sectors (FatOpContext* ctx)
 	return 1;
 }
 
+/* Returns 0 if the old or the new FAT of \p ctx could not be loaded at
+ * some point, after which nothing built from them may be written.
+ */
+static int
+tables_ok (const FatOpContext* ctx)
+{
+	return !fat_table_failed (FAT_SPECIFIC (ctx->old_fs)->fat)
+	       && !fat_table_failed (FAT_SPECIFIC (ctx->new_fs)->fat);
+}
+
 int
 fat_resize (PedFileSystem* fs, PedGeometry* geom, PedTimer* timer)
 {
@@ -835,21 +866,21 @@ fat_resize (PedFileSystem* fs, PedGeometry* geom, PedTimer* timer)
 	new_fs = ctx->new_fs;
 	new_fs_info = FAT_SPECIFIC (new_fs);
 
-	if (!fat_duplicate_clusters (ctx, timer))
+	if (!fat_duplicate_clusters (ctx, timer) || !tables_ok (ctx))
 		goto error_abort_ctx;
 	if (fs_info->fat_type == FAT_TYPE_FAT16
 			&& new_fs_info->fat_type == FAT_TYPE_FAT32) {
-		if (!alloc_root_dir (ctx))
+		if (!alloc_root_dir (ctx) || !tables_ok (ctx))
 			goto error_abort_ctx;
 	}
-	if (!fat_construct_new_fat (ctx))
+	if (!fat_construct_new_fat (ctx) || !tables_ok (ctx))
 		goto error_abort_ctx;
 	if (fs_info->fat_type == FAT_TYPE_FAT32
 			&& new_fs_info->fat_type == FAT_TYPE_FAT16) {
-		if (!free_root_dir (ctx))
+		if (!free_root_dir (ctx) || !tables_ok (ctx))
 			goto error_abort_ctx;
 	}
-	if (!fat_construct_dir_tree (ctx))
+	if (!fat_construct_dir_tree (ctx) || !tables_ok (ctx))
 		goto error_abort_ctx;
 	if (!fat_table_write_all (new_fs_info->fat, new_fs))
 		goto error_abort_ctx;
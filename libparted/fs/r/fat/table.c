@@ -20,14 +20,459 @@
 #include <config.h>
 #include <parted/endian.h>
 #include "fat.h"
+#include "tablescan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #ifndef DISCOVER_ONLY
 
+/* A FAT16 or FAT32 table bigger than PARTED_FAT_TABLE_MEMORY bytes is not
+ * held in memory whole.  It is split into windows of WINDOW_SIZE bytes,
+ * and only as many as fit in that budget are loaded at a time, each in a
+ * slot.  To load another, the least recently used window is dropped,
+ * after being written to a temporary file if it was changed.  A window
+ * that was never written there is all zeros.  Room for the whole table is
+ * reserved in the file up front, so running out of space fails creating
+ * the table rather than using it.
+ *
+ * The file is made in $TMPDIR, or in /var/tmp if that is not set, rather
+ * than in /tmp, which is often a tmpfs: reserving the table there would
+ * take as much memory as not windowing it at all.  The budget only
+ * holds if $TMPDIR is not a tmpfs either.
+ */
+#define WINDOW_SIZE	65536
+#define NO_WINDOW	((FatCluster) -1)
+
+typedef struct {
+	FatCluster	window;		/* or NO_WINDOW */
+	int		dirty;
+	uint64_t	used;
+	char*		data;
+} FatWindowSlot;
+
+struct _FatTableWindows {
+	int		fd;		/* of the temporary file */
+	FatCluster	window_count;
+	int*		slot_of;	/* per window, its slot, or -1 */
+	unsigned char*	stored;		/* per window, whether it is in file */
+
+	int		slot_count;
+	FatWindowSlot*	slots;
+	char*		data;
+	uint64_t	clock;
+	int		failed;		/* a window couldn't be written or read */
+};
+
+/* Returns the memory budget of a FAT table from PARTED_FAT_TABLE_MEMORY,
+ * a number of bytes with an optional K, M or G suffix, or 0 if there is
+ * none.
+ */
+static unsigned long long
+_memory_budget (void)
+{
+	static const char	units[] = "KkMmGg";
+	const char*		str = getenv ("PARTED_FAT_TABLE_MEMORY");
+	const char*		unit;
+	char*			end;
+	unsigned long long	budget;
+
+	if (!str || !*str)
+		return 0;
+
+	errno = 0;
+	budget = strtoull (str, &end, 10);
+	if (errno || end == str)
+		return 0;
+	if (*end) {
+		unit = strchr (units, *end);
+		if (!unit || end [1])
+			return 0;
+		budget <<= 10 * ((unit - units) / 2 + 1);
+	}
+	return budget;
+}
+
+static void
+_windows_reset (FatTableWindows* w)
+{
+	int	i;
+
+	for (i = 0; i < w->slot_count; i++) {
+		w->slots [i].window = NO_WINDOW;
+		w->slots [i].dirty = 0;
+		w->slots [i].used = 0;
+	}
+	memset (w->slot_of, 0xff, w->window_count * sizeof (int));
+	memset (w->stored, 0, w->window_count);
+	w->clock = 0;
+}
+
+static void
+_windows_free (FatTableWindows* w)
+{
+	if (w->fd >= 0)
+		close (w->fd);
+	free (w->slot_of);
+	free (w->stored);
+	free (w->slots);
+	free (w->data);
+	free (w);
+}
+
+/* Returns a descriptor of a new, already unlinked, temporary file in
+ * $TMPDIR or /var/tmp, or -1 with errno set.
+ */
+static int
+_windows_open_file (void)
+{
+	const char*	dir = getenv ("TMPDIR");
+	char*		name;
+	int		fd;
+	int		saved_errno;
+
+	if (!dir || !*dir)
+		dir = "/var/tmp";
+	name = ped_malloc (strlen (dir) + sizeof ("/parted-fat-XXXXXX"));
+	if (!name)
+		return -1;
+	sprintf (name, "%s/parted-fat-XXXXXX", dir);
+
+	fd = mkstemp (name);
+	saved_errno = errno;
+	if (fd >= 0)
+		unlink (name);
+	free (name);
+	errno = saved_errno;
+	return fd;
+}
+
+static FatTableWindows*
+_windows_new (int raw_size, unsigned long long budget)
+{
+	FatTableWindows*	w;
+	int			i;
+
+	w = ped_malloc (sizeof (FatTableWindows));
+	if (!w)
+		return NULL;
+	memset (w, 0, sizeof (FatTableWindows));
+	w->fd = -1;
+
+	w->window_count = ped_div_round_up (raw_size, WINDOW_SIZE);
+	w->slot_count = PED_MAX (budget / WINDOW_SIZE, 2);
+	w->slot_count = PED_MIN (w->slot_count, w->window_count);
+
+	w->slot_of = ped_malloc (w->window_count * sizeof (int));
+	w->stored = ped_malloc (w->window_count);
+	w->slots = ped_malloc (w->slot_count * sizeof (FatWindowSlot));
+	w->data = ped_malloc ((size_t) w->slot_count * WINDOW_SIZE);
+	if (!w->slot_of || !w->stored || !w->slots || !w->data)
+		goto error;
+
+	w->fd = _windows_open_file ();
+	if (w->fd < 0) {
+		ped_exception_throw (PED_EXCEPTION_ERROR, PED_EXCEPTION_CANCEL,
+				     _("Could not create a temporary file for "
+				       "the FAT: %s"),
+				     strerror (errno));
+		goto error;
+	}
+	errno = posix_fallocate (w->fd, 0,
+				 (off_t) w->window_count * WINDOW_SIZE);
+	if (errno) {
+		ped_exception_throw (PED_EXCEPTION_ERROR, PED_EXCEPTION_CANCEL,
+				     _("Could not make room for the FAT in a "
+				       "temporary file: %s"),
+				     strerror (errno));
+		goto error;
+	}
+
+	for (i = 0; i < w->slot_count; i++)
+		w->slots [i].data = w->data + (size_t) i * WINDOW_SIZE;
+	_windows_reset (w);
+	return w;
+
+error:
+	_windows_free (w);
+	return NULL;
+}
+
+static int
+_window_evict (FatTableWindows* w, int slot)
+{
+	FatWindowSlot*	s = &w->slots [slot];
+	off_t		offset = (off_t) s->window * WINDOW_SIZE;
+
+	if (s->window == NO_WINDOW)
+		return 1;
+
+	if (s->dirty) {
+		if (pwrite (w->fd, s->data, WINDOW_SIZE, offset)
+				!= WINDOW_SIZE) {
+			ped_exception_throw (PED_EXCEPTION_FATAL,
+					     PED_EXCEPTION_CANCEL,
+					     _("Could not write the FAT to a "
+					       "temporary file: %s"),
+					     strerror (errno));
+			return 0;
+		}
+		w->stored [s->window] = 1;
+	}
+	w->slot_of [s->window] = -1;
+	s->window = NO_WINDOW;
+	s->dirty = 0;
+	return 1;
+}
+
+static int
+_window_load (FatTableWindows* w, int slot, FatCluster window)
+{
+	FatWindowSlot*	s = &w->slots [slot];
+	off_t		offset = (off_t) window * WINDOW_SIZE;
+
+	if (!w->stored [window])
+		memset (s->data, 0, WINDOW_SIZE);
+	else if (pread (w->fd, s->data, WINDOW_SIZE, offset)
+			!= WINDOW_SIZE) {
+		ped_exception_throw (PED_EXCEPTION_FATAL, PED_EXCEPTION_CANCEL,
+				     _("Could not read the FAT back from a "
+				       "temporary file: %s"),
+				     strerror (errno));
+		return 0;
+	}
+	s->window = window;
+	w->slot_of [window] = slot;
+	return 1;
+}
+
+/* Returns the data of \p window, loading it if needed.  If \p dirty, it
+ * is written out before it is next dropped.
+ */
+static char*
+_window_get (FatTableWindows* w, FatCluster window, int dirty)
+{
+	int	slot = w->slot_of [window];
+	int	i;
+
+	if (slot < 0) {
+		slot = 0;
+		for (i = 1; i < w->slot_count; i++) {
+			if (w->slots [i].used < w->slots [slot].used)
+				slot = i;
+		}
+		if (!_window_evict (w, slot)
+		    || !_window_load (w, slot, window)) {
+			w->failed = 1;
+			return NULL;
+		}
+	}
+	w->slots [slot].used = ++w->clock;
+	w->slots [slot].dirty |= dirty;
+	return w->slots [slot].data;
+}
+
+/* Returns the raw entries of \p ft from \p entry up to the end of its
+ * window, or of the table if it is not windowed, and sets *\p n to their
+ * number.  The pointer is good until the next window is loaded.  If
+ * \p dirty, the entries are to be changed.  Returns NULL if the window
+ * could not be loaded.
+ */
+static void*
+_table_chunk (const FatTable* ft, FatCluster entry, FatCluster* n, int dirty)
+{
+	int		entry_size = fat_table_entry_size (ft->fat_type);
+	FatCluster	per_window = WINDOW_SIZE / entry_size;
+	char*		data;
+
+	if (!ft->windows) {
+		*n = ft->size - entry;
+		return (char*) ft->table + entry * entry_size;
+	}
+
+	data = _window_get (ft->windows, entry / per_window, dirty);
+	if (!data)
+		return NULL;
+	*n = PED_MIN (per_window - entry % per_window, ft->size - entry);
+	return data + entry % per_window * entry_size;
+}
+
+/* Returns the raw entry of \p cluster, as _table_chunk() does.  */
+static inline void*
+_table_entry (const FatTable* ft, FatCluster cluster, int dirty)
+{
+	FatCluster	n;
+
+	if (!ft->windows)
+		return (char*) ft->table
+			+ cluster * (ft->fat_type == FAT_TYPE_FAT32 ? 4 : 2);
+	return _table_chunk (ft, cluster, &n, dirty);
+}
+
+/* The free map has a bit per entry of a FAT16 or FAT32 table, set while
+ * the entry is zero.  fat_table_set() keeps it in sync.  Each bit of the
+ * summary stands for a word of the map, and is set if that word has any
+ * bit set, so a search skips 64 words, 4096 used clusters, at a time.
+ * FAT12 tables, which can't be changed, have no map.
+ */
+#define MAP_BITS	64
+
+static int
+_free_map_new (FatTable* ft)
+{
+	FatCluster	words = ped_div_round_up (ft->size, MAP_BITS);
+
+	ft->free_map = NULL;
+	ft->free_summary = NULL;
+	if (ft->fat_type == FAT_TYPE_FAT12)
+		return 1;
+
+	ft->free_map = ped_malloc (words * sizeof (uint64_t));
+	if (!ft->free_map)
+		return 0;
+	ft->free_summary = ped_malloc (ped_div_round_up (words, MAP_BITS)
+				       * sizeof (uint64_t));
+	if (!ft->free_summary) {
+		free (ft->free_map);
+		ft->free_map = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+static int
+_free_map_build (FatTable* ft)
+{
+	const FatScanOps*	ops = fat_scan_ops ();
+	FatCluster		words = ped_div_round_up (ft->size, MAP_BITS);
+	FatCluster		i;
+	FatCluster		n;
+	void*			chunk;
+
+	if (!ft->free_map)
+		return 1;
+
+	/* windows hold a multiple of MAP_BITS entries */
+	for (i = 0; i < ft->size; i += n) {
+		chunk = _table_chunk (ft, i, &n, 0);
+		if (!chunk)
+			return 0;
+		if (ft->fat_type == FAT_TYPE_FAT16)
+			ops->free_map16 (chunk, n, ft->free_map + i / MAP_BITS);
+		else
+			ops->free_map32 (chunk, n, ft->free_map + i / MAP_BITS);
+	}
+
+	memset (ft->free_summary, 0,
+		ped_div_round_up (words, MAP_BITS) * sizeof (uint64_t));
+	for (i = 0; i < words; i++) {
+		if (ft->free_map [i])
+			ft->free_summary [i / MAP_BITS]
+				|= (uint64_t) 1 << (i % MAP_BITS);
+	}
+	return 1;
+}
+
+static void
+_free_map_update (FatTable* ft, FatCluster cluster, int is_free)
+{
+	FatCluster	i = cluster / MAP_BITS;
+	uint64_t	bit = (uint64_t) 1 << (cluster % MAP_BITS);
+	uint64_t	summary_bit = (uint64_t) 1 << (i % MAP_BITS);
+
+	if (!ft->free_map)
+		return;
+
+	if (is_free)
+		ft->free_map [i] |= bit;
+	else
+		ft->free_map [i] &= ~bit;
+
+	if (ft->free_map [i])
+		ft->free_summary [i / MAP_BITS] |= summary_bit;
+	else
+		ft->free_summary [i / MAP_BITS] &= ~summary_bit;
+}
+
+/* Returns the first word of the free map from \p start up to \p end with
+ * a bit set, or \p end.
+ */
+static FatCluster
+_free_summary_find (const FatTable* ft, FatCluster start, FatCluster end)
+{
+	FatCluster	i = start / MAP_BITS;
+	uint64_t	bits;
+	FatCluster	word;
+
+	if (start >= end)
+		return end;
+
+	bits = ft->free_summary [i] & (~(uint64_t) 0 << (start % MAP_BITS));
+	while (!bits) {
+		if (++i * MAP_BITS >= end)
+			return end;
+		bits = ft->free_summary [i];
+	}
+	word = i * MAP_BITS + __builtin_ctzll (bits);
+	return word < end ? word : end;
+}
+
+/* Returns the first free cluster from \p start up to \p end, or \p end.  */
+static FatCluster
+_free_map_find (const FatTable* ft, FatCluster start, FatCluster end)
+{
+	FatCluster	i = start / MAP_BITS;
+	FatCluster	end_word = ped_div_round_up (end, MAP_BITS);
+	uint64_t	bits;
+	FatCluster	cluster;
+
+	if (start >= end)
+		return end;
+
+	bits = ft->free_map [i] & (~(uint64_t) 0 << (start % MAP_BITS));
+	if (!bits) {
+		i = _free_summary_find (ft, i + 1, end_word);
+		if (i == end_word)
+			return end;
+		bits = ft->free_map [i];
+	}
+	cluster = i * MAP_BITS + __builtin_ctzll (bits);
+	return cluster < end ? cluster : end;
+}
+
+/* Returns the first cluster in use from \p start up to \p end, or
+ * \p end.
+ */
+static FatCluster
+_free_map_find_used (const FatTable* ft, FatCluster start, FatCluster end)
+{
+	FatCluster	i = start / MAP_BITS;
+	uint64_t	bits;
+	FatCluster	cluster;
+
+	if (start >= end)
+		return end;
+
+	bits = ~ft->free_map [i] & (~(uint64_t) 0 << (start % MAP_BITS));
+	while (!bits) {
+		if (++i * MAP_BITS >= end)
+			return end;
+		bits = ~ft->free_map [i];
+	}
+	cluster = i * MAP_BITS + __builtin_ctzll (bits);
+	return cluster < end ? cluster : end;
+}
+
 FatTable*
 fat_table_new (FatType fat_type, FatCluster size)
 {
-	FatTable*	ft;
-	int		entry_size = fat_table_entry_size (fat_type);
+	FatTable*		ft;
+	int			entry_size = fat_table_entry_size (fat_type);
+	unsigned long long	budget;
 
 	ft = (FatTable*) ped_malloc (sizeof (FatTable));
 	if (!ft) return NULL;
@@ -39,9 +484,24 @@ fat_table_new (FatType fat_type, FatCluster size)
 	ft->fat_type = fat_type;
 	ft->raw_size = ft->size * entry_size;
 
-	ft->table = ped_malloc (ft->raw_size);
-	if (!ft->table) {
-		free (ft);
+	budget = _memory_budget ();
+	ft->table = NULL;
+	ft->windows = NULL;
+	if (budget && fat_type != FAT_TYPE_FAT12 && ft->raw_size > budget) {
+		ft->windows = _windows_new (ft->raw_size, budget);
+		if (!ft->windows) {
+			free (ft);
+			return NULL;
+		}
+	} else {
+		ft->table = ped_malloc (ft->raw_size);
+		if (!ft->table) {
+			free (ft);
+			return NULL;
+		}
+	}
+	if (!_free_map_new (ft)) {
+		fat_table_destroy (ft);
 		return NULL;
 	}
 
@@ -52,6 +512,10 @@ fat_table_new (FatType fat_type, FatCluster size)
 void
 fat_table_destroy (FatTable* ft)
 {
+	free (ft->free_map);
+	free (ft->free_summary);
+	if (ft->windows)
+		_windows_free (ft->windows);
 	free (ft->table);
 	free (ft);
 }
@@ -60,6 +524,12 @@ FatTable*
 fat_table_duplicate (const FatTable* ft)
 {
 	FatTable*	dup_ft;
+	int		entry_size = fat_table_entry_size (ft->fat_type);
+	FatCluster	i;
+	FatCluster	n;
+	FatCluster	dup_n;
+	void*		chunk;
+	void*		dup_chunk;
 
 	dup_ft = fat_table_new (ft->fat_type, ft->size);
 	if (!dup_ft) return NULL;
@@ -69,15 +539,33 @@ fat_table_duplicate (const FatTable* ft)
 	dup_ft->bad_cluster_count	= ft->bad_cluster_count;
 	dup_ft->last_alloc		= ft->last_alloc;
 
-	memcpy (dup_ft->table, ft->table, ft->raw_size);
+	for (i = 0; i < ft->size; i += n) {
+		chunk = _table_chunk (ft, i, &n, 0);
+		dup_chunk = chunk ? _table_chunk (dup_ft, i, &dup_n, 1) : NULL;
+		if (!dup_chunk)
+			goto error_destroy_dup_ft;
+		n = PED_MIN (n, dup_n);
+		memcpy (dup_chunk, chunk, n * entry_size);
+	}
+	if (!_free_map_build (dup_ft))
+		goto error_destroy_dup_ft;
 
 	return dup_ft;
+
+error_destroy_dup_ft:
+	fat_table_destroy (dup_ft);
+	return NULL;
 }
 
 void
 fat_table_clear (FatTable* ft)
 {
-	memset (ft->table, 0, ft->raw_size);
+	if (ft->windows)
+		_windows_reset (ft->windows);
+	else
+		memset (ft->table, 0, ft->raw_size);
+	/* can't fail: no window was changed, so none needs writing out */
+	_free_map_build (ft);
 
 	fat_table_set (ft, 0, 0x0ffffff8);
 	fat_table_set (ft, 1, 0x0fffffff);
@@ -96,6 +584,37 @@ fat_table_set_cluster_count (FatTable* ft, FatCluster new_cluster_count)
 	return fat_table_count_stats (ft);
 }
 
+/* Counts the free and bad entries of a FAT16 or FAT32 table straight from
+ * its raw entries, many at a time.
+ */
+static int
+_count_stats (FatTable* ft)
+{
+	const FatScanOps*	ops = fat_scan_ops ();
+	size_t			n_free = 0;
+	size_t			n_bad = 0;
+	FatCluster		end = ft->cluster_count + 2;
+	FatCluster		i;
+	FatCluster		n;
+	void*			chunk;
+
+	for (i = 2; i < end; i += n) {
+		chunk = _table_chunk (ft, i, &n, 0);
+		if (!chunk)
+			return 0;
+		n = PED_MIN (n, end - i);
+		if (ft->fat_type == FAT_TYPE_FAT16)
+			ops->count16 (chunk, n, PED_CPU_TO_LE16 (0xfff7),
+				      &n_free, &n_bad);
+		else
+			ops->count32 (chunk, n, PED_CPU_TO_LE32 (0x0ffffff7),
+				      &n_free, &n_bad);
+	}
+	ft->free_cluster_count = n_free;
+	ft->bad_cluster_count = n_bad;
+	return 1;
+}
+
 int
 fat_table_count_stats (FatTable* ft)
 {
@@ -106,6 +625,9 @@ fat_table_count_stats (FatTable* ft)
 	ft->free_cluster_count = 0;
 	ft->bad_cluster_count = 0;
 
+	if (ft->fat_type == FAT_TYPE_FAT16 || ft->fat_type == FAT_TYPE_FAT32)
+		return _count_stats (ft) && !fat_table_failed (ft);
+
 	for (i=2; i < ft->cluster_count + 2; i++) {
 		if (fat_table_is_available (ft, i))
 			ft->free_cluster_count++;
@@ -119,25 +641,46 @@ int
 fat_table_read (FatTable* ft, const PedFileSystem* fs, int table_num)
 {
 	FatSpecific*	fs_info = FAT_SPECIFIC (fs);
+	int		entry_size = fat_table_entry_size (ft->fat_type);
+	PedSector	offset = fs_info->fat_offset
+				 + table_num * fs_info->fat_sectors;
+	PedSector	done = 0;
+	PedSector	count;
+	FatCluster	i;
+	FatCluster	n;
+	void*		chunk;
+	int		media;
 
 	PED_ASSERT (ft->raw_size >= fs_info->fat_sectors * 512);
 
-	memset (ft->table, 0, ft->raw_size);
-
-        if (!ped_geometry_read (fs->geom, (void *) ft->table,
-				fs_info->fat_offset
-					+ table_num * fs_info->fat_sectors,
-				fs_info->fat_sectors))
+	/* one read, unless the table is windowed */
+	for (i = 0; i < ft->size; i += n) {
+		chunk = _table_chunk (ft, i, &n, 1);
+		if (!chunk)
+			return 0;
+		memset (chunk, 0, n * entry_size);
+		count = PED_MIN (n * entry_size / 512,
+				 fs_info->fat_sectors - done);
+		if (count && !ped_geometry_read (fs->geom, chunk,
+						 offset + done, count))
+			return 0;
+		done += count;
+	}
+	if (!_free_map_build (ft))
 		return 0;
 
-        if ( *((unsigned char*) ft->table) != fs_info->boot_sector->media) {
+	chunk = _table_chunk (ft, 0, &n, 0);
+	if (!chunk)
+		return 0;
+	media = *(unsigned char*) chunk;
+        if (media != fs_info->boot_sector->media) {
 		if (ped_exception_throw (
 			PED_EXCEPTION_ERROR,
 			PED_EXCEPTION_IGNORE_CANCEL,
 			_("FAT %d media %x doesn't match the boot sector's "
 			  "media %x.  You should probably run scandisk."),
 			(int) table_num + 1,
-			(int) *((unsigned char*) ft->table),
+			media,
 			(int) fs_info->boot_sector->media)
 				!= PED_EXCEPTION_IGNORE)
 			return 0;
@@ -145,23 +688,36 @@ fat_table_read (FatTable* ft, const PedFileSystem* fs, int table_num)
 
 	ft->cluster_count = fs_info->cluster_count;
 
-	fat_table_count_stats (ft);
-
-	return 1;
+	return fat_table_count_stats (ft);
 }
 
 int
 fat_table_write (const FatTable* ft, PedFileSystem* fs, int table_num)
 {
 	FatSpecific*	fs_info = FAT_SPECIFIC (fs);
+	int		entry_size = fat_table_entry_size (ft->fat_type);
+	PedSector	offset = fs_info->fat_offset
+				 + table_num * fs_info->fat_sectors;
+	PedSector	done = 0;
+	PedSector	count;
+	FatCluster	i;
+	FatCluster	n;
+	void*		chunk;
 
 	PED_ASSERT (ft->raw_size >= fs_info->fat_sectors * 512);
 
-        if (!ped_geometry_write (fs->geom, (void *) ft->table,
-				 fs_info->fat_offset
-					+ table_num * fs_info->fat_sectors,
-				 fs_info->fat_sectors))
-		return 0;
+	/* one write, unless the table is windowed */
+	for (i = 0; done < fs_info->fat_sectors; i += n) {
+		chunk = _table_chunk (ft, i, &n, 0);
+		if (!chunk)
+			return 0;
+		count = PED_MIN (n * entry_size / 512,
+				 fs_info->fat_sectors - done);
+		if (!ped_geometry_write (fs->geom, chunk, offset + done,
+					 count))
+			return 0;
+		done += count;
+	}
 	if (!ped_geometry_sync (fs->geom))
 		return 0;
 
@@ -263,6 +819,8 @@ _update_stats (FatTable* ft, FatCluster cluster, FatCluster value)
 int
 fat_table_set (FatTable* ft, FatCluster cluster, FatCluster value)
 {
+	void*	entry;
+
 	if (cluster >= ft->cluster_count + 2) {
 		ped_exception_throw (PED_EXCEPTION_BUG,
 				     PED_EXCEPTION_CANCEL,
@@ -272,6 +830,10 @@ fat_table_set (FatTable* ft, FatCluster cluster, FatCluster value)
 		return 0;
 	}
 
+	entry = _table_entry (ft, cluster, 1);
+	if (!entry)
+		return 0;
+
 	_update_stats (ft, cluster, value);
 
 	switch (ft->fat_type) {
@@ -280,21 +842,42 @@ fat_table_set (FatTable* ft, FatCluster cluster, FatCluster value)
                 break;
 
 		case FAT_TYPE_FAT16:
-		((unsigned short *) ft->table) [cluster]
-			= PED_CPU_TO_LE16 (value);
+		*(unsigned short *) entry = PED_CPU_TO_LE16 (value);
+		_free_map_update (ft, cluster, (unsigned short) value == 0);
 		break;
 
 		case FAT_TYPE_FAT32:
-		((unsigned int *) ft->table) [cluster]
-			= PED_CPU_TO_LE32 (value);
+		*(unsigned int *) entry = PED_CPU_TO_LE32 (value);
+		_free_map_update (ft, cluster, value == 0);
 		break;
 	}
 	return 1;
 }
 
+/* Returns the end of file marker of \p ft, which fat_table_get() and
+ * fat_table_get_run() return in place of entries that can't be loaded,
+ * so that whoever follows a chain stops there.
+ */
+static FatCluster
+_eof_code (const FatTable* ft)
+{
+	return ft->fat_type == FAT_TYPE_FAT16 ? 0xfff8 : 0x0fffffff;
+}
+
+/* Returns 1 if a window of \p ft could not be written out or read back.
+ * The table can't be trusted after that, and must not be written.
+ */
+int
+fat_table_failed (const FatTable* ft)
+{
+	return ft->windows && ft->windows->failed;
+}
+
 FatCluster
 fat_table_get (const FatTable* ft, FatCluster cluster)
 {
+	const void*	entry;
+
 	if (cluster >= ft->cluster_count + 2) {
 		ped_exception_throw (PED_EXCEPTION_BUG,
 				     PED_EXCEPTION_CANCEL,
@@ -304,38 +887,143 @@ fat_table_get (const FatTable* ft, FatCluster cluster)
 		exit (EXIT_FAILURE);	/* FIXME */
 	}
 
+	entry = _table_entry (ft, cluster, 0);
+	if (!entry)
+		return _eof_code (ft);
+
 	switch (ft->fat_type) {
                 case FAT_TYPE_FAT12:
                 PED_ASSERT (0);
                 break;
 
 		case FAT_TYPE_FAT16:
-		return PED_LE16_TO_CPU
-			(((unsigned short *) ft->table) [cluster]);
+		return PED_LE16_TO_CPU (*(const unsigned short *) entry);
 
 		case FAT_TYPE_FAT32:
-		return PED_LE32_TO_CPU
-			(((unsigned int *) ft->table) [cluster]);
+		return PED_LE32_TO_CPU (*(const unsigned int *) entry);
 	}
 
 	return 0;
 }
 
+/*
+    returns the number of clusters in the run that starts at <cluster>,
+    each of which is followed by the next one in its chain, and sets *<next>
+    to what follows the last, like fat_table_get() does.  The run stops at
+    the end of the file system.  Returns 0 if <cluster> is outside the file
+    system.
+*/
+FatCluster
+fat_table_get_run (const FatTable* ft, FatCluster cluster, FatCluster* next)
+{
+	FatCluster	end = ft->cluster_count + 2;
+	FatCluster	i = cluster;
+	FatCluster	n;
+	FatCluster	k;
+	const void*	chunk;
+
+	PED_ASSERT (ft->fat_type != FAT_TYPE_FAT12);
+
+	if (cluster >= end) {
+		ped_exception_throw (PED_EXCEPTION_BUG,
+				     PED_EXCEPTION_CANCEL,
+				     _("fat_table_get_run: cluster %ld outside "
+				       "file system"),
+				     (long) cluster);
+		*next = _eof_code (ft);
+		return 0;
+	}
+
+	while (1) {
+		chunk = _table_chunk (ft, i, &n, 0);
+		if (!chunk) {
+			*next = _eof_code (ft);
+			return PED_MAX (i - cluster, 1);
+		}
+		n = PED_MIN (n, end - i);
+
+		if (ft->fat_type == FAT_TYPE_FAT16) {
+			const uint16_t*	entry = chunk;
+			for (k = 0; k < n; k++) {
+				if (PED_LE16_TO_CPU (entry [k]) != i + k + 1)
+					break;
+			}
+		} else {
+			const uint32_t*	entry = chunk;
+			for (k = 0; k < n; k++) {
+				if (PED_LE32_TO_CPU (entry [k]) != i + k + 1)
+					break;
+			}
+		}
+
+		i += k;
+		if (k < n)
+			break;
+		if (i == end) {
+			/* the last cluster points outside the file system */
+			i--;
+			break;
+		}
+	}
+
+	*next = fat_table_get (ft, i);
+	return i - cluster + 1;
+}
+
+/* Returns the first free cluster from \p start up to \p end, or \p end.  */
+static FatCluster
+_find_free (const FatTable* ft, FatCluster start, FatCluster end)
+{
+	FatCluster	cluster;
+
+	if (ft->free_map)
+		return _free_map_find (ft, start, end);
+
+	for (cluster = start; cluster < end; cluster++) {
+		if (fat_table_is_available (ft, cluster))
+			break;
+	}
+	return cluster;
+}
+
+/* Returns the first cluster from \p start up to \p end that starts a run
+ * of \p count free ones, or \p end.
+ */
+static FatCluster
+_find_free_run (const FatTable* ft, FatCluster start, FatCluster end,
+		FatCluster count)
+{
+	FatCluster	cluster = start;
+	FatCluster	used;
+
+	while ((cluster = _free_map_find (ft, cluster, end)) < end) {
+		used = _free_map_find_used (ft, cluster, end);
+		if (used - cluster >= count)
+			return cluster;
+		cluster = used;
+	}
+	return end;
+}
+
 FatCluster
 fat_table_alloc_cluster (FatTable* ft)
 {
-	FatCluster	i;
+	FatCluster	start;
 	FatCluster	cluster;
 
 /* hack: assumes the first two FAT entries are marked as used (which they
  * always should be)
  */
-	for (i=1; i < ft->cluster_count + 1; i++) {
-		cluster = (i + ft->last_alloc) % ft->cluster_count;
-		if (fat_table_is_available (ft, cluster)) {
-			ft->last_alloc = cluster;
-			return cluster;
-		}
+	start = (ft->last_alloc + 1) % ft->cluster_count;
+	cluster = _find_free (ft, start, ft->cluster_count);
+	if (cluster == ft->cluster_count) {
+		cluster = _find_free (ft, 0, start);
+		if (cluster == start)
+			cluster = ft->cluster_count;
+	}
+	if (cluster < ft->cluster_count) {
+		ft->last_alloc = cluster;
+		return cluster;
 	}
 
 	ped_exception_throw (PED_EXCEPTION_ERROR,
@@ -344,6 +1032,31 @@ fat_table_alloc_cluster (FatTable* ft)
 	return 0;
 }
 
+/*
+    returns the first of <count> free clusters in a row, looking from where
+    the last allocation left off, like fat_table_alloc_cluster(), or 0 if
+    there is no such run.  Nothing is marked as used.
+*/
+FatCluster
+fat_table_alloc_run (FatTable* ft, FatCluster count)
+{
+	FatCluster	start;
+	FatCluster	cluster;
+
+	if (!ft->free_map || !count || count > ft->cluster_count)
+		return 0;
+
+	start = (ft->last_alloc + 1) % ft->cluster_count;
+	cluster = _find_free_run (ft, start, ft->cluster_count, count);
+	if (cluster == ft->cluster_count)
+		cluster = _find_free_run (ft, 0, ft->cluster_count, count);
+	if (cluster == ft->cluster_count)
+		return 0;
+
+	ft->last_alloc = cluster + count - 1;
+	return cluster;
+}
+
 FatCluster
 fat_table_alloc_check_cluster (FatTable* ft, PedFileSystem* fs)
 {
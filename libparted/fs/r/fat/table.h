@@ -21,11 +21,13 @@
 #define PED_FAT_TABLE_H_INCLUDED
 
 typedef struct _FatTable	FatTable;
+typedef struct _FatTableWindows	FatTableWindows;
 
 #include "fat.h"
 
 struct _FatTable {
-	void*		table;
+	void*		table;		/* NULL if the table is windowed */
+	FatTableWindows* windows;
 	FatCluster	size;
 	int		raw_size;
 
@@ -35,6 +37,10 @@ struct _FatTable {
 	FatCluster	bad_cluster_count;
 
 	FatCluster	last_alloc;
+
+	uint64_t*	free_map;	/* a bit per entry, set if it is free */
+	uint64_t*	free_summary;	/* a bit per word of free_map, set if
+					   it has a bit set */
 };
 
 extern FatTable* fat_table_new (FatType fat_type, FatCluster size);
@@ -51,11 +57,15 @@ extern int fat_table_write (const FatTable* ft, PedFileSystem* fs,
 extern int fat_table_write_all (const FatTable* ft, PedFileSystem* fs);
 extern int fat_table_compare (const FatTable* a, const FatTable* b);
 extern int fat_table_count_stats (FatTable* ft);
+extern int fat_table_failed (const FatTable* ft);
 
 extern FatCluster fat_table_get (const FatTable* ft, FatCluster cluster);
+extern FatCluster fat_table_get_run (const FatTable* ft, FatCluster cluster,
+				     FatCluster* next);
 extern int fat_table_set (FatTable* ft, FatCluster cluster, FatCluster value);
 
 extern FatCluster fat_table_alloc_cluster (FatTable* ft);
+extern FatCluster fat_table_alloc_run (FatTable* ft, FatCluster count);
 extern FatCluster fat_table_alloc_check_cluster (FatTable* ft,
 						 PedFileSystem* fs);
 
@@ -0,0 +1,426 @@
+/*
+    libparted
+    Copyright (C) 2026 Free Software Foundation, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include "tablescan.h"
+
+/* The plain loops, which the others must agree with.  */
+
+static void
+_count16_ref (const uint16_t* table, size_t n, uint16_t bad,
+	      size_t* n_free, size_t* n_bad)
+{
+	size_t	f = 0;
+	size_t	b = 0;
+	size_t	i;
+
+	for (i = 0; i < n; i++) {
+		f += table[i] == 0;
+		b += table[i] == bad;
+	}
+	*n_free += f;
+	*n_bad += b;
+}
+
+static void
+_count32_ref (const uint32_t* table, size_t n, uint32_t bad,
+	      size_t* n_free, size_t* n_bad)
+{
+	size_t	f = 0;
+	size_t	b = 0;
+	size_t	i;
+
+	for (i = 0; i < n; i++) {
+		f += table[i] == 0;
+		b += table[i] == bad;
+	}
+	*n_free += f;
+	*n_bad += b;
+}
+
+static void
+_free_map16_ref (const uint16_t* table, size_t n, uint64_t* map)
+{
+	size_t	i;
+
+	for (i = 0; i < n; i += 64) {
+		uint64_t	word = 0;
+		size_t		j;
+
+		for (j = 0; j < 64 && i + j < n; j++)
+			word |= (uint64_t) (table[i + j] == 0) << j;
+		map[i / 64] = word;
+	}
+}
+
+static void
+_free_map32_ref (const uint32_t* table, size_t n, uint64_t* map)
+{
+	size_t	i;
+
+	for (i = 0; i < n; i += 64) {
+		uint64_t	word = 0;
+		size_t		j;
+
+		for (j = 0; j < 64 && i + j < n; j++)
+			word |= (uint64_t) (table[i + j] == 0) << j;
+		map[i / 64] = word;
+	}
+}
+
+static const FatScanOps scan_ref = {
+	name:		"ref",
+	count16:	_count16_ref,
+	count32:	_count32_ref,
+	free_map16:	_free_map16_ref,
+	free_map32:	_free_map32_ref
+};
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+# define HAVE_FAT_SCAN_X86 1
+# include <immintrin.h>
+
+/* The SSE2 and AVX2 versions keep one counter per lane, as wide as an
+ * entry, and subtract the all-ones compare results from them.  16-bit
+ * counters are emptied every 0xffff rounds, before they can wrap.  The
+ * free maps are put together 64 entries at a time from the compare masks.
+ */
+# define SCAN_ROUNDS_MAX(bits)	((bits) == 16 ? 0xffff : 0xffffffff)
+# define SCAN_MIN(a, b)		((a) < (b) ? (a) : (b))
+
+__attribute__ ((target ("sse2")))
+static size_t
+_sum16_sse2 (__m128i v)
+{
+	uint16_t	lanes[8];
+	size_t		sum = 0;
+	int		i;
+
+	_mm_storeu_si128 ((__m128i*) lanes, v);
+	for (i = 0; i < 8; i++)
+		sum += lanes[i];
+	return sum;
+}
+
+__attribute__ ((target ("sse2")))
+static size_t
+_sum32_sse2 (__m128i v)
+{
+	uint32_t	lanes[4];
+	size_t		sum = 0;
+	int		i;
+
+	_mm_storeu_si128 ((__m128i*) lanes, v);
+	for (i = 0; i < 4; i++)
+		sum += lanes[i];
+	return sum;
+}
+
+__attribute__ ((target ("sse2")))
+static void
+_count16_sse2 (const uint16_t* table, size_t n, uint16_t bad,
+	       size_t* n_free, size_t* n_bad)
+{
+	const __m128i	zero = _mm_setzero_si128 ();
+	const __m128i	bad_v = _mm_set1_epi16 ((short) bad);
+	size_t		i = 0;
+
+	while (n - i >= 8) {
+		size_t	end = i + 8 * SCAN_MIN ((n - i) / 8,
+						SCAN_ROUNDS_MAX (16));
+		__m128i	f = zero;
+		__m128i	b = zero;
+
+		for (; i < end; i += 8) {
+			__m128i	x = _mm_loadu_si128 ((const __m128i*)
+						     (table + i));
+			f = _mm_sub_epi16 (f, _mm_cmpeq_epi16 (x, zero));
+			b = _mm_sub_epi16 (b, _mm_cmpeq_epi16 (x, bad_v));
+		}
+		*n_free += _sum16_sse2 (f);
+		*n_bad += _sum16_sse2 (b);
+	}
+	_count16_ref (table + i, n - i, bad, n_free, n_bad);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+_count32_sse2 (const uint32_t* table, size_t n, uint32_t bad,
+	       size_t* n_free, size_t* n_bad)
+{
+	const __m128i	zero = _mm_setzero_si128 ();
+	const __m128i	bad_v = _mm_set1_epi32 ((int) bad);
+	size_t		i = 0;
+
+	while (n - i >= 4) {
+		size_t	end = i + 4 * SCAN_MIN ((n - i) / 4,
+						SCAN_ROUNDS_MAX (32));
+		__m128i	f = zero;
+		__m128i	b = zero;
+
+		for (; i < end; i += 4) {
+			__m128i	x = _mm_loadu_si128 ((const __m128i*)
+						     (table + i));
+			f = _mm_sub_epi32 (f, _mm_cmpeq_epi32 (x, zero));
+			b = _mm_sub_epi32 (b, _mm_cmpeq_epi32 (x, bad_v));
+		}
+		*n_free += _sum32_sse2 (f);
+		*n_bad += _sum32_sse2 (b);
+	}
+	_count32_ref (table + i, n - i, bad, n_free, n_bad);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+_free_map16_sse2 (const uint16_t* table, size_t n, uint64_t* map)
+{
+	const __m128i	zero = _mm_setzero_si128 ();
+	size_t		i;
+
+	for (i = 0; n - i >= 64; i += 64) {
+		const __m128i*	v = (const __m128i*) (table + i);
+		uint64_t	word = 0;
+		int		k;
+
+		/* Pack the 16-bit compare results to bytes, in order.  */
+		for (k = 0; k < 4; k++) {
+			__m128i	a = _mm_cmpeq_epi16 (
+					_mm_loadu_si128 (v + 2 * k), zero);
+			__m128i	b = _mm_cmpeq_epi16 (
+					_mm_loadu_si128 (v + 2 * k + 1), zero);
+			word |= (uint64_t) (uint16_t) _mm_movemask_epi8 (
+					_mm_packs_epi16 (a, b)) << (16 * k);
+		}
+		map[i / 64] = word;
+	}
+	if (i < n)
+		_free_map16_ref (table + i, n - i, map + i / 64);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+_free_map32_sse2 (const uint32_t* table, size_t n, uint64_t* map)
+{
+	const __m128i	zero = _mm_setzero_si128 ();
+	size_t		i;
+
+	for (i = 0; n - i >= 64; i += 64) {
+		const __m128i*	v = (const __m128i*) (table + i);
+		uint64_t	word = 0;
+		int		k;
+
+		for (k = 0; k < 16; k++) {
+			__m128i	x = _mm_cmpeq_epi32 (
+					_mm_loadu_si128 (v + k), zero);
+			word |= (uint64_t) _mm_movemask_ps (
+					_mm_castsi128_ps (x)) << (4 * k);
+		}
+		map[i / 64] = word;
+	}
+	if (i < n)
+		_free_map32_ref (table + i, n - i, map + i / 64);
+}
+
+static const FatScanOps scan_sse2 = {
+	name:		"sse2",
+	count16:	_count16_sse2,
+	count32:	_count32_sse2,
+	free_map16:	_free_map16_sse2,
+	free_map32:	_free_map32_sse2
+};
+
+__attribute__ ((target ("avx2")))
+static size_t
+_sum16_avx2 (__m256i v)
+{
+	uint16_t	lanes[16];
+	size_t		sum = 0;
+	int		i;
+
+	_mm256_storeu_si256 ((__m256i*) lanes, v);
+	for (i = 0; i < 16; i++)
+		sum += lanes[i];
+	return sum;
+}
+
+__attribute__ ((target ("avx2")))
+static size_t
+_sum32_avx2 (__m256i v)
+{
+	uint32_t	lanes[8];
+	size_t		sum = 0;
+	int		i;
+
+	_mm256_storeu_si256 ((__m256i*) lanes, v);
+	for (i = 0; i < 8; i++)
+		sum += lanes[i];
+	return sum;
+}
+
+__attribute__ ((target ("avx2")))
+static void
+_count16_avx2 (const uint16_t* table, size_t n, uint16_t bad,
+	       size_t* n_free, size_t* n_bad)
+{
+	const __m256i	zero = _mm256_setzero_si256 ();
+	const __m256i	bad_v = _mm256_set1_epi16 ((short) bad);
+	size_t		i = 0;
+
+	while (n - i >= 16) {
+		size_t	end = i + 16 * SCAN_MIN ((n - i) / 16,
+						 SCAN_ROUNDS_MAX (16));
+		__m256i	f = zero;
+		__m256i	b = zero;
+
+		for (; i < end; i += 16) {
+			__m256i	x = _mm256_loadu_si256 ((const __m256i*)
+							(table + i));
+			f = _mm256_sub_epi16 (f, _mm256_cmpeq_epi16 (x, zero));
+			b = _mm256_sub_epi16 (b,
+					      _mm256_cmpeq_epi16 (x, bad_v));
+		}
+		*n_free += _sum16_avx2 (f);
+		*n_bad += _sum16_avx2 (b);
+	}
+	_count16_ref (table + i, n - i, bad, n_free, n_bad);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+_count32_avx2 (const uint32_t* table, size_t n, uint32_t bad,
+	       size_t* n_free, size_t* n_bad)
+{
+	const __m256i	zero = _mm256_setzero_si256 ();
+	const __m256i	bad_v = _mm256_set1_epi32 ((int) bad);
+	size_t		i = 0;
+
+	while (n - i >= 8) {
+		size_t	end = i + 8 * SCAN_MIN ((n - i) / 8,
+						SCAN_ROUNDS_MAX (32));
+		__m256i	f = zero;
+		__m256i	b = zero;
+
+		for (; i < end; i += 8) {
+			__m256i	x = _mm256_loadu_si256 ((const __m256i*)
+							(table + i));
+			f = _mm256_sub_epi32 (f, _mm256_cmpeq_epi32 (x, zero));
+			b = _mm256_sub_epi32 (b,
+					      _mm256_cmpeq_epi32 (x, bad_v));
+		}
+		*n_free += _sum32_avx2 (f);
+		*n_bad += _sum32_avx2 (b);
+	}
+	_count32_ref (table + i, n - i, bad, n_free, n_bad);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+_free_map16_avx2 (const uint16_t* table, size_t n, uint64_t* map)
+{
+	const __m256i	zero = _mm256_setzero_si256 ();
+	size_t		i;
+
+	for (i = 0; n - i >= 64; i += 64) {
+		const __m256i*	v = (const __m256i*) (table + i);
+		uint64_t	word = 0;
+		int		k;
+
+		/* _mm256_packs_epi16 packs within each 128-bit half, so put
+		 * the quarters back in order before taking the mask.
+		 */
+		for (k = 0; k < 2; k++) {
+			__m256i	a = _mm256_loadu_si256 (v + 2 * k);
+			__m256i	b = _mm256_loadu_si256 (v + 2 * k + 1);
+			__m256i	x = _mm256_permute4x64_epi64 (
+					_mm256_packs_epi16 (
+						_mm256_cmpeq_epi16 (a, zero),
+						_mm256_cmpeq_epi16 (b, zero)),
+					0xd8);
+			word |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (x)
+				<< (32 * k);
+		}
+		map[i / 64] = word;
+	}
+	if (i < n)
+		_free_map16_ref (table + i, n - i, map + i / 64);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+_free_map32_avx2 (const uint32_t* table, size_t n, uint64_t* map)
+{
+	const __m256i	zero = _mm256_setzero_si256 ();
+	size_t		i;
+
+	for (i = 0; n - i >= 64; i += 64) {
+		const __m256i*	v = (const __m256i*) (table + i);
+		uint64_t	word = 0;
+		int		k;
+
+		for (k = 0; k < 8; k++) {
+			__m256i	x = _mm256_cmpeq_epi32 (
+					_mm256_loadu_si256 (v + k), zero);
+			word |= (uint64_t) (uint8_t) _mm256_movemask_ps (
+					_mm256_castsi256_ps (x)) << (8 * k);
+		}
+		map[i / 64] = word;
+	}
+	if (i < n)
+		_free_map32_ref (table + i, n - i, map + i / 64);
+}
+
+static const FatScanOps scan_avx2 = {
+	name:		"avx2",
+	count16:	_count16_avx2,
+	count32:	_count32_avx2,
+	free_map16:	_free_map16_avx2,
+	free_map32:	_free_map32_avx2
+};
+#endif /* HAVE_FAT_SCAN_X86 */
+
+static const FatScanOps*	scan_impls[3] = { &scan_ref };
+static int			scan_impl_count = 1;
+
+/* Find out which implementations this CPU can run.  Until this has run,
+ * only the plain loops are used.
+ */
+static void fat_scan_init (void) __attribute__ ((constructor));
+
+static void
+fat_scan_init (void)
+{
+#ifdef HAVE_FAT_SCAN_X86
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("sse2"))
+		scan_impls[scan_impl_count++] = &scan_sse2;
+	if (__builtin_cpu_supports ("avx2"))
+		scan_impls[scan_impl_count++] = &scan_avx2;
+#endif
+}
+
+const FatScanOps*
+fat_scan_ops (void)
+{
+	return scan_impls[scan_impl_count - 1];
+}
+
+const FatScanOps*
+fat_scan_ops_get (int i)
+{
+	return i >= 0 && i < scan_impl_count ? scan_impls[i] : NULL;
+}
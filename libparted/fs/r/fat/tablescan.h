@@ -0,0 +1,63 @@
+/*
+    libparted
+    Copyright (C) 2026 Free Software Foundation, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PED_FAT_TABLESCAN_H_INCLUDED
+#define PED_FAT_TABLESCAN_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Loops over the raw, little-endian entries of a FAT16 or FAT32 table,
+ * for fat_table_count_stats() and the free cluster map.  Entries are
+ * compared as stored, so \p bad is the bad cluster code already converted
+ * with PED_CPU_TO_LE16() or PED_CPU_TO_LE32().
+ *
+ * count* adds the number of free (zero) entries among the \p n at
+ * \p table to *\p n_free, and of entries equal to \p bad to *\p n_bad.
+ * free_map* sets bit i % 64 of \p map [i / 64] if entry i is free and
+ * clears it otherwise, for the \p n entries, and clears the bits of the
+ * last word past \p n.
+ *
+ * This file does not depend on the rest of the FAT code, so that the
+ * tests can check every implementation against the plain loops.
+ */
+typedef struct _FatScanOps	FatScanOps;
+
+struct _FatScanOps {
+	const char*	name;
+	void		(*count16) (const uint16_t* table, size_t n,
+				    uint16_t bad, size_t* n_free,
+				    size_t* n_bad);
+	void		(*count32) (const uint32_t* table, size_t n,
+				    uint32_t bad, size_t* n_free,
+				    size_t* n_bad);
+	void		(*free_map16) (const uint16_t* table, size_t n,
+				       uint64_t* map);
+	void		(*free_map32) (const uint32_t* table, size_t n,
+				       uint64_t* map);
+};
+
+/* The fastest implementation this CPU can run.  */
+extern const FatScanOps* fat_scan_ops (void);
+
+/* The \p i th implementation this CPU can run, from the plain loops at
+ * 0 to the fastest, or NULL past the last one.
+ */
+extern const FatScanOps* fat_scan_ops_get (int i);
+
+#endif /* PED_FAT_TABLESCAN_H_INCLUDED */
@@ -72,8 +72,24 @@ static PedGeometry *reiserfs_probe(PedGeometry *geom)
 }
 
 
+/* at each of reiserfs_super_offset */
+#define MAGIC(sector, signature) \
+	{ sector, offsetof (reiserfs_super_block_t, s_magic), \
+	  sizeof signature - 1, signature }
+static const PedFileSystemMagic reiserfs_magic[] = {
+	MAGIC (128, REISERFS_SIGNATURE),
+	MAGIC (128, REISER2FS_SIGNATURE),
+	MAGIC (128, REISER3FS_SIGNATURE),
+	MAGIC (16, REISERFS_SIGNATURE),
+	MAGIC (16, REISER2FS_SIGNATURE),
+	MAGIC (16, REISER3FS_SIGNATURE),
+	{ 0, 0, 0, NULL }
+};
+#undef MAGIC
+
 static PedFileSystemOps reiserfs_simple_ops = {
 	probe:		reiserfs_probe,
+	magic:		reiserfs_magic,
 };
 
 static PedFileSystemType reiserfs_simple_type = {
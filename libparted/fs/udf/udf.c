@@ -152,8 +152,22 @@ udf_probe (PedGeometry* geom)
 	return ped_geometry_duplicate (geom);
 }
 
+/* the identifiers check_vrs accepts as the first volume structure
+   descriptor */
+static const PedFileSystemMagic udf_magic[] = {
+	{ 0, 32768 + 1, 5, "NSR02" },
+	{ 0, 32768 + 1, 5, "NSR03" },
+	{ 0, 32768 + 1, 5, "BEA01" },
+	{ 0, 32768 + 1, 5, "TEA01" },
+	{ 0, 32768 + 1, 5, "BOOT2" },
+	{ 0, 32768 + 1, 5, "CD001" },
+	{ 0, 32768 + 1, 5, "CDW02" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps udf_ops = {
 	probe:		udf_probe,
+	magic:		udf_magic,
 };
 
 static PedFileSystemType udf_type = {
@@ -244,12 +244,33 @@ ufs_probe_hp (PedGeometry* geom)
 	return NULL;
 }
 
+/* fs_magic, in the superblock 8KiB in, in either byte order */
+#define UFS_MAGIC_AT	(8192 + offsetof (struct ufs_super_block, fs_magic))
+
+static const PedFileSystemMagic ufs_magic_sun[] = {
+	{ 0, UFS_MAGIC_AT, 4, "\x00\x01\x19\x54" },
+	{ 0, UFS_MAGIC_AT, 4, "\x54\x19\x01\x00" },
+	{ 0, 0, 0, NULL }
+};
+
+static const PedFileSystemMagic ufs_magic_hp[] = {
+	{ 0, UFS_MAGIC_AT, 4, "\x00\x09\x50\x14" },
+	{ 0, UFS_MAGIC_AT, 4, "\x14\x50\x09\x00" },
+	{ 0, UFS_MAGIC_AT, 4, "\x00\x19\x56\x12" },
+	{ 0, UFS_MAGIC_AT, 4, "\x12\x56\x19\x00" },
+	{ 0, UFS_MAGIC_AT, 4, "\x05\x23\x19\x94" },
+	{ 0, UFS_MAGIC_AT, 4, "\x94\x19\x23\x05" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps ufs_ops_sun = {
 	probe:		ufs_probe_sun,
+	magic:		ufs_magic_sun,
 };
 
 static PedFileSystemOps ufs_ops_hp = {
 	probe:		ufs_probe_hp,
+	magic:		ufs_magic_hp,
 };
 
 static PedFileSystemType ufs_type_sun = {
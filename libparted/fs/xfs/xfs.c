@@ -64,8 +64,16 @@ xfs_probe (PedGeometry* geom)
 	return NULL;
 }
 
+/* sb_magicnum, in either byte order */
+static const PedFileSystemMagic xfs_magic[] = {
+	{ XFS_SB_DADDR, 0, 4, "XFSB" },
+	{ XFS_SB_DADDR, 0, 4, "BSFX" },
+	{ 0, 0, 0, NULL }
+};
+
 static PedFileSystemOps xfs_ops = {
 	probe:		xfs_probe,
+	magic:		xfs_magic,
 };
 
 static PedFileSystemType xfs_type = {
@@ -1695,8 +1695,10 @@ art_room_for_logic (PedDisk* disk)
 		if (part && ped_partition_is_active (part)
 		         && !(part->type & ( PED_PARTITION_LOGICAL
 					   | PED_PARTITION_EXTENDED))
-			 && part->num > 0 )
+			 && part->num > 0 ) {
 			part->num++;
+			_ped_disk_renumbered (disk);
+		}
 	}
 
 	return 1;
@@ -21,6 +21,9 @@
 
 #include <sys/time.h>
 #include <stdbool.h>
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
 #include <parted/parted.h>
 #include <parted/debug.h>
 #include <parted/endian.h>
@@ -1078,6 +1081,100 @@ disk_probe_bios_geometry (const PedDisk* disk, PedCHSGeometry* bios_geom)
 		}
 	}
 }
+
+/* Guessing the BIOS geometry means reading the whole table again, so
+ * remember what was guessed for the last few devices, by the geometry the
+ * device started with and the primary partition entries.  A remembered
+ * geometry is only a hint: it is used if it still agrees with every
+ * partition, and guessed again otherwise.
+ */
+#define GEOM_MEMO_SIZE		16
+
+typedef struct {
+	char*		path;
+	PedSector	length;
+	long long	sector_size;
+	PedCHSGeometry	from;		/* the device's geometry */
+	DosRawPartition	mbr[DOS_N_PRI_PARTITIONS];
+	PedCHSGeometry	to;		/* the one guessed */
+} GeomMemo;
+
+static GeomMemo	geom_memo[GEOM_MEMO_SIZE];
+static int	geom_memo_next;
+#if HAVE_PTHREAD
+static pthread_mutex_t	geom_memo_lock = PTHREAD_MUTEX_INITIALIZER;
+# define GEOM_MEMO_LOCK()	pthread_mutex_lock (&geom_memo_lock)
+# define GEOM_MEMO_UNLOCK()	pthread_mutex_unlock (&geom_memo_lock)
+#else
+# define GEOM_MEMO_LOCK()
+# define GEOM_MEMO_UNLOCK()
+#endif
+
+static int
+geom_memo_matches (const GeomMemo* memo, const PedDevice* dev,
+		   const DosRawPartition* mbr)
+{
+	return memo->path
+	       && !strcmp (memo->path, dev->path)
+	       && memo->length == dev->length
+	       && memo->sector_size == dev->sector_size
+	       && !memcmp (&memo->from, &dev->bios_geom, sizeof memo->from)
+	       && !memcmp (memo->mbr, mbr, sizeof memo->mbr);
+}
+
+/* If a geometry was guessed for DEV with the primary partition entries
+ * MBR, store it in *BIOS_GEOM and return 1.
+ */
+static int
+geom_memo_lookup (const PedDevice* dev, const DosRawPartition* mbr,
+		  PedCHSGeometry* bios_geom)
+{
+	int	found = 0;
+	int	i;
+
+	GEOM_MEMO_LOCK ();
+	for (i = 0; i < GEOM_MEMO_SIZE; i++) {
+		if (geom_memo_matches (&geom_memo[i], dev, mbr)) {
+			*bios_geom = geom_memo[i].to;
+			found = 1;
+			break;
+		}
+	}
+	GEOM_MEMO_UNLOCK ();
+	return found;
+}
+
+static void
+geom_memo_store (const PedDevice* dev, const DosRawPartition* mbr,
+		 const PedCHSGeometry* bios_geom)
+{
+	GeomMemo*	memo = NULL;
+	int		i;
+
+	GEOM_MEMO_LOCK ();
+	for (i = 0; i < GEOM_MEMO_SIZE; i++) {
+		if (geom_memo_matches (&geom_memo[i], dev, mbr)) {
+			memo = &geom_memo[i];
+			break;
+		}
+	}
+	if (!memo) {
+		char* path = strdup (dev->path);
+		if (!path)
+			goto out;
+		memo = &geom_memo[geom_memo_next];
+		geom_memo_next = (geom_memo_next + 1) % GEOM_MEMO_SIZE;
+		free (memo->path);
+		memo->path = path;
+		memo->length = dev->length;
+		memo->sector_size = dev->sector_size;
+		memo->from = dev->bios_geom;
+		memcpy (memo->mbr, mbr, sizeof memo->mbr);
+	}
+	memo->to = *bios_geom;
+out:
+	GEOM_MEMO_UNLOCK ();
+}
 #endif /* !DISCOVER_ONLY */
 
 static int _GL_ATTRIBUTE_PURE
@@ -1128,8 +1225,216 @@ raw_part_parse (const PedDisk* disk, const DosRawPartition* raw_part,
 	return part;
 }
 
+/* Most software lays out logical partitions of the same size one after
+ * the other, so the EBRs of a chain tend to be the same distance apart.
+ * When they have been so far, read several of them ahead in one batch
+ * instead of one round trip per EBR.  Speculative reads are only used if
+ * the chain actually leads to them.  Every EBR read is kept until the
+ * whole label has been read, as msdos_read may need to read it twice.
+ */
+#define EBR_READ_AHEAD_MAX	8
+
+typedef struct {
+	PedSector	last;		/* the last EBR asked for, or 0 */
+	PedSector	stride;		/* distance from the one before */
+	int		window;		/* how many to read on the next miss */
+	int		n;		/* sectors read so far */
+	int		n_alloc;
+	PedSector*	sector;
+	char*		buf;		/* their contents */
+} EbrReader;
+
+static void
+ebr_reader_init (EbrReader* ebrs)
+{
+	memset (ebrs, 0, sizeof *ebrs);
+}
+
+/* Start following a chain from the start, keeping what was read.  */
+static void
+ebr_reader_rewind (EbrReader* ebrs)
+{
+	ebrs->last = 0;
+	ebrs->stride = 0;
+	ebrs->window = 1;
+}
+
+static void
+ebr_reader_fini (EbrReader* ebrs)
+{
+	free (ebrs->sector);
+	free (ebrs->buf);
+}
+
+/* Make room for N more sectors.  */
 static int
-read_table (PedDisk* disk, PedSector sector, int is_extended_table)
+ebr_reader_reserve (const PedDevice* dev, EbrReader* ebrs, int n)
+{
+	if (ebrs->n + n <= ebrs->n_alloc)
+		return 1;
+
+	int		n_alloc = PED_MAX (ebrs->n_alloc * 2, ebrs->n + n);
+	PedSector*	sector = realloc (ebrs->sector, n_alloc * sizeof *sector);
+	if (!sector)
+		return 0;
+	ebrs->sector = sector;
+	char*		buf = realloc (ebrs->buf, n_alloc * dev->sector_size);
+	if (!buf)
+		return 0;
+	ebrs->buf = buf;
+	ebrs->n_alloc = n_alloc;
+	return 1;
+}
+
+/* If SECTOR was read already, copy it to malloc'd storage at *BUF and
+ * return 1.  Otherwise return 0.
+ */
+static int
+ebr_lookup (const PedDevice* dev, const EbrReader* ebrs, PedSector sector,
+	    void** buf)
+{
+	int		i;
+
+	/* Chains are followed in order, so look at the latest first.  */
+	for (i = ebrs->n - 1; i >= 0; i--) {
+		if (ebrs->sector[i] == sector) {
+			void* b = ped_malloc (dev->sector_size);
+			if (!b)
+				return 0;
+			memcpy (b, ebrs->buf + i * dev->sector_size,
+				dev->sector_size);
+			*buf = b;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Read the EBR at SECTOR into malloc'd storage, like ptt_read_sector.  */
+static int
+ebr_read (const PedDisk* disk, EbrReader* ebrs, PedSector sector, void** buf)
+{
+	PedDevice*	dev = disk->dev;
+	PedSector	stride = ebrs->last ? sector - ebrs->last : 0;
+	int		regular = stride > 0 && stride == ebrs->stride;
+	PedIoVec	iov[EBR_READ_AHEAD_MAX];
+	int		n = 0;
+	int		i;
+
+	ebrs->last = sector;
+	ebrs->stride = stride;
+
+	if (ebr_lookup (dev, ebrs, sector, buf))
+		return 1;
+
+	/* A miss.  Read further ahead each time the spacing held up, and
+	 * go back to one EBR at a time as soon as it doesn't.
+	 */
+	ebrs->window = regular ? PED_MIN (ebrs->window * 2, EBR_READ_AHEAD_MAX)
+			       : 1;
+	if (!ebr_reader_reserve (dev, ebrs, ebrs->window))
+		return 0;
+	for (i = 0; i < ebrs->window; i++) {
+		PedSector s = sector + i * stride;
+		if (s >= dev->length)
+			break;
+		iov[n] = (PedIoVec) {
+			ebrs->buf + (ebrs->n + n) * dev->sector_size, s, 1 };
+		ebrs->sector[ebrs->n + n] = s;
+		n++;
+	}
+
+	/* A lone sector goes through the device's read cache.  The others
+	 * may not be EBRs at all, so errors reading a batch are kept quiet,
+	 * and only reported when the one the chain needs is read alone.
+	 */
+	if (n > 1) {
+		ped_exception_fetch_all ();
+		if (!ped_device_read_batch (dev, iov, n)) {
+			ped_exception_catch ();
+			n = 1;
+		}
+		ped_exception_leave_all ();
+	}
+	if (n == 1 && !ped_device_read (dev, iov[0].buffer, sector, 1))
+		return 0;
+	ebrs->n += n;
+	return ebr_lookup (dev, ebrs, sector, buf);
+}
+
+/* A file system found at the start of a partition.  */
+typedef struct {
+	PedSector			start;
+	PedSector			length;
+	const PedFileSystemType*	type;
+} ProbedFs;
+
+/* What msdos_read keeps from one pass over the label to the next.  The
+ * partitions don't move when the label is read again for another BIOS
+ * geometry, so neither do their file systems.
+ */
+typedef struct {
+	EbrReader	ebrs;
+	int		n_fs;		/* file systems probed, in order */
+	int		n_fs_alloc;
+	int		next_fs;	/* the one to expect next */
+	ProbedFs*	fs;
+	DosRawPartition	mbr[DOS_N_PRI_PARTITIONS];
+} DosReader;
+
+static void
+dos_reader_init (DosReader* rd)
+{
+	memset (rd, 0, sizeof *rd);
+	ebr_reader_init (&rd->ebrs);
+}
+
+static void
+dos_reader_rewind (DosReader* rd)
+{
+	ebr_reader_rewind (&rd->ebrs);
+	rd->next_fs = 0;
+}
+
+static void
+dos_reader_fini (DosReader* rd)
+{
+	ebr_reader_fini (&rd->ebrs);
+	free (rd->fs);
+}
+
+/* Like ped_file_system_probe, but only once per partition per read.  */
+static const PedFileSystemType*
+dos_reader_probe_fs (DosReader* rd, PedGeometry* geom)
+{
+	const PedFileSystemType*	type;
+
+	if (rd->next_fs < rd->n_fs) {
+		const ProbedFs* fs = &rd->fs[rd->next_fs];
+		if (fs->start == geom->start && fs->length == geom->length) {
+			rd->next_fs++;
+			return fs->type;
+		}
+	}
+
+	type = ped_file_system_probe (geom);
+
+	if (rd->n_fs == rd->n_fs_alloc) {
+		int		n_alloc = PED_MAX (rd->n_fs_alloc * 2, 16);
+		ProbedFs*	fs = realloc (rd->fs, n_alloc * sizeof *fs);
+		if (!fs)
+			return type;
+		rd->fs = fs;
+		rd->n_fs_alloc = n_alloc;
+	}
+	rd->fs[rd->n_fs++] = (ProbedFs) { geom->start, geom->length, type };
+	rd->next_fs = rd->n_fs;
+	return type;
+}
+
+static int
+read_table (PedDisk* disk, DosReader* rd, PedSector sector,
+	    int is_extended_table)
 {
 	int			i;
 	DosRawTable*		table;
@@ -1142,10 +1447,13 @@ read_table (PedDisk* disk, PedSector sector, int is_extended_table)
 	PED_ASSERT (disk->dev != NULL);
 
 	void *label = NULL;
-	if (!ptt_read_sector (disk->dev, sector, &label))
+	if (!(is_extended_table ? ebr_read (disk, &rd->ebrs, sector, &label)
+				: ptt_read_sector (disk->dev, sector, &label)))
 		goto error;
 
         table = (DosRawTable *) label;
+	if (!is_extended_table)
+		memcpy (rd->mbr, table->partitions, sizeof rd->mbr);
 
 	/* weird: empty extended partitions are filled with 0xf6 by PM */
 	if (is_extended_table
@@ -1205,7 +1513,7 @@ read_table (PedDisk* disk, PedSector sector, int is_extended_table)
 		if (!is_extended_table)
 			part->num = i + 1;
 		if (type != PED_PARTITION_EXTENDED)
-			part->fs_type = ped_file_system_probe (&part->geom);
+			part->fs_type = dos_reader_probe_fs (rd, &part->geom);
 
 		PedConstraint *constraint_exact
 		  = ped_constraint_exact (&part->geom);
@@ -1216,7 +1524,7 @@ read_table (PedDisk* disk, PedSector sector, int is_extended_table)
 
 		/* non-nested extended partition */
 		if (part->type == PED_PARTITION_EXTENDED) {
-			if (!read_table (disk, part->geom.start, 1))
+			if (!read_table (disk, rd, part->geom.start, 1))
 				goto error;
 		}
 	}
@@ -1239,7 +1547,7 @@ read_table (PedDisk* disk, PedSector sector, int is_extended_table)
 				 */
 				continue;
 			}
-			if (!read_table (disk, part_start, 1))
+			if (!read_table (disk, rd, part_start, 1))
 				goto error;
 		}
 	}
@@ -1255,20 +1563,26 @@ error:
 }
 
 static int
-msdos_read (PedDisk* disk)
+read_disk (PedDisk* disk, DosReader* rd)
 {
-	PED_ASSERT (disk != NULL);
-	PED_ASSERT (disk->dev != NULL);
-
 	ped_disk_delete_all (disk);
-	if (!read_table (disk, 0, 0))
+	dos_reader_rewind (rd);
+	if (!read_table (disk, rd, 0, 0))
 		return 0;
 
 #ifndef DISCOVER_ONLY
+	if (disk->open_flags & PED_DISK_OPEN_LBA_ONLY)
+		return 1;
+
 	/* try to figure out the correct BIOS CHS values */
 	if (!disk_check_bios_geometry (disk, &disk->dev->bios_geom)) {
 		PedCHSGeometry bios_geom = disk->dev->bios_geom;
-		disk_probe_bios_geometry (disk, &bios_geom);
+		if (!geom_memo_lookup (disk->dev, rd->mbr, &bios_geom)
+		    || !disk_check_bios_geometry (disk, &bios_geom)) {
+			bios_geom = disk->dev->bios_geom;
+			disk_probe_bios_geometry (disk, &bios_geom);
+			geom_memo_store (disk->dev, rd->mbr, &bios_geom);
+		}
 
 		/* if the geometry was wrong, then we should reread, to
 		 * make sure the metadata is allocated in the right places.
@@ -1277,7 +1591,7 @@ msdos_read (PedDisk* disk)
 		    || disk->dev->bios_geom.heads != bios_geom.heads
 		    || disk->dev->bios_geom.sectors != bios_geom.sectors) {
 			disk->dev->bios_geom = bios_geom;
-			return msdos_read (disk);
+			return read_disk (disk, rd);
 		}
 	}
 #endif
@@ -1285,6 +1599,21 @@ msdos_read (PedDisk* disk)
 	return 1;
 }
 
+static int
+msdos_read (PedDisk* disk)
+{
+	DosReader	rd;
+	int		ok;
+
+	PED_ASSERT (disk != NULL);
+	PED_ASSERT (disk->dev != NULL);
+
+	dos_reader_init (&rd);
+	ok = read_disk (disk, &rd);
+	dos_reader_fini (&rd);
+	return ok;
+}
+
 #ifndef DISCOVER_ONLY
 static int
 fill_raw_part (DosRawPartition* raw_part,
@@ -2609,4 +2938,10 @@ void
 ped_disk_msdos_done ()
 {
 	ped_disk_type_unregister (&msdos_disk_type);
+#ifndef DISCOVER_ONLY
+	for (int i = 0; i < GEOM_MEMO_SIZE; i++) {
+		free (geom_memo[i].path);
+		geom_memo[i].path = NULL;
+	}
+#endif
 }
@@ -50,6 +50,7 @@
 
 #include <config.h>
 #include <stdint.h>
+#include <parted/crc32.h>
 
 static const uint32_t crc32_tab[] = {
       0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
@@ -106,10 +107,11 @@ static const uint32_t crc32_tab[] = {
       0x2d02ef8dL
    };
 
-/* Return a 32-bit CRC of the contents of the buffer. */
+/* Return a 32-bit CRC of the contents of the buffer, a byte at a time.
+   This is the reference the faster versions below must agree with.  */
 
 uint32_t _GL_ATTRIBUTE_PURE
-__efi_crc32(const void *buf, unsigned long len, uint32_t seed)
+__efi_crc32_ref(const void *buf, unsigned long len, uint32_t seed)
 {
   unsigned long i;
   register uint32_t crc32val;
@@ -124,3 +126,217 @@ __efi_crc32(const void *buf, unsigned long len, uint32_t seed)
     }
   return crc32val;
 }
+
+/* Slicing-by-8: crc32_tab8[k][b] is the CRC of byte B followed by K zero
+   bytes, so eight bytes can be folded in with eight independent lookups.
+   crc32_tab8[0] is crc32_tab.  Filled in by efi_crc32_init.  */
+static uint32_t crc32_tab8[8][256];
+
+static inline uint32_t
+get_le32 (const unsigned char *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+uint32_t _GL_ATTRIBUTE_PURE
+__efi_crc32_slice8(const void *buf, unsigned long len, uint32_t seed)
+{
+  const unsigned char *s = buf;
+  uint32_t crc = seed;
+
+  for (; len >= 8; s += 8, len -= 8)
+    {
+      uint32_t lo = crc ^ get_le32 (s);
+      uint32_t hi = get_le32 (s + 4);
+      crc = (crc32_tab8[7][lo & 0xff] ^ crc32_tab8[6][(lo >> 8) & 0xff]
+             ^ crc32_tab8[5][(lo >> 16) & 0xff] ^ crc32_tab8[4][lo >> 24]
+             ^ crc32_tab8[3][hi & 0xff] ^ crc32_tab8[2][(hi >> 8) & 0xff]
+             ^ crc32_tab8[1][(hi >> 16) & 0xff] ^ crc32_tab8[0][hi >> 24]);
+    }
+  for (; len; s++, len--)
+    crc = crc32_tab[(crc ^ *s) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+# define HAVE_CRC32_HW 1
+# include <cpuid.h>
+# include <immintrin.h>
+
+/* Fold 64 bytes at a time with carry-less multiplication, then reduce to
+   32 bits, as in Intel's "Fast CRC Computation for Generic Polynomials
+   Using PCLMULQDQ Instruction".  LEN must be a multiple of 16, and at
+   least 64.  The constants are the bit-reflected x^(4*128+32) mod P,
+   x^(4*128-32) mod P, x^(128+32) mod P, x^(128-32) mod P, x^64 mod P,
+   then P itself and floor(x^64 / P) for the Barrett reduction.  */
+__attribute__ ((target ("pclmul,sse4.1")))
+static uint32_t
+crc32_clmul_fold (const unsigned char *s, unsigned long len, uint32_t crc)
+{
+  const __m128i k1k2 = _mm_set_epi64x (0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x (0x00ccaa009e, 0x01751997d0);
+  const __m128i k5 = _mm_set_epi64x (0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x (0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32 (~0, 0, ~0, 0);
+  __m128i x1, x2, x3, x4, t1, t2, t3, t4;
+
+  x1 = _mm_loadu_si128 ((const __m128i *) (s + 0x00));
+  x2 = _mm_loadu_si128 ((const __m128i *) (s + 0x10));
+  x3 = _mm_loadu_si128 ((const __m128i *) (s + 0x20));
+  x4 = _mm_loadu_si128 ((const __m128i *) (s + 0x30));
+  x1 = _mm_xor_si128 (x1, _mm_cvtsi32_si128 (crc));
+  s += 64;
+  len -= 64;
+
+  for (; len >= 64; s += 64, len -= 64)
+    {
+      t1 = _mm_clmulepi64_si128 (x1, k1k2, 0x00);
+      t2 = _mm_clmulepi64_si128 (x2, k1k2, 0x00);
+      t3 = _mm_clmulepi64_si128 (x3, k1k2, 0x00);
+      t4 = _mm_clmulepi64_si128 (x4, k1k2, 0x00);
+      x1 = _mm_clmulepi64_si128 (x1, k1k2, 0x11);
+      x2 = _mm_clmulepi64_si128 (x2, k1k2, 0x11);
+      x3 = _mm_clmulepi64_si128 (x3, k1k2, 0x11);
+      x4 = _mm_clmulepi64_si128 (x4, k1k2, 0x11);
+      x1 = _mm_xor_si128 (_mm_xor_si128 (x1, t1),
+                          _mm_loadu_si128 ((const __m128i *) (s + 0x00)));
+      x2 = _mm_xor_si128 (_mm_xor_si128 (x2, t2),
+                          _mm_loadu_si128 ((const __m128i *) (s + 0x10)));
+      x3 = _mm_xor_si128 (_mm_xor_si128 (x3, t3),
+                          _mm_loadu_si128 ((const __m128i *) (s + 0x20)));
+      x4 = _mm_xor_si128 (_mm_xor_si128 (x4, t4),
+                          _mm_loadu_si128 ((const __m128i *) (s + 0x30)));
+    }
+
+  /* Fold the four lanes, then any remaining 16-byte blocks, into one.  */
+  x2 = _mm_xor_si128 (x2, _mm_clmulepi64_si128 (x1, k3k4, 0x00));
+  x1 = _mm_xor_si128 (x2, _mm_clmulepi64_si128 (x1, k3k4, 0x11));
+  x3 = _mm_xor_si128 (x3, _mm_clmulepi64_si128 (x1, k3k4, 0x00));
+  x1 = _mm_xor_si128 (x3, _mm_clmulepi64_si128 (x1, k3k4, 0x11));
+  x4 = _mm_xor_si128 (x4, _mm_clmulepi64_si128 (x1, k3k4, 0x00));
+  x1 = _mm_xor_si128 (x4, _mm_clmulepi64_si128 (x1, k3k4, 0x11));
+  for (; len >= 16; s += 16, len -= 16)
+    {
+      x2 = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) s),
+                          _mm_clmulepi64_si128 (x1, k3k4, 0x00));
+      x1 = _mm_xor_si128 (x2, _mm_clmulepi64_si128 (x1, k3k4, 0x11));
+    }
+
+  /* 128 bits to 64.  */
+  x2 = _mm_clmulepi64_si128 (x1, k3k4, 0x10);
+  x1 = _mm_xor_si128 (_mm_srli_si128 (x1, 8), x2);
+  x2 = _mm_srli_si128 (x1, 4);
+  x1 = _mm_clmulepi64_si128 (_mm_and_si128 (x1, mask32), k5, 0x00);
+  x1 = _mm_xor_si128 (x1, x2);
+
+  /* Barrett reduction to 32 bits.  */
+  x2 = _mm_clmulepi64_si128 (_mm_and_si128 (x1, mask32), poly, 0x10);
+  x2 = _mm_clmulepi64_si128 (_mm_and_si128 (x2, mask32), poly, 0x00);
+  x1 = _mm_xor_si128 (x1, x2);
+  return _mm_extract_epi32 (x1, 1);
+}
+
+static uint32_t _GL_ATTRIBUTE_PURE
+crc32_hw (const void *buf, unsigned long len, uint32_t seed)
+{
+  const unsigned char *s = buf;
+  unsigned long n = len >= 64 ? len & ~15UL : 0;
+
+  if (n)
+    seed = crc32_clmul_fold (s, n, seed);
+  return __efi_crc32_slice8 (s + n, len - n, seed);
+}
+
+static const char *
+crc32_hw_probe (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (__get_cpuid (1, &eax, &ebx, &ecx, &edx)
+      && (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1))
+    return "pclmul";
+  return NULL;
+}
+
+#elif defined __aarch64__ && defined __linux__ && defined __GNUC__ \
+      && !defined __AARCH64EB__
+# define HAVE_CRC32_HW 1
+# include <arm_acle.h>
+# include <sys/auxv.h>
+# ifndef HWCAP_CRC32
+#  define HWCAP_CRC32 (1 << 7)
+# endif
+
+/* The ARMv8 CRC32 instructions use the same reflected polynomial, and
+   take and return the same unfinished CRC as crc32_tab.  */
+__attribute__ ((target ("arch=armv8-a+crc")))
+static uint32_t _GL_ATTRIBUTE_PURE
+crc32_hw (const void *buf, unsigned long len, uint32_t seed)
+{
+  const unsigned char *s = buf;
+  uint32_t crc = seed;
+
+  for (; len && ((uintptr_t) s & 7); s++, len--)
+    crc = __crc32b (crc, *s);
+  for (; len >= 8; s += 8, len -= 8)
+    crc = __crc32d (crc, *(const uint64_t *) s);
+  for (; len; s++, len--)
+    crc = __crc32b (crc, *s);
+  return crc;
+}
+
+static const char *
+crc32_hw_probe (void)
+{
+  return getauxval (AT_HWCAP) & HWCAP_CRC32 ? "armv8-crc" : NULL;
+}
+#endif
+
+static efi_crc32_fn crc32_impl = __efi_crc32_ref;
+static const char *crc32_hw_name;
+
+efi_crc32_fn
+__efi_crc32_hw (const char **name)
+{
+  if (name)
+    *name = crc32_hw_name;
+#ifdef HAVE_CRC32_HW
+  if (crc32_hw_name)
+    return crc32_hw;
+#endif
+  return NULL;
+}
+
+/* Build the slicing tables and pick the fastest implementation this CPU
+   can run.  Until this has run, __efi_crc32 uses the reference.  */
+static void efi_crc32_init (void) __attribute__ ((constructor));
+
+static void
+efi_crc32_init (void)
+{
+  for (int i = 0; i < 256; i++)
+    {
+      uint32_t crc = crc32_tab[i];
+      crc32_tab8[0][i] = crc;
+      for (int k = 1; k < 8; k++)
+        {
+          crc = crc32_tab[crc & 0xff] ^ (crc >> 8);
+          crc32_tab8[k][i] = crc;
+        }
+    }
+  crc32_impl = __efi_crc32_slice8;
+
+#ifdef HAVE_CRC32_HW
+  crc32_hw_name = crc32_hw_probe ();
+  if (crc32_hw_name)
+    crc32_impl = crc32_hw;
+#endif
+}
+
+/* Return a 32-bit CRC of the contents of the buffer. */
+
+uint32_t
+__efi_crc32(const void *buf, unsigned long len, uint32_t seed)
+{
+  return crc32_impl (buf, len, seed);
+}
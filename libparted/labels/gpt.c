@@ -343,6 +343,27 @@ struct __attribute__ ((packed)) _LegacyMBR_t
   uint16_t Signature;
 };
 
+/* What the last read or write left on disk, so that gpt_write can skip
+   the sectors that have not changed since.  */
+typedef struct _GPTOnDisk
+{
+  PedSector AlternateLBA;
+  int entry_count;
+  int pmbr_boot;		/* -1 if the pmbr must be rewritten */
+  uint8_t *pth_raw[2];		/* primary and backup header sectors */
+  uint8_t *ptes;		/* partition entry array, whole sectors */
+} GPTOnDisk;
+
+/* What gpt_read fetches up front, in a single batch: the protective MBR,
+   primary header and a default-sized entry array from the start of the
+   disk, and a default-sized entry array and the backup header from its
+   end.  Any other read falls back to the device.  */
+typedef struct _GPTReadPlan
+{
+  PedIoVec range[2];
+  int n_ranges;
+} GPTReadPlan;
+
 /* uses libparted's disk_specific field in PedDisk, to store our info */
 struct __attribute__ ((packed, aligned(8))) _GPTDiskData
 {
@@ -351,6 +372,9 @@ struct __attribute__ ((packed, aligned(8))) _GPTDiskData
   efi_guid_t uuid;
   int pmbr_boot;
   PedSector AlternateLBA;
+  GPTOnDisk *on_disk;		/* NULL if unknown */
+  GPTReadPlan *read_plan;	/* only set within gpt_read */
+  int backup_unverified;	/* read with PED_DISK_OPEN_LAZY_BACKUP */
 };
 
 /* uses libparted's disk_specific field in PedPartition, to store our info */
@@ -447,6 +471,130 @@ pth_get_raw (const PedDevice *dev, const GuidPartitionTableHeader_t *pth)
   return pth_raw;
 }
 
+/* Return the number of sectors gpt_write uses for an array of
+   ENTRY_COUNT entries.  */
+static inline PedSector
+gpt_ptes_sectors (const PedDevice *dev, int entry_count)
+{
+  return ped_div_round_up (entry_count * sizeof (GuidPartitionEntry_t),
+                           dev->sector_size);
+}
+
+static void
+gpt_on_disk_free (GPTOnDisk *on_disk)
+{
+  if (on_disk == NULL)
+    return;
+  free (on_disk->pth_raw[0]);
+  free (on_disk->pth_raw[1]);
+  free (on_disk->ptes);
+  free (on_disk);
+}
+
+/* Forget what is on disk, so that the next gpt_write writes everything.  */
+static void
+gpt_on_disk_forget (const PedDisk *disk)
+{
+  GPTDiskData *gpt_disk_data = disk->disk_specific;
+
+  gpt_on_disk_free (gpt_disk_data->on_disk);
+  gpt_disk_data->on_disk = NULL;
+}
+
+static void
+gpt_read_plan_free (GPTReadPlan *plan)
+{
+  if (plan == NULL)
+    return;
+  free (plan->range[0].buffer);
+  free (plan->range[1].buffer);
+  free (plan);
+}
+
+/* Read the sectors gpt_read will most likely need, so that a table of
+   the default size costs two ranges read at once instead of a round trip
+   per header and array.  With LAZY, leave out the end of the disk.
+   Return NULL if they could not be read.  */
+static GPTReadPlan *
+gpt_read_plan_new (const PedDevice *dev, bool lazy)
+{
+  PedSector array_sectors = ped_div_round_up
+    (GPT_DEFAULT_PARTITION_ENTRY_ARRAY_SIZE, dev->sector_size);
+  PedSector head = PED_MIN (GPT_PRIMARY_PART_TABLE_LBA + array_sectors,
+                            dev->length);
+  PedSector tail = PED_MIN (array_sectors + GPT_HEADER_SECTORS, dev->length);
+
+  GPTReadPlan *plan = ped_calloc (sizeof *plan);
+  if (plan == NULL)
+    return NULL;
+  plan->n_ranges = lazy ? 1 : 2;
+  plan->range[0] = (PedIoVec) { ped_malloc (head * dev->sector_size),
+                                0, head };
+  if (!lazy)
+    plan->range[1] = (PedIoVec) { ped_malloc (tail * dev->sector_size),
+                                  dev->length - tail, tail };
+  if (plan->range[0].buffer == NULL
+      || (!lazy && plan->range[1].buffer == NULL)
+      || !ped_device_read_batch ((PedDevice *) dev, plan->range,
+                                 plan->n_ranges))
+    {
+      gpt_read_plan_free (plan);
+      return NULL;
+    }
+  return plan;
+}
+
+static void
+gpt_read_plan_forget (const PedDisk *disk)
+{
+  GPTDiskData *gpt_disk_data = disk->disk_specific;
+
+  gpt_read_plan_free (gpt_disk_data->read_plan);
+  gpt_disk_data->read_plan = NULL;
+}
+
+/* Like ptt_read_sectors, but take the sectors from the read plan of DISK
+   when it has them.  */
+static int
+gpt_read_sectors (PedDisk const *disk, PedSector start, PedSector count,
+                  void **buf)
+{
+  GPTDiskData *gpt_disk_data = disk->disk_specific;
+  GPTReadPlan *plan = gpt_disk_data->read_plan;
+  size_t ss = disk->dev->sector_size;
+
+  if (plan)
+    {
+      for (int i = 0; i < plan->n_ranges; i++)
+        {
+          PedIoVec const *r = &plan->range[i];
+          if (r->start <= start && start + count <= r->start + r->count)
+            {
+              void *b = ped_malloc (count * ss);
+              if (b == NULL)
+                return 0;
+              memcpy (b, (char *) r->buffer + (start - r->start) * ss,
+                      count * ss);
+              *buf = b;
+              return 1;
+            }
+        }
+    }
+
+  void *b = ped_malloc (count * ss);
+  if (b == NULL)
+    return 0;
+  if (!ped_device_read (disk->dev, b, start, count))
+    {
+      int saved_errno = errno;
+      free (b);
+      errno = saved_errno;
+      return 0;
+    }
+  *buf = b;
+  return 1;
+}
+
 /**
  * swap_uuid_and_efi_guid() - converts between uuid formats
  * @uuid - uuid_t in either format (converts it to the other)
@@ -601,6 +749,9 @@ gpt_alloc (const PedDevice *dev)
   uuid_generate ((unsigned char *) &gpt_disk_data->uuid);
   swap_uuid_and_efi_guid (&gpt_disk_data->uuid);
   gpt_disk_data->pmbr_boot = 0;
+  gpt_disk_data->on_disk = NULL;
+  gpt_disk_data->read_plan = NULL;
+  gpt_disk_data->backup_unverified = 0;
   return disk;
 
 error_free_disk:
@@ -629,6 +780,7 @@ gpt_duplicate (const PedDisk *disk)
   new_disk_data->entry_count = old_disk_data->entry_count;
   new_disk_data->uuid = old_disk_data->uuid;
   new_disk_data->pmbr_boot = old_disk_data->pmbr_boot;
+  new_disk_data->backup_unverified = old_disk_data->backup_unverified;
   return new_disk;
 }
 
@@ -636,6 +788,7 @@ static void
 gpt_free (PedDisk *disk)
 {
   ped_disk_delete_all (disk);
+  gpt_on_disk_forget (disk);
   free (disk->disk_specific);
   _ped_disk_free (disk);
 }
@@ -658,19 +811,11 @@ gpt_read_PE_array (PedDisk const *disk, GuidPartitionTableHeader_t const *gpt,
       errno = ENOMEM;
       return NULL;
     }
-  void *ptes = ped_malloc (ptes_sectors * disk->dev->sector_size);
-  if (ptes == NULL)
+  void *ptes;
+  if (!gpt_read_sectors (disk, PED_LE64_TO_CPU (gpt->PartitionEntryLBA),
+                         ptes_sectors, &ptes))
     return NULL;
 
-  if (!ped_device_read (disk->dev, ptes,
-                        PED_LE64_TO_CPU (gpt->PartitionEntryLBA), ptes_sectors))
-    {
-      int saved_errno = errno;
-      free (ptes);
-      errno = saved_errno;
-      return NULL;
-    }
-
   return ptes;
 }
 
@@ -879,6 +1024,114 @@ _parse_part_entry (PedDisk *disk, GuidPartitionEntry_t *pte)
   return part;
 }
 
+#ifndef DISCOVER_ONLY
+/* Set up the protective partition record of PMBR, keeping the boot code
+   and everything else that is not ours.  */
+static void
+_fill_pmbr (LegacyMBR_t *pmbr, const PedDevice *dev, bool pmbr_boot)
+{
+  /* Zero out the legacy partitions.  */
+  memset (pmbr->PartitionRecord, 0, sizeof pmbr->PartitionRecord);
+
+  pmbr->Signature = PED_CPU_TO_LE16 (MSDOS_MBR_SIGNATURE);
+  pmbr->PartitionRecord[0].OSType = EFI_PMBR_OSTYPE_EFI;
+  pmbr->PartitionRecord[0].StartSector = 2;
+  pmbr->PartitionRecord[0].EndHead = 0xFF;
+  pmbr->PartitionRecord[0].EndSector = 0xFF;
+  pmbr->PartitionRecord[0].EndTrack = 0xFF;
+  pmbr->PartitionRecord[0].StartingLBA = PED_CPU_TO_LE32 (1);
+  if ((dev->length - 1ULL) > 0xFFFFFFFFULL)
+    pmbr->PartitionRecord[0].SizeInLBA = PED_CPU_TO_LE32 (0xFFFFFFFF);
+  else
+    pmbr->PartitionRecord[0].SizeInLBA = PED_CPU_TO_LE32 (dev->length - 1UL);
+  if (pmbr_boot)
+    pmbr->PartitionRecord[0].BootIndicator = 0x80;
+}
+
+/* Return true if _write_pmbr would leave MBR unchanged.  */
+static bool
+_pmbr_is_current (const LegacyMBR_t *mbr, const PedDevice *dev,
+                  bool pmbr_boot)
+{
+  LegacyMBR_t pmbr = *mbr;
+
+  _fill_pmbr (&pmbr, dev, pmbr_boot);
+  return memcmp (&pmbr, mbr, sizeof pmbr) == 0;
+}
+
+/* If the primary and backup GPT are laid out the way gpt_write would lay
+   them out, and describe the same partition entry array, return a record
+   of them for gpt_write to compare against.  Otherwise return NULL.  */
+static GPTOnDisk *
+gpt_on_disk_new (PedDisk const *disk,
+                 GuidPartitionTableHeader_t const *pri,
+                 GuidPartitionTableHeader_t const *bak)
+{
+  GPTDiskData *gpt_disk_data = disk->disk_specific;
+  int entry_count = PED_LE32_TO_CPU (pri->NumberOfPartitionEntries);
+  PedSector alt_lba = PED_LE64_TO_CPU (pri->AlternateLBA);
+
+  if (PED_LE32_TO_CPU (pri->SizeOfPartitionEntry)
+        != sizeof (GuidPartitionEntry_t)
+      || PED_LE32_TO_CPU (bak->SizeOfPartitionEntry)
+        != sizeof (GuidPartitionEntry_t)
+      || PED_LE32_TO_CPU (bak->NumberOfPartitionEntries) != entry_count
+      || pri->PartitionEntryArrayCRC32 != bak->PartitionEntryArrayCRC32
+      || PED_LE64_TO_CPU (pri->PartitionEntryLBA) != 2
+      || PED_LE64_TO_CPU (bak->PartitionEntryLBA)
+        != alt_lba - gpt_ptes_sectors (disk->dev, entry_count)
+      || alt_lba != gpt_disk_data->AlternateLBA)
+    return NULL;
+
+  GPTOnDisk *on_disk = ped_calloc (sizeof *on_disk);
+  if (on_disk == NULL)
+    return NULL;
+  on_disk->AlternateLBA = alt_lba;
+  on_disk->entry_count = entry_count;
+  on_disk->pmbr_boot = -1;
+  on_disk->pth_raw[0] = pth_get_raw (disk->dev, pri);
+  on_disk->pth_raw[1] = pth_get_raw (disk->dev, bak);
+  if (on_disk->pth_raw[0] == NULL || on_disk->pth_raw[1] == NULL)
+    {
+      gpt_on_disk_free (on_disk);
+      return NULL;
+    }
+  return on_disk;
+}
+
+/* The backup header must be at the end of the disk, or at what the
+   primary header PRI thinks is the end of the disk.  If it is not, offer
+   to move it there, by removing it and setting the AlternateLBA that the
+   next commit will write it to.  Return true if that was accepted.  */
+static bool
+_fix_backup_location (PedDisk const *disk,
+                      GuidPartitionTableHeader_t const *pri)
+{
+  GPTDiskData *gpt_disk_data = disk->disk_specific;
+
+  gpt_disk_data->AlternateLBA = PED_LE64_TO_CPU (pri->AlternateLBA);
+  PedSector pri_disk_end = _hdr_disk_end(disk, pri);
+
+  if (gpt_disk_data->AlternateLBA != disk->dev->length -1 &&
+      gpt_disk_data->AlternateLBA != pri_disk_end)
+    {
+      if (ped_exception_throw
+              (PED_EXCEPTION_ERROR,
+               (PED_EXCEPTION_FIX | PED_EXCEPTION_IGNORE),
+               _("The backup GPT table is not at the end of the disk, as it "
+                 "should be.  Fix, by moving the backup to the end "
+                 "(and removing the old backup)?")) == PED_EXCEPTION_FIX)
+        {
+          ptt_clear_sectors (disk->dev,
+                             PED_LE64_TO_CPU (pri->AlternateLBA), 1);
+          gpt_disk_data->AlternateLBA = disk->dev->length -1;
+          return true;
+        }
+    }
+  return false;
+}
+#endif /* !DISCOVER_ONLY */
+
 /* Read the primary GPT at sector 1 of DEV.
    Verify its CRC and that of its partition entry array.
    If they are valid, read the backup GPT specified by AlternateLBA.
@@ -887,28 +1140,35 @@ _parse_part_entry (PedDisk *disk, GuidPartitionEntry_t *pte)
    Upon successful verification of the primary GPT, set *PRIMARY_GPT, else NULL.
    Upon successful verification of the backup GPT, set *BACKUP_GPT, else NULL.
    If we've set *BACKUP_GPT to non-NULL, set *BACKUP_SECTOR_NUM_P to the sector
-   number in which it was found.  */
+   number in which it was found.
+   With LAZY, don't read the backup GPT if the primary one is valid.
+   Set *PMBR_CURRENT to whether the protective MBR needs no rewriting.  */
 static int
 gpt_read_headers (PedDisk const *disk,
                   GuidPartitionTableHeader_t **primary_gpt,
                   GuidPartitionTableHeader_t **backup_gpt,
-                  PedSector *backup_sector_num_p)
+                  PedSector *backup_sector_num_p,
+                  bool lazy, bool *pmbr_current)
 {
   *primary_gpt = NULL;
   *backup_gpt = NULL;
+  *pmbr_current = false;
   PedDevice const *dev = disk->dev;
   GPTDiskData *gpt_disk_data = disk->disk_specific;
   LegacyMBR_t *mbr;
 
-  if (!ptt_read_sector (dev, 0, (void *)&mbr))
+  if (!gpt_read_sectors (disk, 0, 1, (void *)&mbr))
     return 1;
 
   if (mbr->PartitionRecord[0].BootIndicator == 0x80)
     gpt_disk_data->pmbr_boot = 1;
+#ifndef DISCOVER_ONLY
+  *pmbr_current = _pmbr_is_current (mbr, dev, gpt_disk_data->pmbr_boot);
+#endif
   free (mbr);
 
   void *s1;
-  if (!ptt_read_sector (dev, 1, &s1))
+  if (!gpt_read_sectors (disk, 1, 1, &s1))
     return 1;
 
   GuidPartitionTableHeader_t *t = pth_new_from_raw (dev, s1);
@@ -927,9 +1187,11 @@ gpt_read_headers (PedDisk const *disk,
     (valid_primary
      ? PED_LE64_TO_CPU (pri->AlternateLBA)
      : dev->length - 1);
+  if (valid_primary && lazy)
+    return 0;
 
   void *s_bak;
-  if (!ptt_read_sector (dev, gpt_disk_data->AlternateLBA ,&s_bak))
+  if (!gpt_read_sectors (disk, gpt_disk_data->AlternateLBA, 1, &s_bak))
     return 1;
   t = pth_new_from_raw (dev, s_bak);
   free (s_bak);
@@ -980,18 +1242,25 @@ gpt_read (PedDisk *disk)
 #endif
 
   ped_disk_delete_all (disk);
+  gpt_on_disk_forget (disk);
 
   /* motivation: let the user decide about the pmbr... during
      ped_disk_probe(), they probably didn't get a choice... */
   if (!gpt_probe (disk->dev))
     goto error;
 
+  bool lazy = disk->open_flags & PED_DISK_OPEN_LAZY_BACKUP;
+  gpt_disk_data->backup_unverified = 0;
+  gpt_disk_data->read_plan = gpt_read_plan_new (disk->dev, lazy);
+
   GuidPartitionTableHeader_t *gpt = NULL;
   GuidPartitionTableHeader_t *primary_gpt;
   GuidPartitionTableHeader_t *backup_gpt;
   PedSector backup_sector_num;
+  bool pmbr_current;
   int read_failure = gpt_read_headers (disk, &primary_gpt, &backup_gpt,
-                                       &backup_sector_num);
+                                       &backup_sector_num, lazy,
+                                       &pmbr_current);
   if (read_failure)
     {
       /* This includes the case in which there used to be a GPT partition
@@ -1004,6 +1273,7 @@ gpt_read (PedDisk *disk)
          is officially invalid.  */
       pth_free (backup_gpt);
       pth_free (primary_gpt);
+      gpt_read_plan_forget (disk);
       return 0;
     }
 
@@ -1011,27 +1281,17 @@ gpt_read (PedDisk *disk)
     {
       /* Both are valid.  */
 #ifndef DISCOVER_ONLY
-      /* The backup header must be at the end of the disk, or at what the primary
-       * header thinks is the end of the disk.
-       */
-      gpt_disk_data->AlternateLBA = PED_LE64_TO_CPU (primary_gpt->AlternateLBA);
-      PedSector pri_disk_end = _hdr_disk_end(disk, primary_gpt);
-
-      if (gpt_disk_data->AlternateLBA != disk->dev->length -1 &&
-          gpt_disk_data->AlternateLBA != pri_disk_end)
+      if (_fix_backup_location (disk, primary_gpt))
+        write_back = 1;
+
+      /* Remember both, so that a commit can skip what it would not
+         change.  */
+      if (!write_back)
         {
-          if (ped_exception_throw
-                  (PED_EXCEPTION_ERROR,
-                   (PED_EXCEPTION_FIX | PED_EXCEPTION_IGNORE),
-                   _("The backup GPT table is not at the end of the disk, as it "
-                     "should be.  Fix, by moving the backup to the end "
-                     "(and removing the old backup)?")) == PED_EXCEPTION_FIX)
-            {
-              ptt_clear_sectors (disk->dev,
-                                 PED_LE64_TO_CPU (primary_gpt->AlternateLBA), 1);
-              gpt_disk_data->AlternateLBA = disk->dev->length -1;
-              write_back = 1;
-            }
+          gpt_disk_data->on_disk = gpt_on_disk_new (disk, primary_gpt,
+                                                    backup_gpt);
+          if (gpt_disk_data->on_disk && pmbr_current)
+            gpt_disk_data->on_disk->pmbr_boot = gpt_disk_data->pmbr_boot;
         }
 #endif /* !DISCOVER_ONLY */
       pth_free (backup_gpt);
@@ -1045,7 +1305,14 @@ gpt_read (PedDisk *disk)
                              "are corrupt.  Try making a fresh table, "
                              "and using Parted's rescue feature to "
                              "recover partitions."));
-      goto error;
+      goto error_free_gpt;
+    }
+  else if (primary_gpt && !backup_gpt && lazy)
+    {
+      /* The backup was not read.  gpt_check_backup reads it if a check
+         or a commit asks for it.  */
+      gpt_disk_data->backup_unverified = 1;
+      gpt = primary_gpt;
     }
   else if (primary_gpt && !backup_gpt)
     {
@@ -1079,6 +1346,7 @@ gpt_read (PedDisk *disk)
 
   size_t ptes_bytes;
   void *ptes = gpt_read_PE_array (disk, gpt, &ptes_bytes);
+  gpt_read_plan_forget (disk);
   if (ptes == NULL)
     goto error_free_gpt;
 
@@ -1118,11 +1386,23 @@ gpt_read (PedDisk *disk)
         }
       ped_constraint_destroy (constraint_exact);
     }
+
+  if (gpt_disk_data->on_disk && !write_back)
+    {
+      gpt_disk_data->on_disk->ptes = ptes;
+      ptes = NULL;
+    }
+  else
+    gpt_on_disk_forget (disk);
   free (ptes);
 
 #ifndef DISCOVER_ONLY
   if (write_back)
-    ped_disk_commit_to_dev (disk);
+    {
+      /* Whatever the backup held, it is about to be replaced.  */
+      gpt_disk_data->backup_unverified = 0;
+      ped_disk_commit_to_dev (disk);
+    }
 #endif
 
   pth_free (gpt);
@@ -1133,6 +1413,7 @@ error_delete_all:
 error_free_ptes:
   free (ptes);
 error_free_gpt:
+  gpt_read_plan_forget (disk);
   pth_free (primary_gpt);
   pth_free (backup_gpt);
   pth_free (gpt);
@@ -1154,22 +1435,7 @@ _write_pmbr (PedDevice *dev, bool pmbr_boot)
     return 0;
   LegacyMBR_t *pmbr = s0;
 
-  /* Zero out the legacy partitions.  */
-  memset (pmbr->PartitionRecord, 0, sizeof pmbr->PartitionRecord);
-
-  pmbr->Signature = PED_CPU_TO_LE16 (MSDOS_MBR_SIGNATURE);
-  pmbr->PartitionRecord[0].OSType = EFI_PMBR_OSTYPE_EFI;
-  pmbr->PartitionRecord[0].StartSector = 2;
-  pmbr->PartitionRecord[0].EndHead = 0xFF;
-  pmbr->PartitionRecord[0].EndSector = 0xFF;
-  pmbr->PartitionRecord[0].EndTrack = 0xFF;
-  pmbr->PartitionRecord[0].StartingLBA = PED_CPU_TO_LE32 (1);
-  if ((dev->length - 1ULL) > 0xFFFFFFFFULL)
-    pmbr->PartitionRecord[0].SizeInLBA = PED_CPU_TO_LE32 (0xFFFFFFFF);
-  else
-    pmbr->PartitionRecord[0].SizeInLBA = PED_CPU_TO_LE32 (dev->length - 1UL);
-  if (pmbr_boot)
-    pmbr->PartitionRecord[0].BootIndicator = 0x80;
+  _fill_pmbr (pmbr, dev, pmbr_boot);
 
   int write_ok = ped_device_write (dev, pmbr, GPT_PMBR_LBA,
                                    GPT_PMBR_SECTORS);
@@ -1249,14 +1515,174 @@ _partition_generate_part_entry (PedPartition *part, GuidPartitionEntry_t *pte)
     pte->PartitionName[i] = gpt_part_data->name[i];
 }
 
+/* Generate the raw primary (ALTERNATE == 0) or backup header sector.  */
+static uint8_t *
+_generate_header_raw (const PedDisk *disk, int alternate, uint32_t ptes_crc)
+{
+  GuidPartitionTableHeader_t *gpt;
+  uint8_t *pth_raw = NULL;
+
+  if (_generate_header (disk, alternate, ptes_crc, &gpt) == 0)
+    pth_raw = pth_get_raw (disk->dev, gpt);
+  pth_free (gpt);
+  return pth_raw;
+}
+
+/* Return true if the sectors recorded in ON_DISK are still what is on
+   the device, and are laid out as gpt_write would lay them out now.  */
+static bool
+_on_disk_is_current (const PedDisk *disk, const GPTOnDisk *on_disk)
+{
+  GPTDiskData *gpt_disk_data = disk->disk_specific;
+  size_t ss = disk->dev->sector_size;
+
+  if (on_disk == NULL || on_disk->ptes == NULL
+      || on_disk->AlternateLBA != gpt_disk_data->AlternateLBA
+      || on_disk->entry_count != gpt_disk_data->entry_count)
+    return false;
+
+  /* Someone else may have written a new table since.  Their headers
+     would differ from ours, if only in the array CRC.  */
+  uint8_t *buf = ped_malloc (2 * ss);
+  if (buf == NULL)
+    return false;
+  PedIoVec iov[2] = {
+    { buf, GPT_PRIMARY_HEADER_LBA, GPT_HEADER_SECTORS },
+    { buf + ss, on_disk->AlternateLBA, GPT_HEADER_SECTORS },
+  };
+  bool current = (ped_device_read_batch (disk->dev, iov, 2)
+                  && memcmp (buf, on_disk->pth_raw[0], ss) == 0
+                  && memcmp (buf + ss, on_disk->pth_raw[1], ss) == 0);
+  free (buf);
+  return current;
+}
+
+/* Write those of PTH_RAW and of the PTES_SECTORS sectors of PTES that
+   differ from ON_DISK, to both the primary and the backup GPT.  */
+static int
+_write_changed_sectors (PedDisk const *disk, GPTOnDisk const *on_disk,
+                        uint8_t *const pth_raw[2], uint8_t *ptes,
+                        PedSector ptes_sectors)
+{
+  GPTDiskData *gpt_disk_data = disk->disk_specific;
+  size_t ss = disk->dev->sector_size;
+  PedSector ptes_lba[2] = {
+    GPT_PRIMARY_PART_TABLE_LBA,
+    gpt_disk_data->AlternateLBA - ptes_sectors
+  };
+  PedSector pth_lba[2] = {
+    GPT_PRIMARY_HEADER_LBA,
+    gpt_disk_data->AlternateLBA
+  };
+
+  /* At most one range per header, and one per run of changed sectors,
+     which are at least one unchanged sector apart.  */
+  PedIoVec *iov = ped_malloc ((ptes_sectors + 3) * sizeof *iov);
+  if (iov == NULL)
+    return 0;
+
+  int n = 0;
+  for (int alternate = 0; alternate <= 1; alternate++)
+    {
+      if (memcmp (pth_raw[alternate], on_disk->pth_raw[alternate], ss) != 0)
+        iov[n++] = (PedIoVec) { pth_raw[alternate], pth_lba[alternate],
+                                GPT_HEADER_SECTORS };
+
+      PedSector i = 0;
+      while (i < ptes_sectors)
+        {
+          if (memcmp (ptes + i * ss, on_disk->ptes + i * ss, ss) == 0)
+            {
+              i++;
+              continue;
+            }
+          PedSector run = i;
+          while (i < ptes_sectors
+                 && memcmp (ptes + i * ss, on_disk->ptes + i * ss, ss) != 0)
+            i++;
+          iov[n++] = (PedIoVec) { ptes + run * ss, ptes_lba[alternate] + run,
+                                  i - run };
+        }
+    }
+
+  int ok = n == 0 || ped_device_write_batch (disk->dev, iov, n);
+  free (iov);
+  return ok;
+}
+
+/* Read and check the backup GPT that gpt_read skipped because of
+   PED_DISK_OPEN_LAZY_BACKUP, asking what gpt_read would have asked.
+   If the backup is to be moved and we are not COMMITTING already, commit
+   right away, as gpt_read does.  Return 0 if the user cancelled or the
+   device could not be read.  */
+static int
+gpt_check_backup (const PedDisk *disk, bool committing)
+{
+  GPTDiskData *gpt_disk_data = disk->disk_specific;
+  PedDevice *dev = disk->dev;
+  GuidPartitionTableHeader_t *pri = NULL;
+  GuidPartitionTableHeader_t *bak = NULL;
+  bool fixed = false;
+  int ok = 0;
+  void *s;
+
+  if (!gpt_disk_data->backup_unverified)
+    return 1;
+  if (!ped_device_open (dev))
+    return 0;
+
+  if (!ptt_read_sector (dev, GPT_PRIMARY_HEADER_LBA, &s))
+    goto done;
+  pri = pth_new_from_raw (dev, s);
+  free (s);
+  if (pri == NULL)
+    goto done;
+
+  PedSector alt_lba = PED_LE64_TO_CPU (pri->AlternateLBA);
+  if (!ptt_read_sector (dev, alt_lba, &s))
+    goto done;
+  bak = pth_new_from_raw (dev, s);
+  free (s);
+  if (bak == NULL)
+    goto done;
+
+  if (!_header_is_valid (disk, bak, alt_lba))
+    {
+      if (ped_exception_throw
+          (PED_EXCEPTION_ERROR, PED_EXCEPTION_OK_CANCEL,
+           _("The backup GPT table is corrupt, but the "
+             "primary appears OK, so that will be used."))
+          == PED_EXCEPTION_CANCEL)
+        goto done;
+    }
+  else if (gpt_disk_data->AlternateLBA == alt_lba)
+    fixed = _fix_backup_location (disk, pri);
+
+  gpt_disk_data->backup_unverified = 0;
+  ok = !fixed || committing || ped_disk_commit_to_dev ((PedDisk *) disk);
+
+done:
+  pth_free (pri);
+  pth_free (bak);
+  ped_device_close (dev);
+  return ok;
+}
+
+static int
+gpt_check (const PedDisk *disk)
+{
+  return gpt_check_backup (disk, false);
+}
+
 static int
 gpt_write (const PedDisk *disk)
 {
   GPTDiskData *gpt_disk_data;
+  GPTOnDisk *on_disk;
   uint32_t ptes_crc;
-  uint8_t *pth_raw;
-  GuidPartitionTableHeader_t *gpt;
+  uint8_t *pth_raw[2] = { NULL, NULL };
   PedPartition *part;
+  int write_ok;
 
   PED_ASSERT (disk != NULL);
   PED_ASSERT (disk->dev != NULL);
@@ -1264,10 +1690,14 @@ gpt_write (const PedDisk *disk)
 
   gpt_disk_data = disk->disk_specific;
 
+  if (!gpt_check_backup (disk, true))
+    goto error;
+
   size_t ptes_bytes = (gpt_disk_data->entry_count
 			* sizeof (GuidPartitionEntry_t));
   size_t ss = disk->dev->sector_size;
-  PedSector ptes_sectors = (ptes_bytes + ss - 1) / ss;
+  PedSector ptes_sectors = gpt_ptes_sectors (disk->dev,
+                                             gpt_disk_data->entry_count);
   /* Note that we allocate a little more than ptes_bytes,
      when that number is not a multiple of sector size.  */
   GuidPartitionEntry_t *ptes = calloc (ptes_sectors, ss);
@@ -1283,49 +1713,71 @@ gpt_write (const PedDisk *disk)
 
   ptes_crc = efi_crc32 (ptes, ptes_bytes);
 
+  pth_raw[0] = _generate_header_raw (disk, 0, ptes_crc);
+  pth_raw[1] = _generate_header_raw (disk, 1, ptes_crc);
+  if (pth_raw[0] == NULL || pth_raw[1] == NULL)
+    goto error_free_ptes;
+
+  /* If the table on disk is the one we last read or wrote, only write
+     the sectors that changed.  An unchanged entry array means unchanged
+     headers too, unless the disk GUID or usable area changed.  */
+  on_disk = gpt_disk_data->on_disk;
+  if (_on_disk_is_current (disk, on_disk))
+    {
+      if (on_disk->pmbr_boot != gpt_disk_data->pmbr_boot
+          && !_write_pmbr (disk->dev, gpt_disk_data->pmbr_boot))
+        goto error_free_ptes;
+      if (!_write_changed_sectors (disk, on_disk, pth_raw, (uint8_t *) ptes,
+                                   ptes_sectors))
+        goto error_free_ptes;
+      goto done;
+    }
+
   /* Write protective MBR */
   if (!_write_pmbr (disk->dev, gpt_disk_data->pmbr_boot))
     goto error_free_ptes;
 
   /* Write PTH and PTEs */
-  /* FIXME: Caution: this code is nearly identical to what's just below. */
-  if (_generate_header (disk, 0, ptes_crc, &gpt) != 0) {
-      pth_free(gpt);
-      goto error_free_ptes;
-  }
-  pth_raw = pth_get_raw (disk->dev, gpt);
-  pth_free (gpt);
-  if (pth_raw == NULL)
-    goto error_free_ptes;
-  int write_ok = ped_device_write (disk->dev, pth_raw, 1, 1);
-  free (pth_raw);
+  write_ok = ped_device_write (disk->dev, pth_raw[0], 1, 1);
   if (!write_ok)
     goto error_free_ptes;
   if (!ped_device_write (disk->dev, ptes, 2, ptes_sectors))
     goto error_free_ptes;
 
   /* Write Alternate PTH & PTEs */
-  /* FIXME: Caution: this code is nearly identical to what's just above. */
-  if (_generate_header (disk, 1, ptes_crc, &gpt) != 0) {
-      pth_free(gpt);
-      goto error_free_ptes;
-  }
-  pth_raw = pth_get_raw (disk->dev, gpt);
-  pth_free (gpt);
-  if (pth_raw == NULL)
-    goto error_free_ptes;
-  write_ok = ped_device_write (disk->dev, pth_raw, gpt_disk_data->AlternateLBA, 1);
-  free (pth_raw);
+  write_ok = ped_device_write (disk->dev, pth_raw[1],
+                               gpt_disk_data->AlternateLBA, 1);
   if (!write_ok)
     goto error_free_ptes;
   if (!ped_device_write (disk->dev, ptes,
                          gpt_disk_data->AlternateLBA - ptes_sectors, ptes_sectors))
     goto error_free_ptes;
 
+done:
+  /* Remember what is on disk now, for the next commit.  */
+  gpt_on_disk_forget (disk);
+  on_disk = ped_malloc (sizeof *on_disk);
+  if (on_disk)
+    {
+      on_disk->AlternateLBA = gpt_disk_data->AlternateLBA;
+      on_disk->entry_count = gpt_disk_data->entry_count;
+      on_disk->pmbr_boot = gpt_disk_data->pmbr_boot;
+      on_disk->pth_raw[0] = pth_raw[0];
+      on_disk->pth_raw[1] = pth_raw[1];
+      on_disk->ptes = (uint8_t *) ptes;
+      gpt_disk_data->on_disk = on_disk;
+      return ped_device_sync (disk->dev);
+    }
+
+  free (pth_raw[0]);
+  free (pth_raw[1]);
   free (ptes);
   return ped_device_sync (disk->dev);
 
 error_free_ptes:
+  gpt_on_disk_forget (disk);
+  free (pth_raw[0]);
+  free (pth_raw[1]);
   free (ptes);
 error:
   return 0;
@@ -1900,6 +2352,7 @@ static PedDiskOps gpt_disk_ops =
 {
   clobber:			NULL,
   write:			NULL_IF_DISCOVER_ONLY (gpt_write),
+  check:			NULL_IF_DISCOVER_ONLY (gpt_check),
 
   partition_set_name:		gpt_partition_set_name,
   partition_get_name:		gpt_partition_get_name,
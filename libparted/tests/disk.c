@@ -85,6 +85,72 @@ START_TEST (test_duplicate)
 }
 END_TEST
 
+/* TEST: Look up partitions by number while they are added, removed
+   and renumbered */
+START_TEST (test_partition_numbers)
+{
+        PedDevice* dev = ped_device_get (temporary_disk);
+        if (dev == NULL)
+                return;
+
+        PedDisk* disk;
+        PedPartition *part;
+        PedPartition *next;
+        PedConstraint *constraint;
+
+        disk = _create_disk_label (dev, ped_disk_type_get ("msdos"));
+        constraint = ped_constraint_any (dev);
+
+        part = ped_partition_new (disk, PED_PARTITION_EXTENDED, NULL,
+                                  32, 39999);
+        ped_disk_add_partition (disk, part, constraint);
+
+        /* Logical partitions 5 to 12, 4000 sectors each */
+        for (int i = 0; i < 8; i++) {
+                part = ped_partition_new (disk, PED_PARTITION_LOGICAL,
+                                          ped_file_system_type_get ("ext2"),
+                                          2048 + i * 4096,
+                                          2048 + i * 4096 + 3999);
+                ped_disk_add_partition (disk, part, constraint);
+        }
+
+        ck_assert_int_eq (ped_disk_get_last_partition_num (disk), 12);
+        for (int i = 5; i <= 12; i++) {
+                part = ped_disk_get_partition (disk, i);
+                ck_assert_msg (part != NULL && part->num == i,
+                               "Partition %d not found", i);
+        }
+        ck_assert (ped_disk_get_partition (disk, 2) == NULL);
+        ck_assert (ped_disk_get_partition (disk, 13) == NULL);
+
+        /* Deleting a logical partition renumbers the ones after it */
+        part = ped_disk_get_partition (disk, 7);
+        next = ped_disk_get_partition (disk, 8);
+        ped_disk_delete_partition (disk, part);
+
+        ck_assert_int_eq (ped_disk_get_last_partition_num (disk), 11);
+        ck_assert (ped_disk_get_partition (disk, 12) == NULL);
+        for (int i = 5; i <= 11; i++) {
+                part = ped_disk_get_partition (disk, i);
+                ck_assert_msg (part != NULL && part->num == i,
+                               "Partition %d not found after delete", i);
+        }
+        ck_assert (ped_disk_get_partition (disk, 7) == next);
+
+        /* Refill the gap; it gets the next free number */
+        part = ped_partition_new (disk, PED_PARTITION_LOGICAL,
+                                  ped_file_system_type_get ("ext2"),
+                                  2048 + 2 * 4096, 2048 + 2 * 4096 + 3999);
+        ped_disk_add_partition (disk, part, constraint);
+        ck_assert_int_eq (ped_disk_get_last_partition_num (disk), 12);
+        ck_assert (ped_disk_get_partition (disk, part->num) == part);
+
+        ped_constraint_destroy (constraint);
+        ped_disk_destroy (disk);
+        ped_device_destroy (dev);
+}
+END_TEST
+
 int
 main (int argc, char **argv)
 {
@@ -102,6 +168,11 @@ main (int argc, char **argv)
         tcase_set_timeout (tcase_duplicate, 0);
         suite_add_tcase (suite, tcase_duplicate);
 
+        TCase* tcase_numbers = tcase_create ("Partition numbers");
+        tcase_add_checked_fixture (tcase_numbers, create_disk, destroy_disk);
+        tcase_add_test (tcase_numbers, test_partition_numbers);
+        suite_add_tcase (suite, tcase_numbers);
+
         SRunner* srunner = srunner_create (suite);
         srunner_run_all (srunner, CK_VERBOSE);
 
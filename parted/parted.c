@@ -79,6 +79,9 @@ static int MEGABYTE_SECTORS (PedDevice* dev)
 enum
 {
   PRETEND_INPUT_TTY = CHAR_MAX + 1,
+  JOBS_OPTION,
+  RESCUE_REPORT_OPTION,
+  BATCH_OPTION,
 };
 
 /* Output modes */
@@ -115,6 +118,18 @@ static int const align_types[] =
 };
 ARGMATCH_VERIFY (align_args, align_types);
 
+static char const *const rescue_report_args[] =
+{
+  "json",
+  NULL
+};
+
+static int const rescue_report_types[] =
+{
+  JSON
+};
+ARGMATCH_VERIFY (rescue_report_args, rescue_report_types);
+
 typedef struct {
         time_t  last_update;
         time_t  predicted_time_left;
@@ -130,6 +145,9 @@ static struct option const options[] = {
         {"fix",         0, NULL, 'f'},
         {"version",     0, NULL, 'v'},
         {"align",       required_argument, NULL, 'a'},
+        {"jobs",        required_argument, NULL, JOBS_OPTION},
+        {"rescue-report", required_argument, NULL, RESCUE_REPORT_OPTION},
+        {"batch",       0, NULL, BATCH_OPTION},
         {"-pretend-input-tty", 0, NULL, PRETEND_INPUT_TTY},
         {NULL,          0, NULL, 0}
 };
@@ -143,6 +161,12 @@ static const char *const options_help [][2] = {
         {"fix",         N_("in script mode, fix instead of abort when asked")},
         {"version",     N_("displays the version")},
         {"align=[none|cyl|min|opt]", N_("alignment for new partitions")},
+        {"jobs=N",      N_("with --list or rescue, read up to N devices or "
+                           "parts of the searched region at once")},
+        {"rescue-report=json", N_("with rescue, list the file systems found "
+                                  "instead of adding partitions")},
+        {"batch",       N_("write the partition table once, after all "
+                           "commands")},
         {NULL,          NULL}
 };
 
@@ -153,6 +177,9 @@ int     opt_output_mode = HUMAN;
 int     disk_is_modified = 0;
 int     is_toggle_mode = 0;
 int     alignment = ALIGNMENT_OPTIMAL;
+int     opt_jobs = 1;
+int     opt_rescue_report = 0;
+int     opt_batch_mode = 0;
 
 static const char* number_msg = N_(
 "NUMBER is the partition number used by Linux.  On MS-DOS disk labels, the "
@@ -499,16 +526,38 @@ print_commands_help ()
                 command_print_summary (commands [i]);
 }
 
+/* The short form of the option described by HELP, or 0 if it has none */
+static int
+_short_option (const char* help)
+{
+        size_t                  len = strcspn (help, "=");
+        const struct option*    opt;
+
+        for (opt = options; opt->name; opt++) {
+                if (strlen (opt->name) == len
+                    && strncmp (opt->name, help, len) == 0)
+                        return opt->val <= CHAR_MAX ? opt->val : 0;
+        }
+        return 0;
+}
+
 void
 print_options_help ()
 {
         int             i;
 
         for (i=0; options_help [i][0]; i++) {
-                printf ("  -%c, --%-25.25s %s\n",
-                        options_help [i][0][0],
-                        options_help [i][0],
-                        _(options_help [i][1]));
+                int     short_opt = _short_option (options_help [i][0]);
+
+                if (short_opt)
+                        printf ("  -%c, --%-25.25s %s\n",
+                                short_opt,
+                                options_help [i][0],
+                                _(options_help [i][1]));
+                else
+                        printf ("      --%-25.25s %s\n",
+                                options_help [i][0],
+                                _(options_help [i][1]));
         }
 }
 
@@ -527,6 +576,13 @@ do_help (PedDevice** dev, PedDisk** diskp)
         return 1;
 }
 
+/* Write what --batch has held back of DISK, before it is dropped.  */
+static int
+_disk_end_batch (PedDisk* disk)
+{
+        return !ped_disk_in_batch (disk) || ped_disk_end_batch (disk);
+}
+
 static int
 do_mklabel (PedDevice** dev, PedDisk** diskp)
 {
@@ -556,6 +612,9 @@ do_mklabel (PedDevice** dev, PedDisk** diskp)
         if (!disk)
                 goto error;
 
+        /* The old table goes, and with it whatever was to be written.  */
+        if (opt_batch_mode && !ped_disk_begin_batch (disk))
+                goto error_destroy_disk;
         if (!ped_disk_commit (disk))
                 goto error_destroy_disk;
 
@@ -1258,6 +1317,9 @@ _print_disk_info (const PedDevice *dev, const PedDisk *diskp)
         free (disk_flags);
 }
 
+/* How do_print reads a partition table; set while listing all devices.  */
+static int print_open_flags;
+
 static int
 do_print (PedDevice** dev, PedDisk** diskp)
 {
@@ -1303,7 +1365,8 @@ do_print (PedDevice** dev, PedDisk** diskp)
 
         if (!has_devices_arg && !has_list_arg) {
                 if (!*diskp)
-                        *diskp = ped_disk_new (*dev);
+                        *diskp = ped_disk_new_with_flags (*dev,
+                                                          print_open_flags);
                 /* Returning NULL here is an indication of failure, when in
                    script mode.  Otherwise (interactive mode) it may indicate
                    a real error, but it may also indicate that the user
@@ -1620,22 +1683,41 @@ nopt:
         return ok;
 }
 
+static int
+_print_list_dev (PedDevice* dev, void* data)
+{
+        PedDisk *diskp = NULL;
+
+        /* Listing is read-only, so don't go to the end of each device for
+           backup copies of the partition tables.  */
+        print_open_flags = PED_DISK_OPEN_LAZY_BACKUP;
+        do_print (&dev, &diskp);
+        print_open_flags = 0;
+        if (diskp)
+                ped_disk_destroy (diskp);
+        putchar ('\n');
+        return 1;
+}
+
 static int
 _print_list ()
 {
         PedDevice *current_dev = NULL;
-        PedDisk *diskp = NULL;
+        PedDevice **devs = NULL;
+        int n_devs = 0;
 
         ped_device_probe_all();
 
         while ((current_dev = ped_device_get_next(current_dev))) {
-                do_print (&current_dev, &diskp);
-                if (diskp)
-                        ped_disk_destroy (diskp);
-                diskp = 0;
-                putchar ('\n');
+                devs = xrealloc (devs, (n_devs + 1) * sizeof *devs);
+                devs[n_devs++] = current_dev;
         }
 
+        /* Devices are printed in order, but with --jobs the ones that
+           come next are read in the background meanwhile.  */
+        ped_device_scan (devs, n_devs, opt_jobs, _print_list_dev, NULL);
+        free (devs);
+
         return 1;
 }
 
@@ -1722,95 +1804,174 @@ _rescue_add_partition (PedPartition* part)
         return 1;
 }
 
+typedef struct {
+        PedDisk*                disk;
+        PedGeometry*            end_range;
+        PedPartitionType        part_type;
+        PedGeometry             entire_dev;
+        int                     status;         /* as _rescue_add_partition */
+} RescueScan;
+
+/* Called by ped_file_system_scan for each sector where a file system's
+ * magic was found.  Returns 0 to stop the scan.
+ */
+static int
+_rescue_candidate (PedSector start, void* data)
+{
+        RescueScan*             scan = data;
+        PedDisk*                disk = scan->disk;
+        PedGeometry             start_geom_exact;
+        PedConstraint           constraint;
+        PedPartition*           part;
+
+        ped_geometry_init (&start_geom_exact, disk->dev, start, 1);
+        ped_constraint_init (
+                &constraint, ped_alignment_any, ped_alignment_any,
+                &start_geom_exact, &scan->entire_dev,
+                1, disk->dev->length);
+        part = ped_partition_new (disk, scan->part_type, NULL, start,
+                                  scan->end_range->end);
+        if (!part) {
+                ped_constraint_done (&constraint);
+                return 1;
+        }
+
+        ped_exception_fetch_all ();
+        if (ped_disk_add_partition (disk, part, &constraint)) {
+                ped_exception_leave_all ();
+                scan->status = _rescue_add_partition (part);
+                if (scan->status == 1) {
+                        ped_constraint_done (&constraint);
+                        return 0;
+                }
+                ped_disk_remove_partition (disk, part);
+        } else {
+                ped_exception_leave_all ();
+        }
+        ped_partition_destroy (part);
+        ped_constraint_done (&constraint);
+        return scan->status != -1;
+}
+
 /* hack: we only iterate through the start, since most (all) fs's have their
  * superblocks at the start.  We'll need to change this if we generalize
  * for RAID, or something...
+ *
+ * The search region is read once, and partitions are only tried where
+ * ped_file_system_scan finds the magic of some file system.
  */
 static int
 _rescue_pass (PedDisk* disk, PedGeometry* start_range, PedGeometry* end_range)
 {
-        PedSector               start;
-        PedGeometry             start_geom_exact;
-        PedGeometry             entire_dev;
-        PedConstraint           constraint;
-        PedPartition*           part;
-        PedPartitionType        part_type;
+        RescueScan              scan;
 
-        part_type = _disk_get_part_type_for_sector (
+        scan.disk = disk;
+        scan.end_range = end_range;
+        scan.part_type = _disk_get_part_type_for_sector (
                         disk, (start_range->start + end_range->end) / 2);
-
-        ped_geometry_init (&entire_dev, disk->dev, 0, disk->dev->length);
+        scan.status = 0;
+        ped_geometry_init (&scan.entire_dev, disk->dev, 0, disk->dev->length);
 
         ped_timer_reset (g_timer);
         ped_timer_set_state_name (g_timer, _("searching for file systems"));
-        for (start = start_range->start; start <= start_range->end; start++) {
-                ped_timer_update (g_timer, 1.0 * (start - start_range->start)
-                                         / start_range->length);
-
-                ped_geometry_init (&start_geom_exact, disk->dev, start, 1);
-                ped_constraint_init (
-                        &constraint, ped_alignment_any, ped_alignment_any,
-                        &start_geom_exact, &entire_dev,
-                        1, disk->dev->length);
-                part = ped_partition_new (disk, part_type, NULL, start,
-                                end_range->end);
-                if (!part) {
-                        ped_constraint_done (&constraint);
-                        continue;
-                }
+        if (!ped_file_system_scan_jobs (start_range, opt_jobs, g_timer,
+                                        _rescue_candidate, &scan))
+                return scan.status == 1;
+        return 1;
+}
 
-                ped_exception_fetch_all ();
-                if (ped_disk_add_partition (disk, part, &constraint)) {
-                        ped_exception_leave_all ();
-                        switch (_rescue_add_partition (part)) {
-                        case 1:
-                                ped_constraint_done (&constraint);
-                                return 1;
-
-                        case 0:
-                                ped_disk_remove_partition (disk, part);
-                                break;
-
-                        case -1:
-                                goto error_remove_partition;
-                        }
-                } else {
-                        ped_exception_leave_all ();
-                }
-                ped_partition_destroy (part);
-                ped_constraint_done (&constraint);
+/* Called by ped_file_system_scan with --rescue-report, to list the file
+ * system that starts at START, if any, and ends in the searched REGION.
+ */
+static int
+_rescue_report_candidate (PedSector start, void* data)
+{
+        PedGeometry*                    region = data;
+        PedGeometry                     geom;
+        const PedFileSystemType*        fs_type;
+        PedGeometry*                    probed;
+        char*                           tmp;
+
+        ped_geometry_init (&geom, region->dev, start,
+                           region->end - start + 1);
+        fs_type = ped_file_system_probe (&geom);
+        if (!fs_type)
+                return 1;
+        probed = ped_file_system_probe_specific (fs_type, &geom);
+        if (!probed)
+                return 1;
+        if (!ped_geometry_test_inside (&geom, probed)) {
+                ped_geometry_destroy (probed);
+                return 1;
+        }
+
+        ul_jsonwrt_object_open (&json, NULL);
+        tmp = ped_unit_format (probed->dev, probed->start);
+        ul_jsonwrt_value_s (&json, "start", tmp);
+        free (tmp);
+        tmp = ped_unit_format_byte (probed->dev,
+                                    (probed->end + 1) * probed->dev->sector_size - 1);
+        ul_jsonwrt_value_s (&json, "end", tmp);
+        free (tmp);
+        if (ped_unit_get_default () != PED_UNIT_CHS) {
+                tmp = ped_unit_format (probed->dev, probed->length);
+                ul_jsonwrt_value_s (&json, "size", tmp);
+                free (tmp);
         }
-        ped_timer_update (g_timer, 1.0);
+        ul_jsonwrt_value_s (&json, "filesystem", fs_type->name);
+        ul_jsonwrt_object_close (&json);
 
+        ped_geometry_destroy (probed);
         return 1;
+}
 
-error_remove_partition:
-        ped_disk_remove_partition (disk, part);
-        ped_partition_destroy (part);
-        ped_constraint_done (&constraint);
-        return 0;
+/* With --rescue-report, print every file system found anywhere in REGION
+ * as JSON, without asking anything or touching the partition table,
+ * which need not even be readable.
+ */
+static int
+_rescue_report (PedGeometry* region)
+{
+        int                     ok;
+
+        ul_jsonwrt_init (&json, stdout, 0);
+        ul_jsonwrt_root_open (&json);
+        ul_jsonwrt_object_open (&json, "rescue");
+        ul_jsonwrt_value_s (&json, "path", region->dev->path);
+        ul_jsonwrt_array_open (&json, "filesystems");
+        ok = ped_file_system_scan_jobs (region, opt_jobs, NULL,
+                                        _rescue_report_candidate, region);
+        ul_jsonwrt_array_close (&json);
+        ul_jsonwrt_object_close (&json);
+        ul_jsonwrt_root_close (&json);
+        return ok;
 }
 
 static int
 do_rescue (PedDevice** dev, PedDisk** diskp)
 {
-        PedDisk*                disk;
+        PedDisk*                disk = NULL;
         PedSector               start = 0, end = 0;
         PedSector               fuzz;
         PedGeometry             probe_start_region;
         PedGeometry             probe_end_region;
 
+        /* The table is read again from the device.  */
         if (*diskp) {
+                if (!_disk_end_batch (*diskp))
+                        goto error;
                 ped_disk_destroy (*diskp);
                 *diskp = 0;
         }
-        disk = ped_disk_new (*dev);
-        if (!disk)
-                goto error;
-        if (ped_disk_is_flag_available(disk, PED_DISK_CYLINDER_ALIGNMENT))
-                if (!ped_disk_set_flag(disk, PED_DISK_CYLINDER_ALIGNMENT,
-                                       0))
+        if (!opt_rescue_report) {
+                disk = ped_disk_new (*dev);
+                if (!disk)
                         goto error;
+                if (ped_disk_is_flag_available(disk, PED_DISK_CYLINDER_ALIGNMENT))
+                        if (!ped_disk_set_flag(disk, PED_DISK_CYLINDER_ALIGNMENT,
+                                               0))
+                                goto error;
+        }
 
         if (!command_line_get_sector (_("Start?"), *dev, &start, NULL, NULL))
                 goto error_destroy_disk;
@@ -1827,6 +1988,17 @@ do_rescue (PedDevice** dev, PedDisk** diskp)
                            PED_MAX(end - fuzz, 0),
                            PED_MIN(2 * fuzz, (*dev)->length - (end - fuzz)));
 
+        /* A report is about all that lies between START and END.  */
+        if (opt_rescue_report) {
+                PedGeometry     region;
+
+                ped_geometry_init (&region, *dev, probe_start_region.start,
+                                   PED_MAX (probe_start_region.end,
+                                            probe_end_region.end)
+                                   - probe_start_region.start + 1);
+                return _rescue_report (&region);
+        }
+
         if (!_rescue_pass (disk, &probe_start_region, &probe_end_region))
                 goto error_destroy_disk;
 
@@ -1838,7 +2010,8 @@ do_rescue (PedDevice** dev, PedDisk** diskp)
         return 1;
 
 error_destroy_disk:
-        ped_disk_destroy (disk);
+        if (disk)
+                ped_disk_destroy (disk);
 error:
         return 0;
 }
@@ -1971,6 +2144,10 @@ do_select (PedDevice** dev, PedDisk** diskp)
                 return 0;
         if (!ped_device_open (new_dev))
                 return 0;
+        if (*diskp && !_disk_end_batch (*diskp)) {
+                ped_device_close (new_dev);
+                return 0;
+        }
 
         ped_device_close (*dev);
         if (*diskp) {
@@ -2534,6 +2711,26 @@ while (1)
                 case PRETEND_INPUT_TTY:
                   pretend_input_tty = 1;
                   break;
+                case BATCH_OPTION:
+                  opt_batch_mode = 1;
+                  break;
+                case RESCUE_REPORT_OPTION:
+                  opt_rescue_report = XARGMATCH ("--rescue-report", optarg,
+                                                 rescue_report_args,
+                                                 rescue_report_types);
+                  break;
+                case JOBS_OPTION: {
+                  char *end;
+                  long jobs = strtol (optarg, &end, 10);
+                  if (end == optarg || *end || jobs < 1 || jobs > 1024) {
+                          fprintf (stderr, _("%s: invalid number of jobs: %s\n"),
+                                   program_name, optarg);
+                          wrong = 1;
+                  } else {
+                          opt_jobs = jobs;
+                  }
+                  break;
+                }
                 default:
                   wrong = 1;
                   break;
@@ -2542,7 +2739,7 @@ while (1)
 
 if (wrong == 1) {
         fprintf (stderr,
-                 _("Usage: %s [-hlmsfv] [-a<align>] [DEVICE [COMMAND [PARAMETERS]]...]\n"),
+                 _("Usage: %s [-hlmsfv] [-a<align>] [--jobs=N] [--rescue-report=json] [--batch] [DEVICE [COMMAND [PARAMETERS]]...]\n"),
                  program_name);
         return 0;
 }
@@ -2688,10 +2885,13 @@ main (int argc, char** argv)
         if (!dev)
                 return 1;
 
-        if (argc || opt_script_mode)
+        if (argc || opt_script_mode) {
                 status = non_interactive_mode (&dev, &diskp, commands, argc, argv);
-        else
+        } else {
+                /* There is no last command to write the table after.  */
+                opt_batch_mode = 0;
                 status = interactive_mode (&dev, &diskp, commands);
+        }
 
         _done (dev, diskp);
 
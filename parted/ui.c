@@ -1660,6 +1660,36 @@ interactive_mode (PedDevice** dev, PedDisk** disk, Command* cmd_list[])
 }
 
 
+/* With --batch, make sure the partition table of DEV, if it has one, is
+   read and in a batch before each command, rather than read by the
+   command itself, so that its changes are only written once all
+   commands are done.  Commands may have replaced or dropped *DISK.
+   mklabel replaces the table, so it is left to read the old one, which
+   it does not need to be readable, itself.  */
+static int
+_batch_disk (PedDevice* dev, PedDisk** disk, Command* cmd)
+{
+        if (!*disk && str_list_match_any (cmd->names, "mklabel") == 2)
+                return 1;
+        if (!*disk) {
+                const PedDiskType* type;
+
+                ped_exception_fetch_all ();
+                type = ped_disk_probe (dev);
+                if (!type)
+                        ped_exception_catch ();
+                ped_exception_leave_all ();
+                if (!type)
+                        return 1;
+                *disk = ped_disk_new (dev);
+                if (!*disk)
+                        return 0;
+        }
+        if (!ped_disk_in_batch (*disk) && !ped_disk_begin_batch (*disk))
+                return 0;
+        return 1;
+}
+
 int
 non_interactive_mode (PedDevice** dev, PedDisk **disk, Command* cmd_list[],
                       int argc, char* argv[])
@@ -1692,9 +1722,14 @@ non_interactive_mode (PedDevice** dev, PedDisk **disk, Command* cmd_list[],
                         goto error;
                 }
 
+                if (opt_batch_mode && !_batch_disk (*dev, disk, cmd))
+                        goto error;
                 if (!command_run (cmd, dev, disk))
                         goto error;
         }
+        if (opt_batch_mode && *disk && ped_disk_in_batch (*disk)
+            && !ped_disk_end_batch (*disk))
+                goto error;
         return 1;
 
 error:
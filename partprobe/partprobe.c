@@ -30,6 +30,7 @@
 #include <parted/parted.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
 
@@ -37,6 +38,7 @@
 #include "configmake.h"
 #include "progname.h"
 #include "version-etc.h"
+#include "xalloc.h"
 
 #include <locale.h>
 #include "gettext.h"
@@ -60,6 +62,7 @@ static struct option const long_options[] =
   {
     {"dry-run", no_argument, NULL, 'd'},
     {"summary", no_argument, NULL, 's'},
+    {"jobs", required_argument, NULL, 'j'},
     {"help", no_argument, NULL, 'h'},
     {"version", no_argument, NULL, 'v'},
     {NULL, 0, NULL, 0}
@@ -68,6 +71,7 @@ static struct option const long_options[] =
 /* initialized to 0 according to the language lawyers */
 static int	opt_no_inform;
 static int	opt_summary;
+static int	opt_jobs = 1;
 
 static void
 summary (PedDisk* disk)
@@ -101,7 +105,7 @@ summary (PedDisk* disk)
 }
 
 static int
-process_dev (PedDevice* dev)
+process_dev (PedDevice* dev, void* data)
 {
 	PedDiskType*	disk_type;
 	PedDisk*	disk;
@@ -121,7 +125,13 @@ process_dev (PedDevice* dev)
 		if (!disk)
 			goto error_destroy_disk;
 	} else {
-		disk = ped_disk_new (dev);
+		/* Only the partitions matter here, and the backup GPT can
+		   be far away on a slow device.  Neither does the BIOS
+		   geometry, which msdos may otherwise read the table twice
+		   to find.  */
+		disk = ped_disk_new_with_flags (dev,
+						PED_DISK_OPEN_LAZY_BACKUP
+						| PED_DISK_OPEN_LBA_ONLY);
 		if (!disk)
 			goto error;
 	}
@@ -156,6 +166,7 @@ Inform the operating system about partition table changes.\n\
 \n\
   -d, --dry-run    do not actually inform the operating system\n\
   -s, --summary    print a summary of contents\n\
+  -j, --jobs=N     read up to N devices at once\n\
   -h, --help       display this help and exit\n\
   -v, --version    output version information and exit\n\
 "), stdout);
@@ -182,7 +193,7 @@ main (int argc, char* argv[])
 	atexit (close_stdout);
 
 	int c;
-	while ((c = getopt_long (argc, argv, "dhsv", long_options, NULL)) != -1)
+	while ((c = getopt_long (argc, argv, "dhj:sv", long_options, NULL)) != -1)
 		switch (c) {
 			case 'd':
 				opt_no_inform = 1;
@@ -192,6 +203,20 @@ main (int argc, char* argv[])
 				opt_summary = 1;
 				break;
 
+			case 'j': {
+				char *end;
+				long jobs = strtol (optarg, &end, 10);
+				if (end == optarg || *end || jobs < 1
+				    || jobs > 1024) {
+					fprintf (stderr,
+						 _("%s: invalid number of jobs: %s\n"),
+						 program_name, optarg);
+					usage (EXIT_FAILURE);
+				}
+				opt_jobs = jobs;
+				break;
+			}
+
 			case 'h':
 				usage (EXIT_SUCCESS);
 				break;
@@ -206,22 +231,32 @@ main (int argc, char* argv[])
 				usage (EXIT_FAILURE);
                 }
 
-        int n_dev = argc - optind;
-	if (n_dev != 0) {
+	PedDevice **devs = NULL;
+	int n_dev = 0;
+	if (optind < argc) {
 		int i;
 		for (i = optind; i < argc; i++) {
 			PedDevice *dev = ped_device_get (argv[i]);
-			if (dev == NULL || process_dev (dev) == 0)
+			if (dev == NULL) {
 				status = 1;
+				continue;
+			}
+			devs = xrealloc (devs, (n_dev + 1) * sizeof *devs);
+			devs[n_dev++] = dev;
 		}
 	} else {
 		ped_device_probe_all ();
 		PedDevice *dev;
 		for (dev = ped_device_get_next (NULL); dev;
-		     dev = ped_device_get_next (dev))
-			if (process_dev (dev) == 0)
-				status = 1;
+		     dev = ped_device_get_next (dev)) {
+			devs = xrealloc (devs, (n_dev + 1) * sizeof *devs);
+			devs[n_dev++] = dev;
+		}
 	}
 
+	if (!ped_device_scan (devs, n_dev, opt_jobs, process_dev, NULL))
+		status = 1;
+	free (devs);
+
 	return status;
 }
@@ -0,0 +1,126 @@
+/* Check that every CRC32 implementation libparted may pick agrees with the
+   byte-at-a-time reference, on random buffers of every length up to a few
+   hundred bytes and at every alignment, then on a few large ones.
+
+   With --bench, report the throughput of each instead.  */
+#include <config.h>
+#include <parted/crc32.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+#define BUF_SIZE (1024 * 1024)
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Check FN against the reference on LEN bytes at BUF + OFF, with a random
+   seed.  Return the number of mismatches.  */
+static int
+check (const char *name, efi_crc32_fn fn, const unsigned char *buf,
+       size_t off, size_t len, unsigned int *rand_seed)
+{
+  uint32_t seed = rand_r (rand_seed);
+  uint32_t want = __efi_crc32_ref (buf + off, len, seed);
+  uint32_t got = fn (buf + off, len, seed);
+  if (got == want)
+    return 0;
+  fprintf (stderr, "%s: offset %zu, length %zu, seed %08x: got %08x,"
+           " expected %08x\n", name, off, len, seed, got, want);
+  return 1;
+}
+
+/* Print the throughput of FN over SIZE-byte buffers.  */
+static void
+bench (const char *name, efi_crc32_fn fn, const unsigned char *buf,
+       size_t size)
+{
+  uint32_t crc = 0;
+  size_t total = 0;
+  double t = now ();
+  while (total < 256 * BUF_SIZE)
+    {
+      for (size_t off = 0; off + size <= BUF_SIZE; off += size)
+        crc = fn (buf + off, size, crc);
+      total += BUF_SIZE / size * size;
+    }
+  t = now () - t;
+  printf (" %s %.0f MB/s (%08x)", name, total / t / 1e6, crc);
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  int do_bench = argc > 1 && strcmp (argv[1], "--bench") == 0;
+  if (argc != 1 + do_bench)
+    error (EXIT_FAILURE, 0, "usage: %s [--bench]", argv[0]);
+
+  unsigned char *buf = malloc (BUF_SIZE);
+  if (buf == NULL)
+    error (EXIT_FAILURE, 0, "out of memory");
+  unsigned int rand_seed = 1;
+  for (size_t i = 0; i < BUF_SIZE; i++)
+    buf[i] = rand_r (&rand_seed);
+
+  const char *hw_name;
+  efi_crc32_fn hw = __efi_crc32_hw (&hw_name);
+  struct { const char *name; efi_crc32_fn fn; } impls[] = {
+    { "default", __efi_crc32 },
+    { "slice8", __efi_crc32_slice8 },
+    { hw_name, hw },
+  };
+  int n_impls = hw ? 3 : 2;
+
+  if (do_bench)
+    {
+      /* A 128-entry GPT array, a large one, and a long stretch.  */
+      static const size_t sizes[] = { 16384, 65536, BUF_SIZE };
+      for (int i = 0; i < 3; i++)
+        {
+          printf ("%zu bytes:", sizes[i]);
+          bench ("ref", __efi_crc32_ref, buf, sizes[i]);
+          for (int j = 1; j < n_impls; j++)
+            bench (impls[j].name, impls[j].fn, buf, sizes[i]);
+          printf ("\n");
+        }
+      return EXIT_SUCCESS;
+    }
+
+  /* The reference must still compute the standard CRC32.  */
+  if ((__efi_crc32_ref ("123456789", 9, ~0U) ^ ~0U) != 0xcbf43926)
+    error (EXIT_FAILURE, 0, "reference CRC32 of \"123456789\" is wrong");
+
+  int failures = 0;
+  for (int j = 0; j < n_impls; j++)
+    {
+      for (size_t len = 0; len <= 300; len++)
+        for (size_t off = 0; off < 16; off++)
+          failures += check (impls[j].name, impls[j].fn, buf, off, len,
+                             &rand_seed);
+      for (int k = 0; k < 100; k++)
+        {
+          size_t len = rand_r (&rand_seed) % (BUF_SIZE - 16);
+          failures += check (impls[j].name, impls[j].fn, buf,
+                             rand_r (&rand_seed) % 16, len, &rand_seed);
+        }
+    }
+
+  free (buf);
+  if (failures)
+    error (EXIT_FAILURE, 0, "%d mismatches", failures);
+  return EXIT_SUCCESS;
+}
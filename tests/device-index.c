@@ -0,0 +1,71 @@
+/* Exercise the device list index: lookups by path must find the device
+   that was registered under that path, list order must be kept when
+   devices are removed from its middle and ends, and an unknown device
+   number must not be found.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+static void
+print_list (void)
+{
+  PedDevice *dev = NULL;
+  while ((dev = ped_device_get_next (dev)))
+    printf (" %s", strrchr (dev->path, '/') + 1);
+  printf ("\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  int n = argc - 1;
+  PedDevice **devs = calloc (n, sizeof *devs);
+  if (devs == NULL)
+    return EXIT_FAILURE;
+
+  int i;
+  for (i = 0; i < n; i++)
+    if ((devs[i] = ped_device_get (argv[i + 1])) == NULL)
+      error (EXIT_FAILURE, 0, "failed to get %s", argv[i + 1]);
+  for (i = 0; i < n; i++)
+    if (ped_device_get (argv[i + 1]) != devs[i])
+      error (EXIT_FAILURE, 0, "%s found as another device", argv[i + 1]);
+
+  /* Drop the first, the last and every third device in between.  */
+  for (i = 0; i < n; i++)
+    if (i == 0 || i == n - 1 || i % 3 == 0)
+      {
+        ped_device_destroy (devs[i]);
+        devs[i] = NULL;
+      }
+  print_list ();
+
+  for (i = 0; i < n; i++)
+    if (devs[i] && ped_device_get (argv[i + 1]) != devs[i])
+      error (EXIT_FAILURE, 0, "%s lost", argv[i + 1]);
+
+  /* Dropped devices come back at the end.  */
+  if (n > 0)
+    ped_device_get (argv[1]);
+  print_list ();
+
+  ped_exception_fetch_all ();
+  if (ped_device_get_by_devt (makedev (4095, 1048575)) != NULL)
+    error (EXIT_FAILURE, 0, "found a device that does not exist");
+  ped_exception_catch ();
+  ped_exception_leave_all ();
+
+  ped_device_free_all ();
+  print_list ();
+  return EXIT_SUCCESS;
+}
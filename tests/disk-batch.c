@@ -0,0 +1,83 @@
+/* Add partitions to a new GPT one at a time, committing after each, in a
+   batch, and show that nothing is written until the batch ends, and
+   that ending a nested batch doesn't write either.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+static unsigned long long
+writes (const PedDevice *dev)
+{
+  PedDeviceStats stats;
+  if (!ped_device_get_stats (dev, &stats))
+    error (EXIT_FAILURE, 0, "no I/O statistics for %s", dev->path);
+  return stats.write_requests;
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  if (argc != 2)
+    return EXIT_FAILURE;
+
+  PedDevice *dev = ped_device_get (argv[1]);
+  if (dev == NULL)
+    return EXIT_FAILURE;
+  /* Keep the device open, so that the statistics last.  */
+  if (!ped_device_open (dev))
+    return EXIT_FAILURE;
+
+  PedDisk *disk = ped_disk_new_fresh (dev, ped_disk_type_get ("gpt"));
+  if (disk == NULL)
+    return EXIT_FAILURE;
+
+  unsigned long long before = writes (dev);
+  ped_disk_begin_batch (disk);
+  for (int i = 0; i < 8; i++)
+    {
+      PedSector start = 2048 + i * 2048;
+      PedPartition *part = ped_partition_new (disk, PED_PARTITION_NORMAL,
+                                              NULL, start, start + 2047);
+      if (part == NULL)
+        error (EXIT_FAILURE, 0, "failed to create a partition");
+      PedConstraint *constraint = ped_constraint_exact (&part->geom);
+      if (!ped_disk_add_partition (disk, part, constraint))
+        error (EXIT_FAILURE, 0, "failed to add a partition");
+      ped_constraint_destroy (constraint);
+      if (!ped_disk_commit (disk))
+        error (EXIT_FAILURE, 0, "failed to commit");
+    }
+  printf ("in batch: %d, written: %s\n", ped_disk_in_batch (disk),
+          writes (dev) > before ? "yes" : "no");
+
+  ped_disk_begin_batch (disk);
+  ped_disk_commit (disk);
+  if (!ped_disk_end_batch (disk))
+    error (EXIT_FAILURE, 0, "failed to end the inner batch");
+  printf ("in batch: %d, written: %s\n", ped_disk_in_batch (disk),
+          writes (dev) > before ? "yes" : "no");
+
+  if (!ped_disk_end_batch (disk))
+    error (EXIT_FAILURE, 0, "failed to end the batch");
+  printf ("in batch: %d, written: %s\n", ped_disk_in_batch (disk),
+          writes (dev) > before ? "yes" : "no");
+  ped_disk_destroy (disk);
+
+  disk = ped_disk_new (dev);
+  if (disk == NULL)
+    error (EXIT_FAILURE, 0, "failed to read the label back");
+  printf ("partitions: %d\n", ped_disk_get_last_partition_num (disk));
+  ped_disk_destroy (disk);
+
+  ped_device_close (dev);
+  ped_device_destroy (dev);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+/* libparted-fs-resize picks the FAT table scanner it uses to count free
+   and bad clusters, and to map the free ones, for the CPU it runs on.
+   Make each scanner this CPU can run count and map random FAT16 and
+   FAT32 tables, and compare the results with those of the plain loops.
+
+   The vector scanners deal with the ends of a table apart from its
+   middle, so short tables are tried at every start alignment up to 16
+   entries, and long runs of free or bad entries check that their
+   counters do not wrap.
+
+   With --bench, report how fast each scanner counts and maps FAT16 and
+   FAT32 tables of a few sizes instead.  */
+#include <config.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tablescan.h"
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+#define TABLE_ENTRIES (1024 * 1024)
+#define LONG_RUN 600000
+
+/* Enough for 2 TiB of 32 KiB clusters, FAT32's usual cluster size there.  */
+#define BENCH_ENTRIES (64 * 1024 * 1024)
+
+/* The bad cluster codes, as stored in a table.  */
+#define BAD16 0xfff7
+#define BAD32 0x0ffffff7
+
+static unsigned int rand_seed = 1;
+
+/* Store N random entries of ENTRY_SIZE bytes at TABLE.  One in
+   FREE_ODDS of them is free, and one in BAD_ODDS of the others is bad.
+   Odds of 0 mean none.  */
+static void
+random_table (void *table, int entry_size, size_t n, int free_odds,
+              int bad_odds)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      uint32_t v = rand_r (&rand_seed) | 1;
+      if (free_odds && rand_r (&rand_seed) % free_odds == 0)
+        v = 0;
+      else if (bad_odds && rand_r (&rand_seed) % bad_odds == 0)
+        v = entry_size == 2 ? BAD16 : BAD32;
+      if (entry_size == 2)
+        ((uint16_t *) table)[i] = v;
+      else
+        ((uint32_t *) table)[i] = v;
+    }
+}
+
+struct scan_result
+{
+  size_t n_free;
+  size_t n_bad;
+  uint64_t *map;
+};
+
+/* Scan the N entries of ENTRY_SIZE bytes at TABLE with OPS into R.
+   R->map must have room for one word past the map, which is left
+   alone.  */
+static void
+scan (const FatScanOps *ops, const void *table, int entry_size, size_t n,
+      struct scan_result *r)
+{
+  r->n_free = r->n_bad = 0;
+  if (entry_size == 2)
+    {
+      ops->count16 (table, n, BAD16, &r->n_free, &r->n_bad);
+      ops->free_map16 (table, n, r->map);
+    }
+  else
+    {
+      ops->count32 (table, n, BAD32, &r->n_free, &r->n_bad);
+      ops->free_map32 (table, n, r->map);
+    }
+}
+
+/* Return 1 if OPS scans the N entries of ENTRY_SIZE bytes at TABLE as
+   the plain loops do.  Otherwise say how it went wrong and return 0.  */
+static int
+same_as_plain (const FatScanOps *ops, const void *table, int entry_size,
+               size_t n)
+{
+  static uint64_t plain_map[TABLE_ENTRIES / 64 + 2];
+  static uint64_t ops_map[TABLE_ENTRIES / 64 + 2];
+  size_t map_words = (n + 63) / 64 + 1;
+  struct scan_result plain = { 0, 0, plain_map };
+  struct scan_result got = { 0, 0, ops_map };
+
+  plain_map[map_words - 1] = ops_map[map_words - 1] = 0x5555;
+  scan (fat_scan_ops_get (0), table, entry_size, n, &plain);
+  scan (ops, table, entry_size, n, &got);
+
+  int same_map = !memcmp (plain_map, ops_map, map_words * sizeof *ops_map);
+  if (got.n_free == plain.n_free && got.n_bad == plain.n_bad && same_map)
+    return 1;
+  fprintf (stderr, "%s, FAT%d table of %zu entries: %zu free and %zu bad"
+           " instead of %zu and %zu%s\n", ops->name, entry_size * 8, n,
+           got.n_free, got.n_bad, plain.n_free, plain.n_bad,
+           same_map ? "" : ", and a different free map");
+  return 0;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Print how fast OPS counts, then maps, the N entries of ENTRY_SIZE bytes
+   at TABLE, into MAP.  */
+static void
+bench (const FatScanOps *ops, void *table, uint64_t *map, int entry_size,
+       size_t n)
+{
+  struct scan_result r = { 0, 0, map };
+  size_t total = 0;
+
+  double t = now ();
+  while (total < (size_t) 1024 * 1024 * 1024)
+    {
+      if (entry_size == 2)
+        ops->count16 (table, n, BAD16, &r.n_free, &r.n_bad);
+      else
+        ops->count32 (table, n, BAD32, &r.n_free, &r.n_bad);
+      total += n * entry_size;
+    }
+  double count_t = now () - t;
+
+  total = 0;
+  t = now ();
+  while (total < (size_t) 1024 * 1024 * 1024)
+    {
+      if (entry_size == 2)
+        ops->free_map16 (table, n, map);
+      else
+        ops->free_map32 (table, n, map);
+      total += n * entry_size;
+    }
+  double map_t = now () - t;
+  printf (" %s %.0f/%.0f MB/s", ops->name, total / count_t / 1e6,
+          total / map_t / 1e6);
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  int do_bench = argc > 1 && strcmp (argv[1], "--bench") == 0;
+  if (argc != 1 + do_bench)
+    error (EXIT_FAILURE, 0, "usage: %s [--bench]", argv[0]);
+
+  if (do_bench)
+    {
+      uint32_t *table = malloc (BENCH_ENTRIES * sizeof *table);
+      uint64_t *map = malloc (BENCH_ENTRIES / 8 + sizeof *map);
+      if (table == NULL || map == NULL)
+        error (EXIT_FAILURE, 0, "out of memory");
+
+      /* A full FAT16, then FAT32 tables for 32, 256 and 2048 GiB of
+         32 KiB clusters, with a few free and bad entries.  */
+      static const struct { int entry_size; size_t n; } sizes[] = {
+        { 2, 65536 }, { 4, 1024 * 1024 }, { 4, 8 * 1024 * 1024 },
+        { 4, BENCH_ENTRIES },
+      };
+      for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+        {
+          random_table (table, sizes[i].entry_size, sizes[i].n, 100, 1000);
+          printf ("FAT%d, %zu entries, count/map:",
+                  sizes[i].entry_size * 8, sizes[i].n);
+          const FatScanOps *ops;
+          for (int j = 0; (ops = fat_scan_ops_get (j)); j++)
+            bench (ops, table, map, sizes[i].entry_size, sizes[i].n);
+          printf ("\n");
+        }
+      free (map);
+      free (table);
+      return EXIT_SUCCESS;
+    }
+
+  /* Room for TABLE_ENTRIES FAT32 entries after 16 of alignment.  */
+  uint32_t *entries = malloc ((TABLE_ENTRIES + 16) * sizeof *entries);
+  if (entries == NULL)
+    error (EXIT_FAILURE, 0, "out of memory");
+
+  /* From next to nothing free or bad to everything.  */
+  static const int odds[][2] = { { 1000, 1000 }, { 50, 2 }, { 3, 3 },
+                                 { 1, 1 } };
+  int failures = 0;
+  const FatScanOps *ops;
+  for (int i = 1; (ops = fat_scan_ops_get (i)); i++)
+    for (int entry_size = 2; entry_size <= 4; entry_size += 2)
+      {
+        for (size_t k = 0; k < sizeof odds / sizeof odds[0]; k++)
+          for (size_t n = 0; n <= 300; n++)
+            for (size_t align = 0; align < 16; align++)
+              {
+                void *table = (char *) entries + align * entry_size;
+                random_table (table, entry_size, n, odds[k][0], odds[k][1]);
+                failures += !same_as_plain (ops, table, entry_size, n);
+              }
+
+        for (int k = 0; k < 20; k++)
+          {
+            size_t n = rand_r (&rand_seed) % TABLE_ENTRIES;
+            random_table (entries, entry_size, n,
+                          1 + rand_r (&rand_seed) % (n + 1), 1000);
+            failures += !same_as_plain (ops, entries, entry_size, n);
+          }
+
+        random_table (entries, entry_size, LONG_RUN, 1, 0);
+        failures += !same_as_plain (ops, entries, entry_size, LONG_RUN);
+        random_table (entries, entry_size, LONG_RUN, 0, 1);
+        failures += !same_as_plain (ops, entries, entry_size, LONG_RUN);
+      }
+
+  free (entries);
+  if (failures)
+    error (EXIT_FAILURE, 0, "%d tables scanned wrongly", failures);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+/* Probe a region with no file system, and one with a file system, and
+   show that the sectors where the registered types keep their magic are
+   read in a single system call, and that only the types whose magic
+   matches are probed.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+static void
+probe (PedDevice *dev, PedSector start, PedSector length)
+{
+  PedDeviceStats before, after;
+  PedGeometry geom;
+
+  if (!ped_geometry_init (&geom, dev, start, length))
+    error (EXIT_FAILURE, 0, "bad geometry");
+  ped_device_get_stats (dev, &before);
+  const PedFileSystemType *fs_type = ped_file_system_probe (&geom);
+  ped_device_get_stats (dev, &after);
+  printf ("%lld: %s, %llu read syscalls\n", start,
+          fs_type ? fs_type->name : "none",
+          after.read_syscalls - before.read_syscalls);
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  if (argc != 4)
+    error (EXIT_FAILURE, 0, "usage: %s DEVICE EMPTY-START FS-START",
+           argv[0]);
+
+  PedDevice *dev = ped_device_get (argv[1]);
+  if (dev == NULL)
+    return EXIT_FAILURE;
+  /* Keep the device open, so that the read cache lasts.  */
+  if (!ped_device_open (dev))
+    return EXIT_FAILURE;
+  PedDeviceStats stats;
+  if (!ped_device_get_stats (dev, &stats))
+    error (EXIT_FAILURE, 0, "no I/O statistics for %s", argv[1]);
+
+  PedSector length = 8 * 1024 * 1024 / dev->sector_size;
+  probe (dev, atoll (argv[2]), length);
+  probe (dev, atoll (argv[3]), length);
+
+  ped_device_close (dev);
+  ped_device_destroy (dev);
+  return EXIT_SUCCESS;
+}
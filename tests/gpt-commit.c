@@ -0,0 +1,80 @@
+/* Check that committing a GPT only writes the sectors that changed, and
+   that it falls back to writing everything when the table on disk is no
+   longer the one that was read.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+/* Commit DISK and print how many sectors that wrote, after WHAT.  */
+static void
+commit (PedDisk *disk, const char *what)
+{
+  PedDeviceStats before, after;
+
+  if (!ped_device_get_stats (disk->dev, &before))
+    error (EXIT_FAILURE, 0, "no I/O statistics for %s", disk->dev->path);
+  if (!ped_disk_commit_to_dev (disk))
+    error (EXIT_FAILURE, 0, "failed to commit %s", what);
+  ped_device_get_stats (disk->dev, &after);
+  printf ("%s: %llu\n", what, after.sectors_written - before.sectors_written);
+}
+
+static PedPartition *
+get_partition (PedDisk *disk, int num)
+{
+  PedPartition *part = ped_disk_get_partition (disk, num);
+  if (part == NULL)
+    error (EXIT_FAILURE, 0, "no partition %d", num);
+  return part;
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  if (argc != 2)
+    return EXIT_FAILURE;
+
+  PedDevice *dev = ped_device_get (argv[1]);
+  if (dev == NULL)
+    return EXIT_FAILURE;
+  PedDisk *disk = ped_disk_new (dev);
+  if (disk == NULL)
+    return EXIT_FAILURE;
+
+  commit (disk, "nothing");
+
+  ped_partition_set_name (get_partition (disk, 1), "first");
+  commit (disk, "name 1");
+  commit (disk, "nothing");
+
+  /* Entry 5 is in the second sector of the array.  */
+  ped_partition_set_name (get_partition (disk, 5), "fifth");
+  ped_partition_set_flag (get_partition (disk, 5), PED_PARTITION_HIDDEN, 1);
+  commit (disk, "name and flag 5");
+
+  ped_disk_set_flag (disk, PED_DISK_GPT_PMBR_BOOT, 1);
+  commit (disk, "pmbr_boot");
+
+  /* Change the table behind DISK's back.  */
+  PedDisk *other = ped_disk_new (dev);
+  if (other == NULL)
+    return EXIT_FAILURE;
+  ped_partition_set_name (get_partition (other, 1), "other");
+  commit (other, "other name 1");
+  ped_disk_destroy (other);
+
+  ped_partition_set_name (get_partition (disk, 1), "again");
+  commit (disk, "stale name 1");
+
+  ped_disk_destroy (disk);
+  ped_device_destroy (dev);
+  return EXIT_SUCCESS;
+}
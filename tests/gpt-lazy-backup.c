@@ -0,0 +1,61 @@
+/* Open a GPT whose backup table is damaged with PED_DISK_OPEN_LAZY_BACKUP,
+   and show that the damage is only reported by ped_disk_check or a
+   commit, and only once.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+static PedExceptionOption
+print_exception (PedException *ex)
+{
+  printf ("%s\n", ex->message);
+  return PED_EXCEPTION_OK;
+}
+
+static PedDisk *
+open_disk (PedDevice *dev, int flags)
+{
+  PedDisk *disk = ped_disk_new_with_flags (dev, flags);
+  if (disk == NULL)
+    error (EXIT_FAILURE, 0, "failed to read the label of %s", dev->path);
+  printf ("open%s: %d partitions\n",
+          flags & PED_DISK_OPEN_LAZY_BACKUP ? " lazy" : "",
+          ped_disk_get_last_partition_num (disk));
+  return disk;
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  if (argc != 2)
+    return EXIT_FAILURE;
+
+  PedDevice *dev = ped_device_get (argv[1]);
+  if (dev == NULL)
+    return EXIT_FAILURE;
+  ped_exception_set_handler (print_exception);
+
+  PedDisk *disk = open_disk (dev, PED_DISK_OPEN_LAZY_BACKUP);
+  printf ("check: %d\n", ped_disk_check (disk));
+  printf ("check: %d\n", ped_disk_check (disk));
+  ped_disk_destroy (disk);
+
+  disk = open_disk (dev, PED_DISK_OPEN_LAZY_BACKUP);
+  printf ("commit: %d\n", ped_disk_commit_to_dev (disk));
+  ped_disk_destroy (disk);
+
+  /* The commit rewrote the backup.  */
+  disk = open_disk (dev, 0);
+  ped_disk_destroy (disk);
+
+  ped_device_destroy (dev);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+/* Check that on the Linux backend small reads go through the read cache,
+   each ped_device_write costs exactly one system call, and
+   ped_device_read_batch merges nearby ranges.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  if (argc != 2)
+    return EXIT_FAILURE;
+
+  char const *dev_name = argv[1];
+  PedDevice *dev = ped_device_get (dev_name);
+  if (dev == NULL)
+    return EXIT_FAILURE;
+  if (!ped_device_open (dev))
+    error (EXIT_FAILURE, errno, "failed to open %s\n", dev_name);
+
+  char *buf = ped_malloc (dev->sector_size + 1);
+  if (buf == NULL)
+    return EXIT_FAILURE;
+
+  PedDeviceStats before, after;
+  if (!ped_device_get_stats (dev, &before))
+    error (EXIT_FAILURE, 0, "no I/O statistics for %s\n", dev_name);
+
+  /* Use an unaligned buffer for half of the reads, so that both the
+     bounce-buffer and the direct path are exercised.  */
+  PedSector i;
+  for (i = 0; i < 34; i++)
+    if (!ped_device_read (dev, buf + (i & 1), i, 1))
+      return EXIT_FAILURE;
+  for (i = 0; i < 8; i++)
+    if (!ped_device_write (dev, buf + (i & 1), 100 + i, 1))
+      return EXIT_FAILURE;
+  /* The writes must have dropped the read cache.  */
+  for (i = 0; i < 2; i++)
+    if (!ped_device_read (dev, buf, i, 1))
+      return EXIT_FAILURE;
+
+  ped_device_get_stats (dev, &after);
+  printf ("read requests: %llu\n",
+          after.read_requests - before.read_requests);
+  printf ("read syscalls: %llu\n",
+          after.read_syscalls - before.read_syscalls);
+  printf ("sectors read: %llu\n",
+          after.sectors_read - before.sectors_read);
+  printf ("cache hits: %llu\n",
+          after.cache_hits - before.cache_hits);
+  printf ("cache misses: %llu\n",
+          after.cache_misses - before.cache_misses);
+  printf ("write requests: %llu\n",
+          after.write_requests - before.write_requests);
+  printf ("write syscalls: %llu\n",
+          after.write_syscalls - before.write_syscalls);
+  printf ("sectors written: %llu\n",
+          after.sectors_written - before.sectors_written);
+
+  /* 34 single sectors, in reverse order, then a few scattered ones.
+     Each batch must be served by a single system call.  */
+  PedIoVec iov[34];
+  char *big = ped_malloc (34 * dev->sector_size);
+  if (big == NULL)
+    return EXIT_FAILURE;
+  for (i = 0; i < 34; i++)
+    {
+      iov[i].buffer = big + (33 - i) * dev->sector_size;
+      iov[i].start = 33 - i;
+      iov[i].count = 1;
+    }
+  before = after;
+  if (!ped_device_read_batch (dev, iov, 34))
+    return EXIT_FAILURE;
+  for (i = 0; i < 3; i++)
+    {
+      iov[i].buffer = buf + 1;
+      iov[i].start = 3 * i + 1;
+      iov[i].count = 1;
+    }
+  if (!ped_device_read_batch (dev, iov, 3))
+    return EXIT_FAILURE;
+  ped_device_get_stats (dev, &after);
+  printf ("batch read requests: %llu\n",
+          after.read_requests - before.read_requests);
+  printf ("batch read syscalls: %llu\n",
+          after.read_syscalls - before.read_syscalls);
+
+  free (big);
+  free (buf);
+  ped_device_close (dev);
+  ped_device_destroy (dev);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+/* Write an msdos label with a BIOS geometry that isn't the device's, and
+   check that reading it back finds that geometry, every time the device
+   is opened, unless PED_DISK_OPEN_LBA_ONLY says not to.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+static void
+print_geom (const char *what, const PedDevice *dev)
+{
+  printf ("%s: %d/%d/%d\n", what, dev->bios_geom.cylinders,
+          dev->bios_geom.heads, dev->bios_geom.sectors);
+}
+
+static void
+add_partition (PedDisk *disk, PedPartitionType type, PedSector start,
+               PedSector end)
+{
+  PedPartition *part = ped_partition_new (disk, type, NULL, start, end);
+  if (part == NULL)
+    error (EXIT_FAILURE, 0, "failed to create a partition");
+  PedConstraint *constraint = ped_constraint_exact (&part->geom);
+  if (!ped_disk_add_partition (disk, part, constraint))
+    error (EXIT_FAILURE, 0, "failed to add a partition");
+  ped_constraint_destroy (constraint);
+}
+
+/* Open the label on PATH with FLAGS and print the geometry it leaves
+   the device with.  */
+static void
+read_label (const char *path, int flags, const char *what)
+{
+  PedDevice *dev = ped_device_get (path);
+  if (dev == NULL)
+    exit (EXIT_FAILURE);
+  PedDisk *disk = ped_disk_new_with_flags (dev, flags);
+  if (disk == NULL)
+    error (EXIT_FAILURE, 0, "failed to read the label of %s", path);
+  print_geom (what, dev);
+  ped_disk_destroy (disk);
+  ped_device_destroy (dev);
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  if (argc != 2)
+    return EXIT_FAILURE;
+
+  PedDevice *dev = ped_device_get (argv[1]);
+  if (dev == NULL)
+    return EXIT_FAILURE;
+  print_geom ("device", dev);
+
+  dev->bios_geom.heads = 16;
+  dev->bios_geom.sectors = 63;
+  dev->bios_geom.cylinders = dev->length / (16 * 63);
+  print_geom ("written with", dev);
+
+  PedDisk *disk = ped_disk_new_fresh (dev, ped_disk_type_get ("msdos"));
+  if (disk == NULL)
+    return EXIT_FAILURE;
+  add_partition (disk, PED_PARTITION_NORMAL, 2048, 20479);
+  add_partition (disk, PED_PARTITION_EXTENDED, 20480, 81919);
+  add_partition (disk, PED_PARTITION_LOGICAL, 22528, 40959);
+  add_partition (disk, PED_PARTITION_LOGICAL, 43008, 61439);
+  if (!ped_disk_commit_to_dev (disk))
+    error (EXIT_FAILURE, 0, "failed to commit");
+  ped_disk_destroy (disk);
+  ped_device_destroy (dev);
+
+  read_label (argv[1], 0, "read");
+  read_label (argv[1], 0, "read again");
+  read_label (argv[1], PED_DISK_OPEN_LBA_ONLY, "read LBA only");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/* Exercise the partition geometry index: build a GPT image with room for
+   N partition entries, fill all but one with small partitions separated by
+   gaps, and check that every sector lookup and every overlap check agrees with
+   a plain walk of the partition list.
+
+   With --bench, time sector lookups and partition insertion instead.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+#define SS 512		/* sector size of the image */
+#define PE_SIZE 128	/* size of a GPT partition entry */
+#define PART_LEN 8	/* sectors per partition, and per gap */
+
+static uint32_t
+crc32 (const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+  uint32_t crc = 0xffffffff;
+  while (len--)
+    {
+      crc ^= *p++;
+      for (int k = 0; k < 8; k++)
+        crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+  return ~crc;
+}
+
+static void
+put_le (unsigned char *p, uint64_t v, int len)
+{
+  for (int i = 0; i < len; i++)
+    p[i] = v >> (8 * i);
+}
+
+static void
+write_sector (int fd, const void *buf, uint64_t lba)
+{
+  if (pwrite (fd, buf, SS, lba * SS) != SS)
+    error (EXIT_FAILURE, errno, "write failed");
+}
+
+/* Write an empty GPT with N partition entries, and a protective MBR, to a
+   new sparse image of LEN sectors.  Returns the first usable sector.  */
+static uint64_t
+make_image (const char *file, int n, uint64_t len)
+{
+  int fd = open (file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0 || ftruncate (fd, len * SS) != 0)
+    error (EXIT_FAILURE, errno, "%s", file);
+
+  uint64_t pe_sectors = ((uint64_t) n * PE_SIZE + SS - 1) / SS;
+  unsigned char *zero = calloc (pe_sectors, SS);
+  unsigned char mbr[SS] = { 0 };
+  unsigned char hdr[SS] = { 0 };
+  if (zero == NULL)
+    error (EXIT_FAILURE, errno, "calloc");
+
+  mbr[446 + 4] = 0xee;
+  put_le (mbr + 446 + 8, 1, 4);
+  put_le (mbr + 446 + 12, len - 1 > 0xffffffff ? 0xffffffff : len - 1, 4);
+  mbr[510] = 0x55;
+  mbr[511] = 0xaa;
+  write_sector (fd, mbr, 0);
+
+  for (int backup = 0; backup <= 1; backup++)
+    {
+      uint64_t my_lba = backup ? len - 1 : 1;
+      uint64_t pe_lba = backup ? len - 1 - pe_sectors : 2;
+      memset (hdr, 0, sizeof hdr);
+      memcpy (hdr, "EFI PART", 8);
+      put_le (hdr + 8, 0x00010000, 4);
+      put_le (hdr + 12, 92, 4);
+      put_le (hdr + 24, my_lba, 8);
+      put_le (hdr + 32, backup ? 1 : len - 1, 8);
+      put_le (hdr + 40, 2 + pe_sectors, 8);
+      put_le (hdr + 48, len - 2 - pe_sectors, 8);
+      memset (hdr + 56, 0x5a, 16);
+      put_le (hdr + 72, pe_lba, 8);
+      put_le (hdr + 80, n, 4);
+      put_le (hdr + 84, PE_SIZE, 4);
+      put_le (hdr + 88, crc32 (zero, (size_t) n * PE_SIZE), 4);
+      put_le (hdr + 16, crc32 (hdr, 92), 4);
+      write_sector (fd, hdr, my_lba);
+    }
+
+  free (zero);
+  if (close (fd) != 0)
+    error (EXIT_FAILURE, errno, "%s", file);
+  return 2 + pe_sectors;
+}
+
+/* The answer ped_disk_get_partition_by_sector gave before it had an
+   index.  */
+static PedPartition *
+walk_by_sector (PedDisk *disk, PedSector sect)
+{
+  PedPartition *walk;
+  for (walk = NULL; (walk = ped_disk_next_partition (disk, walk)); )
+    if (ped_geometry_test_sector_inside (&walk->geom, sect)
+        && walk->type != PED_PARTITION_EXTENDED)
+      return walk;
+  return NULL;
+}
+
+static int n_exceptions;
+
+static PedExceptionOption
+count_exceptions (PedException *ex)
+{
+  n_exceptions++;
+  return PED_EXCEPTION_CANCEL;
+}
+
+/* Try to add a partition at START..END; return 1 if that worked, in which
+   case the partition is removed again.  */
+static int
+try_add (PedDisk *disk, PedSector start, PedSector end)
+{
+  PedPartition *part = ped_partition_new (disk, PED_PARTITION_NORMAL,
+                                          NULL, start, end);
+  PedConstraint *exact = ped_constraint_exact (&part->geom);
+  int ok = ped_disk_add_partition (disk, part, exact);
+  ped_constraint_destroy (exact);
+  if (ok)
+    ped_disk_delete_partition (disk, part);
+  else
+    ped_partition_destroy (part);
+  return ok;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  int bench = argc > 1 && strcmp (argv[1], "--bench") == 0;
+  if (argc != 3 + bench)
+    error (EXIT_FAILURE, 0, "usage: %s [--bench] FILE N", argv[0]);
+  const char *file = argv[1 + bench];
+  int n = atoi (argv[2 + bench]);
+  if (n < 2)
+    error (EXIT_FAILURE, 0, "invalid partition count: %s", argv[2 + bench]);
+
+  uint64_t len = 2 * (2 + (n * PE_SIZE + SS - 1) / SS) + 2 * n * PART_LEN
+                 + PART_LEN;
+  PedSector first = make_image (file, n, len);
+
+  PedDevice *dev = ped_device_get (file);
+  if (dev == NULL)
+    return EXIT_FAILURE;
+  PedDisk *disk = ped_disk_new (dev);
+  if (disk == NULL)
+    error (EXIT_FAILURE, 0, "failed to read the label of %s", file);
+  if (ped_disk_get_max_primary_partition_count (disk) != n)
+    error (EXIT_FAILURE, 0, "label has room for %d partitions, not %d",
+           ped_disk_get_max_primary_partition_count (disk), n);
+
+  ped_exception_set_handler (count_exceptions);
+
+  n--;
+  double t = now ();
+  for (int i = 0; i < n; i++)
+    {
+      PedSector start = first + 2 * i * PART_LEN;
+      PedPartition *part = ped_partition_new (disk, PED_PARTITION_NORMAL,
+                                              NULL, start,
+                                              start + PART_LEN - 1);
+      PedConstraint *exact = ped_constraint_exact (&part->geom);
+      if (!ped_disk_add_partition (disk, part, exact))
+        error (EXIT_FAILURE, 0, "failed to add partition %d", i + 1);
+      ped_constraint_destroy (exact);
+    }
+  t = now () - t;
+
+  if (bench)
+    {
+      printf ("%d entries: add %.0f ns", n + 1, t * 1e9 / n);
+      int rounds = 1000000;
+      unsigned int seed = 1;
+      int found = 0;
+      t = now ();
+      for (int i = 0; i < rounds; i++)
+        found += ped_disk_get_partition_by_sector (disk, rand_r (&seed) % len)
+                 != NULL;
+      t = now () - t;
+      printf (", by sector %.0f ns (%d found)", t * 1e9 / rounds, found);
+      rounds = n < 1000 ? 10000 : 1000;
+      t = now ();
+      for (int i = 0; i < rounds; i++)
+        {
+          PedSector gap = first + (2 * (rand_r (&seed) % n) + 1) * PART_LEN;
+          try_add (disk, gap, gap + PART_LEN - 1);
+        }
+      t = now () - t;
+      printf (", add/delete %.0f ns\n", t * 1e9 / rounds);
+      return EXIT_SUCCESS;
+    }
+
+  /* Every partition's edges and the gaps around it.  */
+  int lookups = 0;
+  for (PedSector s = 0; s < dev->length; s++)
+    {
+      PedSector off = s < first ? 0 : (s - first) % PART_LEN;
+      if (s >= first + 2 && off > 0 && off < PART_LEN - 1)
+        continue;
+      PedPartition *got = ped_disk_get_partition_by_sector (disk, s);
+      PedPartition *want = walk_by_sector (disk, s);
+      if (got != want)
+        error (EXIT_FAILURE, 0, "sector %lld: got %d, expected %d",
+               (long long) s, got ? got->num : 0, want ? want->num : 0);
+      lookups++;
+    }
+
+  /* A partition fits each gap, but not one sector more on either side.
+     The last gap runs to the end of the usable area.  */
+  int added = 0;
+  int rejected = 0;
+  for (int i = 0; i < n; i++)
+    {
+      PedSector gap = first + (2 * i + 1) * PART_LEN;
+      added += try_add (disk, gap, gap + PART_LEN - 1);
+      rejected += !try_add (disk, gap - 1, gap + PART_LEN - 1);
+      if (i < n - 1)
+        rejected += !try_add (disk, gap, gap + PART_LEN);
+    }
+
+  printf ("%d partitions, %d lookups\n", ped_disk_get_last_partition_num (disk),
+          lookups);
+  printf ("%d added, %d rejected, %d exceptions\n", added, rejected,
+          n_exceptions);
+
+  ped_disk_destroy (disk);
+  ped_device_destroy (dev);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Small reads must be served by the read cache, 4 KiB at a time, each
+# write must cost one system call (pwrite, not a seek and a write) and
+# drop the cache, and a batch of nearby sectors must be read with one
+# system call.
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted .
+require_512_byte_sector_size_
+
+dev=dev-file
+dd if=/dev/zero of=$dev bs=$sector_size_ count=1 seek=1000 || framework_failure
+
+io-stats $dev > out 2>&1 || fail=1
+cat <<EOT > exp || framework_failure
+read requests: 36
+read syscalls: 6
+sectors read: 48
+cache hits: 30
+cache misses: 6
+write requests: 8
+write syscalls: 8
+sectors written: 8
+batch read requests: 37
+batch read syscalls: 2
+EOT
+compare exp out || fail=1
+
+Exit $fail
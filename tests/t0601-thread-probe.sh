@@ -0,0 +1,41 @@
+#!/bin/sh
+# Probe several devices from several threads at once.  Each thread's
+# exceptions must stay its own.
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted .
+
+for i in 1 2 3 4; do
+  dd if=/dev/zero of=dev$i bs=1M count=0 seek=20 || framework_failure
+done
+parted -s dev1 mklabel gpt mkpart p1 1MiB 5MiB mkpart p2 5MiB 9MiB \
+  > out 2>&1 || fail=1
+parted -s dev2 mklabel msdos mkpart primary 1MiB 5MiB > out 2>&1 || fail=1
+parted -s dev4 mklabel gpt mkpart p1 1MiB 2MiB mkpart p2 2MiB 3MiB \
+  mkpart p3 3MiB 4MiB > out 2>&1 || fail=1
+
+thread-probe dev1 dev2 dev3 dev4 > out 2>&1 || fail=1
+cat <<EOT > exp || framework_failure
+dev1: gpt 2
+dev2: msdos 1
+dev3: none 0
+dev4: gpt 3
+handler calls: 200
+EOT
+compare exp out || fail=1
+
+Exit $fail
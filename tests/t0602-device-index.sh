@@ -0,0 +1,39 @@
+#!/bin/sh
+# The device list must stay in order, and lookups by path must keep
+# working, as devices are added and destroyed.
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted .
+
+# Enough devices to make the index grow a few times.
+devs=
+for i in $(seq 1 150); do
+  dd if=/dev/zero of=dev$i bs=1k count=0 seek=64 2>/dev/null \
+    || framework_failure
+  devs="$devs dev$i"
+done
+
+device-index $devs > out 2>&1 || fail=1
+
+kept=$(for i in $(seq 2 149); do test $(((i - 1) % 3)) = 0 || echo dev$i; done)
+printf ' %s' $kept > exp
+echo >> exp
+printf ' %s' $kept dev1 >> exp
+printf '\n\n' >> exp
+compare exp out || fail=1
+
+Exit $fail
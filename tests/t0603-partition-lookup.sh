@@ -0,0 +1,37 @@
+#!/bin/sh
+# Looking up partitions by sector and checking new partitions for overlaps
+# must give the same answers with large partition tables as with small ones.
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted .
+require_512_byte_sector_size_
+
+partition-lookup dev 128 > out 2>&1 || fail=1
+cat > exp <<EOF
+127 partitions, 558 lookups
+127 added, 253 rejected, 253 exceptions
+EOF
+compare exp out || fail=1
+
+partition-lookup dev 1024 > out 2>&1 || fail=1
+cat > exp <<EOF
+1023 partitions, 4422 lookups
+1023 added, 2045 rejected, 2045 exceptions
+EOF
+compare exp out || fail=1
+
+Exit $fail
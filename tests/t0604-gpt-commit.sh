@@ -0,0 +1,57 @@
+#!/bin/sh
+# Committing a GPT writes only the sectors that changed, unless the label
+# on disk is no longer the one that was read.
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted .
+require_512_byte_sector_size_
+
+dd if=/dev/null of=dev bs=1M seek=20 2>/dev/null || framework_failure_
+parted -s dev mklabel gpt mkpart a 1MiB 2MiB mkpart b 2MiB 3MiB \
+  mkpart c 3MiB 4MiB mkpart d 4MiB 5MiB mkpart e 5MiB 6MiB > out 2>&1 \
+  || fail=1
+compare /dev/null out || fail=1
+
+# A header and an array sector at each end, then the same for the other
+# table, then the protective MBR alone.  A stale table is written whole:
+# the protective MBR, both headers and both 32-sector arrays.
+gpt-commit dev > out 2>&1 || fail=1
+cat > exp <<EOF
+nothing: 0
+name 1: 4
+nothing: 0
+name and flag 5: 4
+pmbr_boot: 1
+other name 1: 4
+stale name 1: 67
+EOF
+compare exp out || fail=1
+
+parted -s -m dev u s p > t 2>&1 || fail=1
+sed 's,.*/dev:,dev:,' t > out || fail=1
+cat > exp <<EOF
+BYT;
+dev:40960s:file:512:512:gpt::pmbr_boot;
+1:2048s:4095s:2048s::again:;
+2:4096s:6143s:2048s::b:;
+3:6144s:8191s:2048s::c:;
+4:8192s:10239s:2048s::d:;
+5:10240s:12287s:2048s::fifth:hidden;
+EOF
+compare exp out || fail=1
+
+Exit $fail
@@ -0,0 +1,45 @@
+#!/bin/sh
+# With PED_DISK_OPEN_LAZY_BACKUP, a damaged backup GPT is only reported when
+# the table is checked or committed.
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted .
+require_512_byte_sector_size_
+
+dd if=/dev/null of=dev bs=1M seek=20 2>/dev/null || framework_failure_
+parted -s dev mklabel gpt mkpart a 1MiB 2MiB mkpart b 2MiB 3MiB > out 2>&1 \
+  || fail=1
+compare /dev/null out || fail=1
+
+# Zero the backup header.
+dd if=/dev/zero of=dev bs=512 seek=40959 count=1 conv=notrunc 2>/dev/null \
+  || framework_failure_
+
+gpt-lazy-backup dev > out 2>&1 || fail=1
+cat > exp <<EOF
+open lazy: 2 partitions
+The backup GPT table is corrupt, but the primary appears OK, so that will be used.
+check: 1
+check: 1
+open lazy: 2 partitions
+The backup GPT table is corrupt, but the primary appears OK, so that will be used.
+commit: 1
+open: 2 partitions
+EOF
+compare exp out || fail=1
+
+Exit $fail
@@ -0,0 +1,56 @@
+#!/bin/sh
+# The logical partitions of an msdos label must all be found, whether
+# their EBRs are evenly spaced, so that they get read ahead, or not.
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted
+require_512_byte_sector_size_
+
+dev=loop-file
+dd if=/dev/null of=$dev bs=1M seek=40 || framework_failure
+cmd="mklabel msdos mkpart extended 2048s 81919s"
+cat > exp <<EOF || framework_failure
+BYT;
+path:81920s:file:512:512:msdos::;
+1:2048s:81919s:79872s:::lba;
+EOF
+
+# Twelve logical partitions of 1MiB, 2MiB apart...
+n=5 start=4096
+for i in $(seq 12); do
+  end=$((start + 2047))
+  cmd="$cmd mkpart logical ${start}s ${end}s"
+  echo "$n:${start}s:${end}s:2048s:::;" >> exp
+  n=$((n + 1)) start=$((start + 4096))
+done
+
+# ... followed by some that aren't.
+for size in 6144 2048 10240; do
+  end=$((start + size - 1))
+  cmd="$cmd mkpart logical ${start}s ${end}s"
+  echo "$n:${start}s:${end}s:${size}s:::;" >> exp
+  n=$((n + 1)) start=$((end + 2049))
+done
+
+parted -s $dev $cmd > out 2>&1 || fail=1
+compare /dev/null out || fail=1
+
+parted -s -m $dev u s p > out 2>&1 || fail=1
+sed "s,^.*/$dev:,path:," out > k && mv k out || fail=1
+compare exp out || fail=1
+
+Exit $fail
@@ -0,0 +1,33 @@
+#!/bin/sh
+# ped_disk_commit writes nothing until the batch it is in ends
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted .
+require_512_byte_sector_size_
+
+dd if=/dev/null of=dev bs=1M seek=40 2>/dev/null || framework_failure_
+
+disk-batch dev > out 2>&1 || fail=1
+cat > exp <<EOF
+in batch: 1, written: no
+in batch: 1, written: no
+in batch: 0, written: yes
+partitions: 8
+EOF
+compare exp out || fail=1
+
+Exit $fail
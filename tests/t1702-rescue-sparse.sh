@@ -0,0 +1,50 @@
+#!/bin/sh
+# rescue a file system in a large, mostly empty, sparse image file
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted
+require_512_byte_sector_size_
+
+( mkfs.ext4 2>&1 | grep -i '^usage' ) > /dev/null \
+    || skip_ "no ext4 support"
+
+dev=loop-file
+dd if=/dev/null of=$dev bs=1M seek=1024 || framework_failure
+parted -s $dev mklabel msdos > out 2>&1 || fail=1
+compare /dev/null out || fail=1
+
+# Put a file system at 300MiB, somewhere in the first of the regions
+# searched.  The rest of the file is a hole.
+mkfs.ext4 -q -F -E offset=$((300 * 1024 * 1024)) $dev 20M \
+    || skip_ "mkfs.ext4 failed"
+
+echo yes | parted ---pretend-input-tty $dev rescue 310M 340M > out 2>&1 \
+    || fail=1
+cat > exp <<EOF
+Information: A ext4 primary partition was found at 315MB -> 336MB.  Do you want to add it to the partition table?
+Yes/No/Cancel? yes
+EOF
+# Remove what erased the progress bar.
+mv out o2 && tr -d '\r' < o2 | sed 's,^  *,,' > out
+compare exp out || fail=1
+
+parted -s -m $dev u s p > out 2>&1 || fail=1
+sed -n 3p out > k && mv k out || fail=1
+echo '1:614400s:655359s:40960s:ext4::;' > exp
+compare exp out || fail=1
+
+Exit $fail
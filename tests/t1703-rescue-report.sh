@@ -0,0 +1,70 @@
+#!/bin/sh
+# list the file systems found by rescue as JSON, with and without threads
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted
+require_512_byte_sector_size_
+
+( mkfs.ext4 2>&1 | grep -i '^usage' ) > /dev/null \
+    || skip_ "no ext4 support"
+
+# No partition table: a report doesn't need one.
+dev=loop-file
+dd if=/dev/null of=$dev bs=1M seek=1024 || framework_failure
+mkfs.ext4 -q -F -E offset=$((100 * 1024 * 1024)) $dev 20M \
+    || skip_ "mkfs.ext4 failed"
+mkfs.ext2 -q -F -E offset=$((700 * 1024 * 1024)) $dev 30M \
+    || skip_ "mkfs.ext2 failed"
+
+cat > exp <<EOF
+{
+   "rescue": {
+      "path": "$PWD/$dev",
+      "filesystems": [
+         {
+            "start": "204800s",
+            "end": "245759s",
+            "size": "40960s",
+            "filesystem": "ext4"
+         },{
+            "start": "1433600s",
+            "end": "1495039s",
+            "size": "61440s",
+            "filesystem": "ext2"
+         }
+      ]
+   }
+}
+EOF
+
+# The region is split among threads, but the report stays in order.
+for jobs in 1 4; do
+  parted -s --jobs=$jobs --rescue-report=json $dev u s rescue 0 100% \
+      > out 2>&1 || fail=1
+  compare exp out || fail=1
+done
+
+# Only JSON reports are supported.
+parted -s --rescue-report=xml $dev u s rescue 0 100% > out 2>&1 && fail=1
+grep 'invalid argument.*xml.*--rescue-report' out > /dev/null \
+    || fail=1
+
+# Nothing was written.
+parted -s $dev p > out 2>&1
+grep "unrecognised disk label" out > /dev/null || fail=1
+
+Exit $fail
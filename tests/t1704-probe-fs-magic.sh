@@ -0,0 +1,48 @@
+#!/bin/sh
+# probing for file systems reads where their magics are in one go
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted .
+require_512_byte_sector_size_
+
+( mkfs.ext2 2>&1 | grep -i '^usage' ) > /dev/null \
+    || skip_ "no ext2 support"
+
+dev=loop-file
+dd if=/dev/null of=$dev bs=1M seek=32 || framework_failure
+mkfs.ext2 -q -F -E offset=$((16 * 1024 * 1024)) $dev 8M \
+    || skip_ "mkfs.ext2 failed"
+
+# Nothing at 1MiB: all the magics are read in one batch, and nothing else.
+# The ext2 file system at 16MiB takes one more read, for its superblock.
+# How many system calls a batch takes depends on the I/O engine and on
+# how far apart the magics are, so only check upper bounds.  Probing each
+# type on its own took 6 and 4.
+fs-probe-io $dev 2048 32768 > out 2>&1 || fail=1
+cat > exp <<EOF
+2048: none
+32768: ext2
+EOF
+sed 's/, [0-9]* read syscalls$//' out > types || fail=1
+compare exp types || fail=1
+
+empty=$(sed -n 's/^2048: none, \([0-9]*\) read syscalls$/\1/p' out)
+ext2=$(sed -n 's/^32768: ext2, \([0-9]*\) read syscalls$/\1/p' out)
+test -n "$empty" && test "$empty" -le 2 || fail=1
+test -n "$ext2" && test "$ext2" -le 3 || fail=1
+
+Exit $fail
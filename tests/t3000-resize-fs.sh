@@ -28,7 +28,10 @@ FSTYPES=""
 mkfs.hfsplus 2>&1 | grep '^usage:' && FSTYPES="hfs+"
 
 # Is mkfs.vfat available?
-mkfs.vfat 2>&1 | grep '^Usage:' && FSTYPES="$FSTYPES fat32 fat16"
+# The -windowed variants resize with FAT tables bigger than their memory
+# budget, so that they are paged in and out of a temporary file.
+mkfs.vfat 2>&1 | grep '^Usage:' &&
+  FSTYPES="$FSTYPES fat32 fat16 fat32-windowed fat16-windowed"
 
 [ -n "$FSTYPES" ] || skip_ "Neither mkfs.hfsplus nor mkfs.vfat installed"
 
@@ -76,7 +79,12 @@ for fs_type in $FSTYPES; do
   # wait for new partition device to appear
   wait_for_dev_to_appear_ ${dev}1
 
+  fat_memory=
   case $fs_type in
+    *-windowed) fat_memory=64K;;
+  esac
+
+  case ${fs_type%-windowed} in
     fat16) mkfs_cmd='mkfs.vfat -F 16'; fsck='fsck.vfat -v';;
     fat32) mkfs_cmd='mkfs.vfat -F 32'; fsck='fsck.vfat -v';;
     hfs*) mkfs_cmd='mkfs.hfsplus';     fsck=fsck.hfsplus;;
@@ -97,10 +105,11 @@ for fs_type in $FSTYPES; do
 
   # NOTE: shrinking is the only type of resizing that works.
   # resize that file system to be one cylinder (8MiB) smaller
-  fs-resize ${dev}1 0 $new_end > out 2>&1 || fail=1
+  PARTED_FAT_TABLE_MEMORY=$fat_memory fs-resize ${dev}1 0 $new_end > out 2>&1 \
+    || fail=1
 
   # check for expected output
-  case $fs_type in
+  case ${fs_type%-windowed} in
     fat16) cat << EOF > exp || framework_failure
 Information: Would you like to use FAT32?  If you leave your file system as FAT16, then you will have no problems.  If you convert to FAT32, and MS Windows is installed on this partition, then you must re-install the MS Windows boot loader.  If you want to do this, you should consult the Parted manual (or your distribution's manual).  Also, converting to FAT32 will make the file system unreadable by MS DOS, MS Windows 95a, and MS Windows NT.
 EOF
@@ -0,0 +1,75 @@
+#!/bin/sh
+# with --batch, parted writes the partition table once, after all commands
+
+# Copyright (C) 2026 Free Software Foundation, Inc.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/init.sh"; path_prepend_ ../parted
+require_512_byte_sector_size_
+
+dev=loop-file
+
+cmds="mklabel gpt"
+for i in 1 2 3 4 5 6 7 8; do
+  cmds="$cmds mkpart p$i ${i}MiB $((i + 1))MiB"
+done
+cmds="$cmds name 3 three rm 5 set 2 boot on"
+
+# The same script, with and without --batch, makes the same table.
+for mode in plain batch; do
+  opt=; test $mode = batch && opt=--batch
+  dd if=/dev/null of=$dev bs=1M seek=20 2>/dev/null || framework_failure_
+  parted -s $opt $dev $cmds > out 2>&1 || fail=1
+  compare /dev/null out || fail=1
+  parted -s -m $dev u s p > out-$mode 2>&1 || fail=1
+  rm $dev
+done
+compare out-plain out-batch || fail=1
+
+# Commands are still checked one at a time, and the failing one is
+# reported.  Then nothing at all is written.
+dd if=/dev/null of=$dev bs=1M seek=20 2>/dev/null || framework_failure_
+parted -s $dev mklabel msdos > out 2>&1 || fail=1
+parted -s --batch $dev mklabel gpt mkpart p1 1MiB 2MiB \
+    mkpart p2 1MiB 3MiB mkpart p3 3MiB 4MiB > out 2>&1 && fail=1
+cat > exp <<EOF
+Error: You requested a partition from 1049kB to 3145kB (sectors 2048..6143).
+The closest location we can manage is 1048kB to 1048kB (sectors 2047..2047).
+EOF
+compare exp out || fail=1
+parted -s -m $dev p > out 2>&1 || fail=1
+sed -n 2p out | cut -d: -f6 > k && mv k out || fail=1
+echo msdos > exp
+compare exp out || fail=1
+
+# mklabel replaces a table that cannot be read, as it does without --batch.
+dd if=/dev/null of=$dev bs=1M seek=20 2>/dev/null || framework_failure_
+parted -s $dev mklabel msdos mkpart primary 1MiB 3MiB \
+    mkpart primary 3MiB 5MiB > out 2>&1 || fail=1
+# Start the second partition at 1MiB, on top of the first.
+printf '\000\010\000\000' \
+    | dd of=$dev bs=1 seek=470 conv=notrunc 2>/dev/null || framework_failure_
+parted -s -m $dev p > out 2>&1 && fail=1
+parted -s --batch $dev mklabel gpt mkpart p1 1MiB 2MiB > out 2>&1 || fail=1
+compare /dev/null out || fail=1
+parted -s -m $dev u s p > out 2>&1 || fail=1
+sed -n '2s/.*:\(gpt\):.*/\1/p;3p' out > k && mv k out || fail=1
+cat > exp <<EOF
+gpt
+1:2048s:4095s:2048s::p1:;
+EOF
+compare exp out || fail=1
+
+Exit $fail
@@ -0,0 +1,112 @@
+/* Read the partition tables of several devices at once, one thread per
+   device, to check that exception state is per thread: exceptions
+   fetched in one thread must neither reach the handler nor be caught by
+   another thread.  */
+#include <config.h>
+#include <parted/parted.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "closeout.h"
+#include "progname.h"
+#include "error.h"
+
+#define ROUNDS 50
+
+static int handler_calls;
+
+struct probe
+{
+  const char *path;
+  char label[32];
+  int n_parts;
+  int ok;
+};
+
+static PedExceptionOption
+count_handler (PedException *ex)
+{
+  __atomic_add_fetch (&handler_calls, 1, __ATOMIC_RELAXED);
+  return PED_EXCEPTION_OK;
+}
+
+static void *
+probe_thread (void *arg)
+{
+  struct probe *p = arg;
+  int i;
+
+  p->ok = 1;
+  for (i = 0; i < ROUNDS; i++)
+    {
+      /* The error this throws must stay in this thread.  */
+      ped_exception_fetch_all ();
+      if (ped_device_get ("/nonexistent/device") != NULL)
+        p->ok = 0;
+      ped_exception_catch ();
+
+      PedDevice *dev = ped_device_get (p->path);
+      PedDisk *disk = dev ? ped_disk_new (dev) : NULL;
+      ped_exception_catch ();
+      ped_exception_leave_all ();
+
+      if (disk)
+        {
+          strcpy (p->label, disk->type->name);
+          p->n_parts = ped_disk_get_last_partition_num (disk);
+          ped_disk_destroy (disk);
+        }
+      else
+        {
+          strcpy (p->label, "none");
+          p->n_parts = 0;
+        }
+
+      /* And this one must go to the handler.  */
+      if (ped_exception_throw (PED_EXCEPTION_INFORMATION, PED_EXCEPTION_OK,
+                               "%s", p->path) != PED_EXCEPTION_OK)
+        p->ok = 0;
+    }
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  atexit (close_stdout);
+  set_program_name (argv[0]);
+
+  int n = argc - 1;
+  if (n < 1)
+    return EXIT_FAILURE;
+
+  struct probe *probes = calloc (n, sizeof *probes);
+  pthread_t *threads = calloc (n, sizeof *threads);
+  if (probes == NULL || threads == NULL)
+    return EXIT_FAILURE;
+
+  ped_exception_set_handler (count_handler);
+
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      probes[i].path = argv[i + 1];
+      if (pthread_create (&threads[i], NULL, probe_thread, &probes[i]))
+        error (EXIT_FAILURE, 0, "failed to create a thread");
+    }
+
+  int status = EXIT_SUCCESS;
+  for (i = 0; i < n; i++)
+    {
+      pthread_join (threads[i], NULL);
+      printf ("%s: %s %d\n", probes[i].path, probes[i].label,
+              probes[i].n_parts);
+      if (!probes[i].ok)
+        status = EXIT_FAILURE;
+    }
+  printf ("handler calls: %d\n", handler_calls);
+
+  return status;
+}